@@ -0,0 +1,322 @@
+// autotune.h — Startup kernel autotuner for the visualizer.
+// Times every kernel in the selected pipeline's grid (pipelines.h) on a
+// synthetic signal for the active layout, checks each against the
+// baseline kernel, and switches to the fastest one that agrees.  The
+// choice is cached on disk per CPU model, pipeline and layout, so each
+// host measures once.  Layout changes while running are tuned on a
+// background thread; the workers keep the current kernel meanwhile.
+// Header-only, C++17 standard library + OS APIs.
+#ifndef VIS_AUTOTUNE_H
+#define VIS_AUTOTUNE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+  #include <direct.h>
+  #include <intrin.h>
+#else
+  #include <sys/stat.h>
+#endif
+
+#include "protocol.h"
+#include "fft.h"
+#include "pipelines.h"
+
+constexpr int AUTOTUNE_VERSION = 1;     // bump when kernels change behaviour
+constexpr int TUNE_WARMUP      = 20;    // frames before timing (sensitivity settles)
+constexpr int TUNE_FRAMES      = 40;    // frames per timed round
+constexpr int TUNE_ROUNDS      = 3;     // best round counts
+
+// CPU model string, e.g. "AMD Ryzen 7 7840U w/ Radeon 780M Graphics".
+static std::string cpuModel() {
+#ifdef _WIN32
+    int regs[4];
+    char brand[49] = {};
+    __cpuid(regs, 0x80000000);
+    if ((unsigned)regs[0] >= 0x80000004) {
+        for (int i = 0; i < 3; i++) {
+            __cpuid(regs, 0x80000002 + i);
+            memcpy(brand + i * 16, regs, 16);
+        }
+    }
+    std::string model = brand;
+#else
+    std::string model;
+    if (FILE* f = fopen("/proc/cpuinfo", "r")) {
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            // x86: "model name"; arm64 has no name, only implementer/part
+            if (strncmp(line, "model name", 10) == 0 || strncmp(line, "CPU part", 8) == 0) {
+                const char* v = strchr(line, ':');
+                if (v) { model = v + 1; break; }
+            }
+        }
+        fclose(f);
+    }
+#endif
+    // Trim, and keep the cache format (tab-separated lines) intact.
+    for (char& c : model) if (c == '\t' || c == '\n' || c == '\r') c = ' ';
+    size_t b = model.find_first_not_of(' '), e = model.find_last_not_of(' ');
+    return b == std::string::npos ? "unknown" : model.substr(b, e - b + 1);
+}
+
+// Cache file: $XDG_CACHE_HOME/clear-vis/kernels (or ~/.cache/...),
+// %LOCALAPPDATA%\clear-vis\kernels on Windows.  Empty if no home.
+static std::string autotuneCachePath(bool create) {
+    std::string dir;
+#ifdef _WIN32
+    if (const char* la = getenv("LOCALAPPDATA")) dir = std::string(la) + "\\clear-vis";
+    if (dir.empty()) return "";
+    if (create) _mkdir(dir.c_str());
+    return dir + "\\kernels";
+#else
+    if (const char* x = getenv("XDG_CACHE_HOME"); x && *x) dir = std::string(x) + "/clear-vis";
+    else if (const char* h = getenv("HOME"); h && *h) dir = std::string(h) + "/.cache/clear-vis";
+    if (dir.empty()) return "";
+    if (create) {
+        mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0755);
+        mkdir(dir.c_str(), 0755);
+    }
+    return dir + "/kernels";
+#endif
+}
+
+// One cache line per host/config: "<key>\t<kernel>\t<us/frame>".
+static std::string autotuneKey(const PipelineVariant& v, int barCount, float freqMax) {
+    char buf[96];
+    snprintf(buf, sizeof(buf), "v%d|%s|fft%d|bars%d|fmax%d", AUTOTUNE_VERSION, v.name,
+             FFT_SIZE, barCount, (int)freqMax);
+    return cpuModel() + "|" + buf;
+}
+
+static int autotuneLoad(const std::string& key) {
+    std::string path = autotuneCachePath(false);
+    FILE* f = path.empty() ? nullptr : fopen(path.c_str(), "r");
+    if (!f) return -1;
+    int found = -1;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        char* tab = strchr(line, '\t');
+        if (!tab || std::string(line, tab - line) != key) continue;
+        char* end = strchr(tab + 1, '\t');
+        if (!end) continue;
+        *end = '\0';
+        found = parseKernelName(tab + 1);
+    }
+    fclose(f);
+    return found;
+}
+
+static void autotuneStore(const std::string& key, int kernel, double usPerFrame) {
+    std::string path = autotuneCachePath(true);
+    if (path.empty()) return;
+    std::vector<std::string> keep;
+    if (FILE* f = fopen(path.c_str(), "r")) {
+        char line[512];
+        while (fgets(line, sizeof(line), f)) {
+            const char* tab = strchr(line, '\t');
+            if (tab && std::string(line, tab - line) != key) keep.push_back(line);
+        }
+        fclose(f);
+    }
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "[vis] could not write kernel cache %s\n", path.c_str());
+        return;
+    }
+    for (const std::string& l : keep) fputs(l.c_str(), f);
+    char name[64];
+    kernelName(kernel, name, sizeof(name));
+    fprintf(f, "%s\t%s\t%.2f\n", key.c_str(), name, usPerFrame);
+    fclose(f);
+    remove(path.c_str());   // rename() does not replace on Windows
+    rename(tmp.c_str(), path.c_str());
+}
+
+// Deterministic test signal: a few tones over noise, loud enough that
+// the auto-sensitivity path is exercised.
+static void tuneSignal(std::vector<float>& pcm, int frames) {
+    pcm.resize((size_t)frames * FRAME_SAMPLES);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < pcm.size(); i++) {
+        seed = seed * 1664525u + 1013904223u;
+        float noise = ((seed >> 9) * (1.0f / 8388608.0f) - 0.5f) * 0.1f;
+        float t = (float)i / SAMPLE_RATE;
+        pcm[i] = noise + 0.3f * sinf(2.0f * (float)M_PI * 110.0f * t)
+                       + 0.15f * sinf(2.0f * (float)M_PI * 1750.0f * t)
+                       + 0.05f * sinf(2.0f * (float)M_PI * 7200.0f * t);
+    }
+}
+
+// Time and check every kernel for the current layout (the published
+// config snapshot).  us[k] gets the best-round time per frame, or -1 if the
+// kernel disagreed with the baseline.  Returns the fastest good kernel.
+static int autotuneMeasure(const PipelineVariant& v, double us[KERNEL_COUNT]) {
+    const int frames = TUNE_WARMUP + TUNE_FRAMES * TUNE_ROUNDS;
+    std::vector<float> pcm;
+    tuneSignal(pcm, frames);
+    std::vector<float> base((size_t)frames * MAX_BAR_COUNT), out(base.size());
+    static VisProcessor p;      // ~100 KB; tuning runs on one thread at a time
+
+    int best = 0;
+    for (int k = 0; k < KERNEL_COUNT; k++) {
+        ProcessFn fn = v.tuneKernels[k];
+        std::vector<float>& dst = k == 0 ? base : out;
+        auto run = [&](int f) { fn(p, &pcm[(size_t)f * FRAME_SAMPLES], &dst[(size_t)f * MAX_BAR_COUNT]); };
+        initProcessor(p);
+        int f = 0;
+        for (; f < TUNE_WARMUP; f++) run(f);
+        double bestRound = 1e30;
+        for (int r = 0; r < TUNE_ROUNDS; r++) {
+            auto t0 = std::chrono::steady_clock::now();
+            for (int i = 0; i < TUNE_FRAMES; i++, f++) run(f);
+            bestRound = std::min(bestRound, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+        }
+        us[k] = bestRound * 1e6 / TUNE_FRAMES;
+
+        if (k > 0) {
+            float maxErr = 0.0f;
+            double sq = 0.0;
+            for (int f = 0; f < frames; f++) {
+                for (int b = 0; b < p.barCount; b++) {
+                    float e = fabsf(out[(size_t)f * MAX_BAR_COUNT + b] - base[(size_t)f * MAX_BAR_COUNT + b]);
+                    maxErr = std::max(maxErr, e);
+                    sq += (double)e * e;
+                }
+            }
+            if (maxErr > KERNEL_MAX_ERR || sqrt(sq / ((double)frames * p.barCount)) > KERNEL_RMS_ERR) {
+                char name[64];
+                kernelName(k, name, sizeof(name));
+                fprintf(stderr, "[vis] kernel %s rejected: max err %.4f vs baseline\n", name, maxErr);
+                us[k] = -1.0;
+                continue;
+            }
+        }
+        if (us[k] < us[best]) best = k;
+    }
+    return best;
+}
+
+static int  g_kernelOverride = -1;      // --kernels NAME, -1 = autotune
+static bool g_retune = false;           // --retune: ignore the cache at startup
+
+static inline void listKernels() {
+    char name[64];
+    fprintf(stderr, "  %-28s (default) time them all, use the fastest\n", "auto");
+    for (int k = 0; k < KERNEL_COUNT; k++) {
+        kernelName(k, name, sizeof(name));
+        fprintf(stderr, "  %s%s\n", name, k == 0 ? "  (baseline)" : "");
+    }
+}
+
+// Pick kernels for the selected pipeline and the current layout: from
+// the cache unless `retune`, else by measuring (and caching the result).
+static void autotune(bool retune) {
+    const PipelineVariant& v = *g_pipeline;
+    if (!v.kernels) {
+        fprintf(stderr, "[vis] kernels: %s has no alternatives\n", v.name);
+        return;
+    }
+    int barCount;
+    float freqMax;
+    currentConfig(&barCount, &freqMax);
+    std::string key = autotuneKey(v, barCount, freqMax);
+    char name[64];
+    int k = retune ? -1 : autotuneLoad(key);
+    if (k >= 0) {
+        selectKernel(k);
+        kernelName(k, name, sizeof(name));
+        fprintf(stderr, "[vis] kernels: %s (cached for this CPU, %d bars)\n", name, barCount);
+        return;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    double us[KERNEL_COUNT];
+    k = autotuneMeasure(v, us);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    // The layout moved under a background measurement: its timings are
+    // mixed, and the request behind the change tunes again.
+    int nowCount;
+    float nowFreq;
+    currentConfig(&nowCount, &nowFreq);
+    if (nowCount != barCount || nowFreq != freqMax) return;
+    selectKernel(k);
+    autotuneStore(key, k, us[k]);
+    kernelName(k, name, sizeof(name));
+    fprintf(stderr, "[vis] kernels: %s, %.1f us/frame vs %.1f baseline (tuned in %.0f ms, %d bars)\n",
+            name, us[k], us[0], ms, barCount);
+}
+
+// Background retuning: one thread, started on first use.  Requests
+// made while it measures collapse into one more pass for the latest
+// layout.
+static std::mutex              g_tuneMtx;
+static std::condition_variable g_tuneCv;
+static std::thread             g_tuneThread;
+static uint64_t                g_tuneWanted = 0, g_tuneDone = 0;
+static bool                    g_tuneStop = false;
+
+static void tuneLoop() {
+    std::unique_lock<std::mutex> lock(g_tuneMtx);
+    for (;;) {
+        g_tuneCv.wait(lock, [] { return g_tuneStop || g_tuneDone != g_tuneWanted; });
+        if (g_tuneStop) return;
+        const uint64_t gen = g_tuneWanted;
+        lock.unlock();
+        autotune(false);
+        lock.lock();
+        g_tuneDone = gen;
+    }
+}
+
+// Join the tuner (an unfinished measurement is abandoned at its end).
+// Call before exit.
+static void stopKernelTuner() {
+    {
+        std::lock_guard<std::mutex> lock(g_tuneMtx);
+        g_tuneStop = true;
+    }
+    g_tuneCv.notify_one();
+    if (g_tuneThread.joinable()) g_tuneThread.join();
+}
+
+// Apply the kernel choice for the current layout: the --kernels override
+// if given, otherwise autotune.  At startup this is done before
+// returning.  On a later layout change it returns at once and the
+// tuner thread looks up (or measures, ~150 ms for a new layout) the
+// kernel and swaps it in; frames keep flowing on the current one.
+static void configureKernels(bool startup) {
+    if (g_kernelOverride < 0) {
+        if (startup) {
+            autotune(g_retune);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(g_tuneMtx);
+            g_tuneWanted++;
+            if (!g_tuneThread.joinable()) g_tuneThread = std::thread(tuneLoop);
+        }
+        g_tuneCv.notify_one();
+        return;
+    }
+    if (!startup) return;
+    char name[64];
+    kernelName(g_kernelOverride, name, sizeof(name));
+    if (selectKernel(g_kernelOverride))
+        fprintf(stderr, "[vis] kernels: %s (--kernels)\n", name);
+    else
+        fprintf(stderr, "[vis] --kernels %s ignored: %s has no alternatives\n", name, g_pipeline->name);
+}
+
+#endif // VIS_AUTOTUNE_H
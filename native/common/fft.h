@@ -3,13 +3,16 @@
 // auto-sensitivity, asymmetric EMA smoothing, and gravity falloff.
 // Uses simple gain=1.0 EMA instead of cava's integral accumulator
 // to guarantee bars cannot lock up at max values.
+// Stages are compile-time policies; see processFrameT and pipelines.h.
 // Header-only, no external dependencies.
 #ifndef VIS_FFT_H
 #define VIS_FFT_H
 
+#include <cstdint>
 #include <cmath>
 #include <cstring>
 #include <cstdio>
+#include <atomic>
 #include <algorithm>
 
 // MSVC does not define M_PI from <cmath> unless _USE_MATH_DEFINES is set
@@ -19,6 +22,7 @@
 #endif
 
 #include "protocol.h"
+#include "snapshot.h"
 
 // ---- Tuning constants ----
 
@@ -60,8 +64,35 @@ constexpr float SENS_MAX        = 5.0f;
 // nearly flat response across all bars for broadband audio.
 constexpr float EQ_POWER        = 0.5f;
 
+// Runtime values of the constants above.  Defaults are the constants;
+// a settings file (settings.h) overrides them, and a reload swaps them
+// in with the next config snapshot without resetting any state.
+struct VisTuning {
+    float smoothAttack     = SMOOTH_ATTACK;
+    float smoothDecay      = SMOOTH_DECAY;
+    float gravity          = GRAVITY;
+    float silenceThreshold = SILENCE_THRESHOLD;
+    float sensInit         = SENS_INIT;
+    float sensAttack       = SENS_ATTACK;
+    float sensRelease      = SENS_RELEASE;
+    float sensInitBoost    = SENS_INIT_BOOST;
+    float sensInitCap      = SENS_INIT_CAP;
+    float sensTarget       = SENS_TARGET;
+    float sensMin          = SENS_MIN;
+    float sensMax          = SENS_MAX;
+    float eqPower          = EQ_POWER;
+};
+
 // ---- Complex helpers ----
 struct Complex { float re, im; };
+struct ComplexQ15 { int16_t re, im; };   // fixed-point path (fft_fixed.h)
+
+// Fixed-point formats (fft_fixed.h): bars in Q16, the gain in Q30.
+constexpr int32_t FX_ONE = 1 << 16;     // 1.0 in Q16
+constexpr int     FX_SENS_BITS = 30;    // gain is Q30
+
+static inline int32_t fxQ16(float v) { return (int32_t)lrintf(v * (float)FX_ONE); }
+static inline int64_t fxQ30(float v) { return llrint((double)v * (1 << FX_SENS_BITS)); }
 
 static inline Complex cadd(Complex a, Complex b) { return {a.re+b.re, a.im+b.im}; }
 static inline Complex csub(Complex a, Complex b) { return {a.re-b.re, a.im-b.im}; }
@@ -69,13 +100,14 @@ static inline Complex cmul(Complex a, Complex b) {
     return {a.re*b.re - a.im*b.im, a.re*b.im + a.im*b.re};
 }
 
-// ---- Bit-reversal permutation ----
-static void bitReverse(Complex* buf, int n) {
+// ---- Bit-reversal permutation (any element type) ----
+template <class T>
+static void bitReverse(T* buf, int n) {
     for (int i = 1, j = 0; i < n; i++) {
         int bit = n >> 1;
         for (; j & bit; bit >>= 1) j ^= bit;
         j ^= bit;
-        if (i < j) { Complex t = buf[i]; buf[i] = buf[j]; buf[j] = t; }
+        if (i < j) { T t = buf[i]; buf[i] = buf[j]; buf[j] = t; }
     }
 }
 
@@ -98,177 +130,512 @@ static void fft(Complex* buf, int n) {
     }
 }
 
-// ---- Runtime-configurable parameters ----
-static int   g_barCount = BAR_COUNT;    // current bar count (default 72)
-static float g_freqMax  = FREQ_MAX;     // current upper freq cutoff
+// ---- In-place radix-2 FFT with a precomputed twiddle table ----
+// Same butterflies as fft(), but each twiddle is read from `tw`
+// (tw[k] = e^(-2*pi*i*k/n), n/2 entries) instead of being advanced by a
+// complex multiply per butterfly: fewer flops, and no rounding drift
+// along the recurrence.
+static void fftTable(const Complex* tw, Complex* buf, int n) {
+    bitReverse(buf, n);
+    for (int len = 2; len <= n; len <<= 1) {
+        int half = len / 2, step = n / len;
+        for (int i = 0; i < n; i += len) {
+            for (int j = 0; j < half; j++) {
+                Complex u = buf[i + j];
+                Complex v = cmul(tw[j * step], buf[i + j + half]);
+                buf[i + j]        = cadd(u, v);
+                buf[i + j + half] = csub(u, v);
+            }
+        }
+    }
+}
+
+// ---- Runtime configuration ----
+// Everything derived from the layout (bar count, frequency range) and
+// the tuning: the window, the bin ranges, EQ weights and the FFT
+// twiddles, for the float and fixed-point paths.  A snapshot is
+// immutable once published.  Commands and reloads build a new one off
+// the DSP threads and swap it in (publishConfig); each processor picks
+// it up at the start of its next frame, and resets only if the layout
+// changed, so a rebuild never stalls or tears a frame and a tuning
+// change keeps the smoothing and gain state.
+struct VisConfig {
+    uint64_t layoutGen;                 // bumped when barCount / freqMax change
+    int   barCount;
+    float freqMax;
+    VisTuning tune;
+    float window[FFT_SIZE];             // Hann window (full FFT buffer)
+    int   binLo[MAX_BAR_COUNT];         // FFT bin lower bound per bar
+    int   binHi[MAX_BAR_COUNT];         // FFT bin upper bound per bar
+    float eq[MAX_BAR_COUNT];            // per-bar EQ weight
+    int   binTop;                       // one past the highest bin any bar reads
+    Complex twiddle[FFT_SIZE / 2];      // e^(-2*pi*i*k/N) for fftTable()
+
+    // Fixed-point path (fft_fixed.h)
+    int16_t    fxWindow[FFT_SIZE];      // Hann window, Q15
+    ComplexQ15 fxTwiddle[FFT_SIZE / 2]; // e^(-2*pi*i*k/N), Q15
+    int32_t    fxEq[MAX_BAR_COUNT];     // per-bar EQ weight, Q16
+    int32_t    fxSmoothAttack, fxSmoothDecay, fxGravity, fxSensTarget;     // Q16
+    int64_t    fxSensInit, fxSensAttack, fxSensRelease, fxSensInitBoost,   // Q30
+               fxSensInitCap, fxSensMin, fxSensMax;
+    int32_t    fxSilence;               // |s| < this is silence (S16)
+};
+
+static VisConfig* buildConfig(int barCount, float freqMax, const VisTuning& tune, uint64_t layoutGen) {
+    VisConfig* c = new VisConfig;
+    c->layoutGen = layoutGen;
+    c->barCount = barCount;
+    c->freqMax  = freqMax;
+    c->tune     = tune;
 
-// ---- Processor state (arrays sized to MAX_BAR_COUNT) ----
-static float g_inputBuf[FFT_SIZE];      // sliding window of real audio
-static float g_window[FFT_SIZE];        // Hann window (full FFT buffer)
-static int   g_binLo[MAX_BAR_COUNT];    // FFT bin lower bound per bar
-static int   g_binHi[MAX_BAR_COUNT];    // FFT bin upper bound per bar
-static float g_eq[MAX_BAR_COUNT];       // per-bar EQ weight
-static float g_mem[MAX_BAR_COUNT];      // EMA smoothing memory
-static float g_peak[MAX_BAR_COUNT];     // gravity peak tracker
-static float g_fall[MAX_BAR_COUNT];     // gravity fall velocity
-static float g_sens;                    // auto-sensitivity (global gain)
-static bool  g_sensInit;                // fast initial ramp-up active
-static bool  g_inited = false;
-static int   g_dbgFrame = 0;            // debug frame counter
-
-static void initProcessor() {
     // Hann window sized to full FFT buffer
     for (int i = 0; i < FFT_SIZE; i++)
-        g_window[i] = 0.5f * (1.0f - cosf(2.0f * (float)M_PI * i / (FFT_SIZE - 1)));
+        c->window[i] = 0.5f * (1.0f - cosf(2.0f * (float)M_PI * i / (FFT_SIZE - 1)));
 
-    // Log-spaced frequency bin cutoffs (using runtime g_barCount / g_freqMax)
+    // Log-spaced frequency bin cutoffs
     float logMin = log10f(FREQ_MIN);
-    float logMax = log10f(g_freqMax);
+    float logMax = log10f(freqMax);
     int loCut[MAX_BAR_COUNT + 1];
-    for (int i = 0; i <= g_barCount; i++) {
-        float f = powf(10.0f, logMin + (float)i / g_barCount * (logMax - logMin));
+    for (int i = 0; i <= barCount; i++) {
+        float f = powf(10.0f, logMin + (float)i / barCount * (logMax - logMin));
         loCut[i] = std::max(1, (int)roundf(f * FFT_SIZE / SAMPLE_RATE));
     }
     // Push up to guarantee each bar has at least 1 unique FFT bin (cava approach)
-    for (int i = 1; i <= g_barCount; i++) {
+    for (int i = 1; i <= barCount; i++) {
         if (loCut[i] <= loCut[i - 1])
             loCut[i] = loCut[i - 1] + 1;
     }
-    for (int i = 0; i < g_barCount; i++) {
-        g_binLo[i] = loCut[i];
-        g_binHi[i] = std::max(loCut[i], loCut[i + 1] - 1);
-        g_binHi[i] = std::min(g_binHi[i], FFT_SIZE / 2 - 1);
+    for (int i = 0; i < barCount; i++) {
+        c->binLo[i] = loCut[i];
+        c->binHi[i] = std::max(loCut[i], loCut[i + 1] - 1);
+        c->binHi[i] = std::min(c->binHi[i], FFT_SIZE / 2 - 1);
+    }
+    c->binTop = c->binHi[barCount - 1] + 1;
+
+    for (int k = 0; k < FFT_SIZE / 2; k++) {
+        double a = -2.0 * M_PI * k / FFT_SIZE;
+        c->twiddle[k] = { (float)cos(a), (float)sin(a) };
     }
 
     // Per-bar EQ: boost higher frequencies to balance typical music spectrum
-    for (int i = 0; i < g_barCount; i++) {
-        float fCenter = (float)(g_binLo[i] + g_binHi[i]) * 0.5f
+    for (int i = 0; i < barCount; i++) {
+        float fCenter = (float)(c->binLo[i] + c->binHi[i]) * 0.5f
                         * (float)SAMPLE_RATE / (float)FFT_SIZE;
-        g_eq[i] = powf(std::max(fCenter, (float)FREQ_MIN) / (float)FREQ_MIN, EQ_POWER);
+        c->eq[i] = powf(std::max(fCenter, (float)FREQ_MIN) / (float)FREQ_MIN, tune.eqPower);
     }
 
-    memset(g_inputBuf, 0, sizeof(g_inputBuf));
-    memset(g_mem, 0, sizeof(g_mem));
-    memset(g_peak, 0, sizeof(g_peak));
-    memset(g_fall, 0, sizeof(g_fall));
-    g_sens = SENS_INIT;
-    g_sensInit = true;
-    g_inited = true;
-    g_dbgFrame = 0;
+    for (int i = 0; i < FFT_SIZE; i++)
+        c->fxWindow[i] = (int16_t)lrintf(c->window[i] * 32767.0f);
+    for (int k = 0; k < FFT_SIZE / 2; k++) {
+        float angle = -2.0f * (float)M_PI * k / FFT_SIZE;
+        c->fxTwiddle[k].re = (int16_t)lrintf(cosf(angle) * 32767.0f);
+        c->fxTwiddle[k].im = (int16_t)lrintf(sinf(angle) * 32767.0f);
+    }
+    for (int b = 0; b < barCount; b++)
+        c->fxEq[b] = fxQ16(c->eq[b]);
+
+    c->fxSmoothAttack  = fxQ16(tune.smoothAttack);
+    c->fxSmoothDecay   = fxQ16(tune.smoothDecay);
+    c->fxGravity       = fxQ16(tune.gravity);
+    c->fxSensTarget    = fxQ16(tune.sensTarget);
+    c->fxSensInit      = fxQ30(tune.sensInit);
+    c->fxSensAttack    = fxQ30(tune.sensAttack);
+    c->fxSensRelease   = fxQ30(tune.sensRelease);
+    c->fxSensInitBoost = fxQ30(tune.sensInitBoost);
+    c->fxSensInitCap   = fxQ30(tune.sensInitCap);
+    c->fxSensMin       = fxQ30(tune.sensMin);
+    c->fxSensMax       = fxQ30(tune.sensMax);
+    // |s| / 32768 < silenceThreshold  <=>  |s| < this
+    c->fxSilence       = (int32_t)ceilf(tune.silenceThreshold * 32768.0f);
+    return c;
 }
 
-// Process one frame of FRAME_SAMPLES fresh audio.
-// Maintains a sliding window of FFT_SIZE samples (all real audio, no zero-padding).
-// Output: bars[BAR_COUNT] in [0, 1].
-static void processFrame(const float* newSamples, float* bars) {
-    if (!g_inited) initProcessor();
+static SnapshotCell<VisConfig> g_config{buildConfig(BAR_COUNT, FREQ_MAX, VisTuning{}, 1)};
 
-    // 1. Sliding window: shift left by FRAME_SAMPLES, append new audio.
-    //    The entire buffer contains real audio — no zero-padding.
-    memmove(g_inputBuf, g_inputBuf + FRAME_SAMPLES,
-            (FFT_SIZE - FRAME_SAMPLES) * sizeof(float));
-    memcpy(g_inputBuf + (FFT_SIZE - FRAME_SAMPLES), newSamples,
-           FRAME_SAMPLES * sizeof(float));
+typedef SnapshotCell<VisConfig>::Reader ConfigReader;
 
-    // 1b. Peak audio level of new chunk — gates sensInit boost so
-    //     microscopic PA warmup noise doesn't trigger the fast ramp-up.
-    float audioMax = 0.0f;
-    for (int i = 0; i < FRAME_SAMPLES; i++) {
-        float a = fabsf(newSamples[i]);
-        if (a > audioMax) audioMax = a;
-    }
+// The layout and tuning most recently published.
+static inline void currentConfig(int* barCount, float* freqMax, VisTuning* tune = nullptr) {
+    ConfigReader c(g_config);
+    *barCount = c->barCount;
+    *freqMax  = c->freqMax;
+    if (tune) *tune = c->tune;
+}
 
-    // 2. Hann window over full buffer -> FFT
-    static Complex fftBuf[FFT_SIZE];
-    for (int i = 0; i < FFT_SIZE; i++) {
-        fftBuf[i].re = g_inputBuf[i] * g_window[i];
-        fftBuf[i].im = 0.0f;
+// Build a snapshot and make it current.  Called from the command
+// thread; DSP threads keep running on the previous snapshot until their
+// next frame.
+static inline void publishConfig(int barCount, float freqMax, const VisTuning& tune) {
+    uint64_t layoutGen;
+    {
+        ConfigReader cur(g_config);
+        layoutGen = cur->layoutGen + (cur->barCount != barCount || cur->freqMax != freqMax ? 1 : 0);
     }
-    fft(fftBuf, FFT_SIZE);
+    g_config.publish(buildConfig(barCount, freqMax, tune, layoutGen));
+}
 
-    // 3. Magnitude spectrum
-    static float mag[FFT_SIZE / 2];
-    for (int i = 0; i < FFT_SIZE / 2; i++)
-        mag[i] = sqrtf(fftBuf[i].re * fftBuf[i].re + fftBuf[i].im * fftBuf[i].im);
+// Republish the current config with one parameter changed.
+static inline void publishBarCount(int barCount) {
+    int n;
+    float freqMax;
+    VisTuning tune;
+    currentConfig(&n, &freqMax, &tune);
+    publishConfig(barCount, freqMax, tune);
+}
 
-    // 4. Bin into bars: average magnitude per frequency range, normalize, EQ
-    //    Silence is checked on raw PCM level vs threshold (matching cava's
-    //    S16LE behavior where sub-16bit noise truncates to zero).
-    bool silence = (audioMax < SILENCE_THRESHOLD);
-    float rawBars[MAX_BAR_COUNT];
-    for (int b = 0; b < g_barCount; b++) {
-        float sum = 0.0f;
-        int count = g_binHi[b] - g_binLo[b] + 1;
-        for (int k = g_binLo[b]; k <= g_binHi[b]; k++)
-            sum += mag[k];
-        float avg = count > 0 ? sum / count : 0.0f;
-
-        // Normalize by FFT size, sqrt compression, per-bar EQ, global sensitivity
-        float norm = avg / (FFT_SIZE * 0.5f);
-        rawBars[b] = sqrtf(norm) * g_eq[b] * g_sens;
-    }
+static inline void publishFreqMax(float freqMax) {
+    int barCount;
+    float f;
+    VisTuning tune;
+    currentConfig(&barCount, &f, &tune);
+    publishConfig(barCount, freqMax, tune);
+}
+
+// ---- Processor state (arrays sized to MAX_BAR_COUNT) ----
+// One instance per analysed source.  Everything a frame touches lives
+// here (including scratch buffers), so separate instances can run on
+// separate threads.  Layout tables are read from the pinned snapshot.
+struct VisProcessor {
+    int   barCount = BAR_COUNT;         // layout in use (from cfg)
+    float freqMax  = FREQ_MAX;
+    const VisConfig* cfg = nullptr;     // snapshot in use; valid only during a frame
+    uint64_t layoutGen = 0;             // layout the state was built for
+    float inputBuf[FFT_SIZE];           // sliding window of real audio
+    float mem[MAX_BAR_COUNT];           // EMA smoothing memory
+    float peak[MAX_BAR_COUNT];          // gravity peak tracker
+    float fall[MAX_BAR_COUNT];          // gravity fall velocity
+    float sens;                         // auto-sensitivity (global gain)
+    bool  sensInit;                     // fast initial ramp-up active
+    bool  inited = false;
+    unsigned gen = 0;                   // bumped by every reset
+    int   dbgFrame = 0;                 // debug frame counter
+
+    // Optional spectrum tap, set by the owner (e.g. hpss.h): called once
+    // per frame with |X[k]| for k < cfg->binTop and the gain the bars got.
+    // Survives resets; `cfg` is valid while it runs.
+    void (*spectrumTap)(void* ctx, const VisProcessor& p, const float* mag, int bins, float gain) = nullptr;
+    void* tapCtx = nullptr;
+
+    // Scratch
+    Complex fftBuf[FFT_SIZE];
+    float   mag[FFT_SIZE / 2];
+    double  magPrefix[FFT_SIZE / 2 + 1];
+
+    // Fixed-point path state (fft_fixed.h), reset whenever gen changes.
+    int16_t    fxInput[FFT_SIZE];       // sliding window of S16 audio
+    int32_t    fxMem[MAX_BAR_COUNT];    // EMA smoothing memory, Q16
+    int32_t    fxPeak[MAX_BAR_COUNT];   // gravity peak tracker, Q16
+    int32_t    fxFall[MAX_BAR_COUNT];   // gravity fall velocity, Q16
+    int64_t    fxSens;                  // auto-sensitivity, Q30
+    bool       fxSensInit;
+    unsigned   fxGen = ~0u;
+    int32_t    fxWindowed[FFT_SIZE];    // scratch
+    ComplexQ15 fxBuf[FFT_SIZE];         // scratch
+    uint16_t   fxMag[FFT_SIZE / 2];     // scratch
+};
+
+// Start p afresh: its next frame clears the state and adopts whichever
+// snapshot is current by then.
+static void initProcessor(VisProcessor& p) {
+    p.inited = false;
+}
+
+static void resetProcessor(VisProcessor& p, const VisConfig& c) {
+    p.barCount = c.barCount;
+    p.freqMax  = c.freqMax;
+    p.layoutGen = c.layoutGen;
+    memset(p.inputBuf, 0, sizeof(p.inputBuf));
+    memset(p.mem, 0, sizeof(p.mem));
+    memset(p.peak, 0, sizeof(p.peak));
+    memset(p.fall, 0, sizeof(p.fall));
+    p.sens = c.tune.sensInit;
+    p.sensInit = true;
+    p.inited = true;
+    p.gen++;
+    p.dbgFrame = 0;
+}
 
-    // 5. Asymmetric EMA + gravity (replaces cava's integral accumulator).
-    //    The integral accumulated input (gain ~4.35x), causing bars to stay
-    //    clamped at 1.0 for hundreds of milliseconds.  This EMA has gain=1.0
-    //    so output never exceeds the input value — provably no lockup.
-    bool overshoot = false;
-    for (int b = 0; b < g_barCount; b++) {
-        float raw = rawBars[b];
-
-        // (a) Asymmetric EMA: fast attack, slow decay (gain = 1.0).
-        //     Attack: 60% new value → ~4 frames to reach 95% of step input.
-        //     Decay:  15% new value → smooth exponential fall, half-life ~4 frames.
-        if (raw > g_mem[b]) {
-            g_mem[b] = g_mem[b] * SMOOTH_ATTACK + raw * (1.0f - SMOOTH_ATTACK);
-        } else {
-            g_mem[b] = g_mem[b] * SMOOTH_DECAY + raw * (1.0f - SMOOTH_DECAY);
+// Frame prologue: point p at the pinned snapshot, resetting first if
+// its layout differs from the one p's state was built for.  `cfg` must
+// outlive the frame.
+static inline void beginFrame(VisProcessor& p, const ConfigReader& cfg) {
+    if (!p.inited || p.layoutGen != cfg->layoutGen) resetProcessor(p, *cfg);
+    p.cfg = cfg.get();
+}
+
+// ---- Pipeline policies ----
+// processFrame() is assembled from one small policy struct per stage:
+// window, transform, binning, smoother, gain control, output encoder and
+// debug.  Each variant is a single template instantiation, so every stage
+// call inlines and a policy that does nothing (FixedGain, NoDebug) takes
+// its branches and bookkeeping with it.
+
+// Window: Hann over the full sliding buffer.
+struct HannWindow {
+    static inline void apply(const VisProcessor& p, Complex* out) {
+        for (int i = 0; i < FFT_SIZE; i++) {
+            out[i].re = p.inputBuf[i] * p.cfg->window[i];
+            out[i].im = 0.0f;
+        }
+    }
+};
+
+// Transform: in-place radix-2 FFT.
+struct Radix2Transform {
+    static constexpr const char* kName = "radix2";
+    static inline void run(const VisProcessor&, Complex* buf) { fft(buf, FFT_SIZE); }
+};
+
+// Transform: radix-2 FFT reading twiddles from the processor's table.
+struct TableRadix2Transform {
+    static constexpr const char* kName = "table";
+    static inline void run(const VisProcessor& p, Complex* buf) { fftTable(p.cfg->twiddle, buf, FFT_SIZE); }
+};
+
+// Binning: average magnitude per frequency range, normalize by FFT size,
+// sqrt compression and per-bar EQ.  Gain is applied by the gain policy.
+struct AverageBinning {
+    static constexpr const char* kName = "average";
+    static inline void run(VisProcessor& p, const Complex* spec, float* rawBars) {
+        const VisConfig& c = *p.cfg;
+        float* mag = p.mag;
+        for (int i = 0; i < FFT_SIZE / 2; i++)
+            mag[i] = sqrtf(spec[i].re * spec[i].re + spec[i].im * spec[i].im);
+
+        for (int b = 0; b < p.barCount; b++) {
+            float sum = 0.0f;
+            int count = c.binHi[b] - c.binLo[b] + 1;
+            for (int k = c.binLo[b]; k <= c.binHi[b]; k++)
+                sum += mag[k];
+            float avg = count > 0 ? sum / count : 0.0f;
+            float norm = avg / (FFT_SIZE * 0.5f);
+            rawBars[b] = sqrtf(norm) * c.eq[b];
+        }
+    }
+};
+
+// Binning: the same averages from a running sum of magnitudes, so each
+// bar is one subtraction however many bins it spans, and magnitudes are
+// only computed up to the highest bin a bar reads (the rest of the
+// spectrum above freqMax is skipped).  The sum is kept in double so the
+// differences stay as exact as the per-bar float sums.
+struct PrefixSumBinning {
+    static constexpr const char* kName = "prefix";
+    static inline void run(VisProcessor& p, const Complex* spec, float* rawBars) {
+        const VisConfig& c = *p.cfg;
+        double* prefix = p.magPrefix;
+        double acc = 0.0;
+        prefix[0] = 0.0;
+        for (int i = 0; i < c.binTop; i++) {
+            acc += sqrtf(spec[i].re * spec[i].re + spec[i].im * spec[i].im);
+            prefix[i + 1] = acc;
         }
 
-        // (b) Gravity: constant-acceleration fall from peak.
-        //     Gives smooth parabolic descent (~367ms from 1.0 to 0).
-        //     Peak tracks the EMA output upward instantly.
-        if (g_mem[b] >= g_peak[b]) {
-            g_peak[b] = g_mem[b];
-            g_fall[b] = 0.0f;
-        } else {
-            g_fall[b] += GRAVITY;
-            g_peak[b] -= g_fall[b];
-            if (g_peak[b] < g_mem[b]) g_peak[b] = g_mem[b];
-            if (g_peak[b] < 0.0f) g_peak[b] = 0.0f;
+        for (int b = 0; b < p.barCount; b++) {
+            int count = c.binHi[b] - c.binLo[b] + 1;
+            float sum = (float)(prefix[c.binHi[b] + 1] - prefix[c.binLo[b]]);
+            float avg = count > 0 ? sum / count : 0.0f;
+            float norm = avg / (FFT_SIZE * 0.5f);
+            rawBars[b] = sqrtf(norm) * c.eq[b];
+        }
+    }
+};
+
+// Gain control: auto-sensitivity.
+//   Overshoot → fast reduction (0.85x, converges in ~7 frames).
+//   Non-silent → slow growth (1.002x).
+//   sensInit → fast ramp (1.1x) until first overshoot or cap.
+// Silence is checked on raw PCM level vs threshold (matching cava's
+// S16LE behavior where sub-16bit noise truncates to zero).
+struct AutoSensGain {
+    static constexpr bool kAdaptive = true;
+    static inline float gain(const VisProcessor& p) { return p.sens; }
+    static inline void update(VisProcessor& p, bool overshoot, float audioMax) {
+        const VisTuning& t = p.cfg->tune;
+        if (overshoot) {
+            p.sens *= t.sensAttack;
+            p.sensInit = false;
+        } else if (!(audioMax < t.silenceThreshold)) {
+            p.sens *= t.sensRelease;
+            if (p.sensInit) {
+                p.sens *= t.sensInitBoost;
+                if (p.sens > t.sensInitCap)
+                    p.sensInit = false;
+            }
         }
+        p.sens = std::max(t.sensMin, std::min(t.sensMax, p.sens));
+    }
+};
+
+// Gain control: constant unity gain, for consumers that want absolute
+// levels.  No peak tracking, no silence gate.
+struct FixedGain {
+    static constexpr bool kAdaptive = false;
+    static inline float gain(const VisProcessor&) { return SENS_INIT; }
+    static inline void update(VisProcessor&, bool, float) {}
+};
+
+// Output encoder: float32 bars clamped to [0, 1] (the wire format).
+struct Float32Encoder {
+    static inline void put(float* bars, int b, float v) { bars[b] = std::min(v, 1.0f); }
+};
+
+// Smoother: asymmetric EMA + gravity (replaces cava's integral accumulator).
+// The integral accumulated input (gain ~4.35x), causing bars to stay
+// clamped at 1.0 for hundreds of milliseconds.  This EMA has gain=1.0
+// so output never exceeds the input value — provably no lockup.
+// Returns true if any bar overshot SENS_TARGET (only tracked when the
+// gain policy needs it).
+struct EmaGravitySmoother {
+    static constexpr const char* kName = "branchy";
+    template <class Gain, class Encoder>
+    static inline bool run(VisProcessor& p, const float* rawBars, float* bars) {
+        const float attack = p.cfg->tune.smoothAttack, decay = p.cfg->tune.smoothDecay;
+        const float gravity = p.cfg->tune.gravity, target = p.cfg->tune.sensTarget;
+        bool overshoot = false;
+        for (int b = 0; b < p.barCount; b++) {
+            float raw = rawBars[b];
+
+            // (a) Asymmetric EMA: fast attack, slow decay (gain = 1.0).
+            //     Attack: 60% new value → ~4 frames to reach 95% of step input.
+            //     Decay:  15% new value → smooth exponential fall, half-life ~4 frames.
+            if (raw > p.mem[b]) {
+                p.mem[b] = p.mem[b] * attack + raw * (1.0f - attack);
+            } else {
+                p.mem[b] = p.mem[b] * decay + raw * (1.0f - decay);
+            }
 
-        // Overshoot detection for auto-sensitivity.
-        if (g_peak[b] > SENS_TARGET) overshoot = true;
+            // (b) Gravity: constant-acceleration fall from peak.
+            //     Gives smooth parabolic descent (~367ms from 1.0 to 0).
+            //     Peak tracks the EMA output upward instantly.
+            if (p.mem[b] >= p.peak[b]) {
+                p.peak[b] = p.mem[b];
+                p.fall[b] = 0.0f;
+            } else {
+                p.fall[b] += gravity;
+                p.peak[b] -= p.fall[b];
+                if (p.peak[b] < p.mem[b]) p.peak[b] = p.mem[b];
+                if (p.peak[b] < 0.0f) p.peak[b] = 0.0f;
+            }
 
-        bars[b] = std::min(g_peak[b], 1.0f);
-    }
+            // Overshoot detection for auto-sensitivity.
+            if constexpr (Gain::kAdaptive) {
+                if (p.peak[b] > target) overshoot = true;
+            }
 
-    // 6. Auto-sensitivity:
-    //    Overshoot → fast reduction (0.85x, converges in ~7 frames).
-    //    Non-silent → slow growth (1.002x).
-    //    sensInit → fast ramp (1.1x) until first overshoot or cap.
-    if (overshoot) {
-        g_sens *= SENS_ATTACK;
-        g_sensInit = false;
-    } else if (!silence) {
-        g_sens *= SENS_RELEASE;
-        if (g_sensInit) {
-            g_sens *= SENS_INIT_BOOST;
-            if (g_sens > SENS_INIT_CAP)
-                g_sensInit = false;
+            Encoder::put(bars, b, p.peak[b]);
+        }
+        return overshoot;
+    }
+};
+
+// Smoother: the same EMA + gravity written as selects instead of
+// branches, so the per-bar loop has no data-dependent jumps and can be
+// vectorised.  Bit-identical to EmaGravitySmoother (mem and raw are
+// never negative, so the extra clamps are no-ops on the rising path).
+struct BranchlessEmaGravitySmoother {
+    static constexpr const char* kName = "branchless";
+    template <class Gain, class Encoder>
+    static inline bool run(VisProcessor& p, const float* rawBars, float* bars) {
+        const float attack = p.cfg->tune.smoothAttack, decay = p.cfg->tune.smoothDecay;
+        const float gravity = p.cfg->tune.gravity, target = p.cfg->tune.sensTarget;
+        bool overshoot = false;
+        for (int b = 0; b < p.barCount; b++) {
+            float raw = rawBars[b];
+            float a = raw > p.mem[b] ? attack : decay;
+            float mem = p.mem[b] * a + raw * (1.0f - a);
+
+            bool rise = mem >= p.peak[b];
+            float fall = rise ? 0.0f : p.fall[b] + gravity;
+            float peak = rise ? mem : p.peak[b] - fall;
+            peak = std::max(std::max(peak, mem), 0.0f);
+
+            p.mem[b] = mem;
+            p.fall[b] = fall;
+            p.peak[b] = peak;
+            if constexpr (Gain::kAdaptive) overshoot |= peak > target;
+            Encoder::put(bars, b, peak);
+        }
+        return overshoot;
+    }
+};
+
+// Debug: log every 60 frames (1 second) so we can verify data flow.
+struct FrameDebugLog {
+    static constexpr bool kEnabled = true;
+    static inline void frame(VisProcessor& p, const float* bars, float audioMax) {
+        if (++p.dbgFrame % 60 == 0) {
+            int n = p.barCount;
+            float maxBar = 0.0f;
+            for (int b = 0; b < n; b++)
+                if (bars[b] > maxBar) maxBar = bars[b];
+            fprintf(stderr, "[vis-dbg] f=%d sens=%.3f maxBar=%.3f audioMax=%.6f bars[0]=%.3f [%d]=%.3f [%d]=%.3f\n",
+                    p.dbgFrame, p.sens, maxBar, audioMax, bars[0], n/2, bars[n/2], n-1, bars[n-1]);
         }
     }
-    g_sens = std::max(SENS_MIN, std::min(SENS_MAX, g_sens));
-
-    // Debug: log every 60 frames (1 second) so we can verify data flow
-    if (++g_dbgFrame % 60 == 0) {
-        float maxBar = 0.0f;
-        for (int b = 0; b < g_barCount; b++)
-            if (bars[b] > maxBar) maxBar = bars[b];
-        fprintf(stderr, "[vis-dbg] f=%d sens=%.3f maxBar=%.3f audioMax=%.6f bars[0]=%.3f [%d]=%.3f [%d]=%.3f\n",
-                g_dbgFrame, g_sens, maxBar, audioMax, bars[0], g_barCount/2, bars[g_barCount/2], g_barCount-1, bars[g_barCount-1]);
+};
+
+struct NoDebug {
+    static constexpr bool kEnabled = false;
+    static inline void frame(VisProcessor&, const float*, float) {}
+};
+
+// Steps 3-6 of a frame, from the spectrum in p.fftBuf (only its first
+// FFT_SIZE / 2 bins are read).  Shared with the batched path (fft_batch.h).
+template <class Binning, class Smoother, class Gain, class Encoder, class Debug>
+static inline void finishFrameT(VisProcessor& p, float audioMax, float* bars) {
+    // 3. Bin into bars, then global sensitivity
+    float rawBars[MAX_BAR_COUNT];
+    Binning::run(p, p.fftBuf, rawBars);
+    float gain = Gain::gain(p);
+    for (int b = 0; b < p.barCount; b++)
+        rawBars[b] *= gain;
+
+    // 3b. Spectrum tap, if the owner set one
+    if (p.spectrumTap) {
+        const Complex* spec = p.fftBuf;
+        for (int i = 0; i < p.cfg->binTop; i++)
+            p.mag[i] = sqrtf(spec[i].re * spec[i].re + spec[i].im * spec[i].im);
+        p.spectrumTap(p.tapCtx, p, p.mag, p.cfg->binTop, gain);
+    }
+
+    // 4. Smoothing + encode, 5. gain control, 6. debug
+    bool overshoot = Smoother::template run<Gain, Encoder>(p, rawBars, bars);
+    Gain::update(p, overshoot, audioMax);
+    Debug::frame(p, bars, audioMax);
+}
+
+// Process one frame of FRAME_SAMPLES fresh audio through the given stages.
+// Maintains a sliding window of FFT_SIZE samples (all real audio, no zero-padding).
+// Output: bars[p.barCount] in [0, 1].
+template <class Window, class Transform, class Binning, class Smoother,
+          class Gain, class Encoder, class Debug>
+static void processFrameT(VisProcessor& p, const float* newSamples, float* bars) {
+    ConfigReader cfg(g_config);
+    beginFrame(p, cfg);
+
+    // 1. Sliding window: shift left by FRAME_SAMPLES, append new audio.
+    //    The entire buffer contains real audio — no zero-padding.
+    memmove(p.inputBuf, p.inputBuf + FRAME_SAMPLES,
+            (FFT_SIZE - FRAME_SAMPLES) * sizeof(float));
+    memcpy(p.inputBuf + (FFT_SIZE - FRAME_SAMPLES), newSamples,
+           FRAME_SAMPLES * sizeof(float));
+
+    // 1b. Peak audio level of new chunk — gates sensInit boost so
+    //     microscopic PA warmup noise doesn't trigger the fast ramp-up.
+    float audioMax = 0.0f;
+    if constexpr (Gain::kAdaptive || Debug::kEnabled) {
+        for (int i = 0; i < FRAME_SAMPLES; i++) {
+            float a = fabsf(newSamples[i]);
+            if (a > audioMax) audioMax = a;
+        }
     }
+
+    // 2. Window -> transform
+    Window::apply(p, p.fftBuf);
+    Transform::run(p, p.fftBuf);
+
+    finishFrameT<Binning, Smoother, Gain, Encoder, Debug>(p, audioMax, bars);
 }
 
 #endif // VIS_FFT_H
@@ -0,0 +1,115 @@
+// fft_batch.h — Batched frames: several hops through one transform.
+// When a worker falls behind (a stalled scheduler, a burst of ingested
+// PCM, a replay catching up) it has a run of consecutive hops queued.
+// Each one still needs its own FFT_SIZE transform, but they are
+// independent, so processFramesT() windows up to FFT_BATCH of them into
+// an interleaved layout, bin k of frame l at re[k].v[l] / im[k].v[l],
+// and runs fftTable()'s butterflies once for all of them: every
+// butterfly loads its twiddle once and applies it across the lanes, an
+// inner loop of FFT_BATCH independent floats that the compiler turns
+// into whole-register vector ops (two SSE or one AVX register per row).
+// The per-frame stages then consume the lanes in order — binning,
+// spectrum tap, smoothing and gain carry state from frame to frame —
+// through the same finishFrameT() as processFrameT(), so the bars are
+// those of table-twiddle processFrameT() on each hop in turn.
+// Header-only, no external dependencies.
+#ifndef VIS_FFT_BATCH_H
+#define VIS_FFT_BATCH_H
+
+#include <cmath>
+#include <cstring>
+
+#include "fft.h"
+
+constexpr int FFT_BATCH = 8;            // hops per transform (vector lanes)
+
+// One bin (or sample) of every frame in the batch.
+struct alignas(32) FftBatchRow { float v[FFT_BATCH]; };
+
+// Per-worker scratch, ~300 KB: allocate once per processor that needs
+// it, not per call.
+struct FrameBatch {
+    FftBatchRow re[FFT_SIZE];
+    FftBatchRow im[FFT_SIZE];
+    float       audio[FFT_SIZE + FFT_BATCH * FRAME_SAMPLES];    // window history, then the hops
+};
+
+typedef void (*ProcessBatchFn)(VisProcessor& p, FrameBatch& batch, const float* const* chunks, int count,
+                               float (*bars)[MAX_BAR_COUNT]);
+
+// fftTable() on every lane at once; same butterflies in the same order,
+// so each lane matches fftTable() on that frame.  Rows are copied into
+// locals before the stores so the lane loop needs no aliasing checks.
+static void fftTableBatch(const Complex* tw, FftBatchRow* re, FftBatchRow* im, int n) {
+    bitReverse(re, n);
+    bitReverse(im, n);
+    for (int len = 2; len <= n; len <<= 1) {
+        int half = len / 2, step = n / len;
+        for (int i = 0; i < n; i += len) {
+            for (int j = 0; j < half; j++) {
+                const Complex w = tw[j * step];
+                const FftBatchRow ur = re[i + j], ui = im[i + j];
+                const FftBatchRow xr = re[i + j + half], xi = im[i + j + half];
+                FftBatchRow ar, ai, br, bi;
+                for (int l = 0; l < FFT_BATCH; l++) {
+                    float vr = w.re * xr.v[l] - w.im * xi.v[l];
+                    float vi = w.re * xi.v[l] + w.im * xr.v[l];
+                    ar.v[l] = ur.v[l] + vr;
+                    ai.v[l] = ui.v[l] + vi;
+                    br.v[l] = ur.v[l] - vr;
+                    bi.v[l] = ui.v[l] - vi;
+                }
+                re[i + j] = ar;        im[i + j] = ai;
+                re[i + j + half] = br; im[i + j + half] = bi;
+            }
+        }
+    }
+}
+
+// Process `count` consecutive hops (oldest first), bars[i] for chunks[i].
+// The whole run uses the config snapshot current at its start.
+template <class Binning, class Smoother, class Gain, class Encoder, class Debug>
+static void processFramesT(VisProcessor& p, FrameBatch& batch, const float* const* chunks, int count,
+                           float (*bars)[MAX_BAR_COUNT]) {
+    ConfigReader cfg(g_config);
+    beginFrame(p, cfg);
+    const float* window = cfg->window;
+
+    for (int done = 0; done < count; done += FFT_BATCH) {
+        const int lanes = std::min(FFT_BATCH, count - done);
+
+        // 1. Window history followed by the new hops; frame l's window
+        //    ends with hop l.
+        float* audio = batch.audio;
+        memcpy(audio, p.inputBuf, sizeof(p.inputBuf));
+        for (int l = 0; l < lanes; l++)
+            memcpy(audio + FFT_SIZE + l * FRAME_SAMPLES, chunks[done + l], FRAME_SAMPLES * sizeof(float));
+        memcpy(p.inputBuf, audio + lanes * FRAME_SAMPLES, sizeof(p.inputBuf));
+
+        // 2. Window into the lanes (unused lanes zeroed) -> transform
+        for (int i = 0; i < FFT_SIZE; i++) {
+            for (int l = 0; l < FFT_BATCH; l++) {
+                batch.re[i].v[l] = l < lanes ? audio[(l + 1) * FRAME_SAMPLES + i] * window[i] : 0.0f;
+                batch.im[i].v[l] = 0.0f;
+            }
+        }
+        fftTableBatch(cfg->twiddle, batch.re, batch.im, FFT_SIZE);
+
+        // 3-6. Each frame in order, from its lane
+        for (int l = 0; l < lanes; l++) {
+            const float* hop = chunks[done + l];
+            float audioMax = 0.0f;
+            if constexpr (Gain::kAdaptive || Debug::kEnabled) {
+                for (int i = 0; i < FRAME_SAMPLES; i++) {
+                    float a = fabsf(hop[i]);
+                    if (a > audioMax) audioMax = a;
+                }
+            }
+            for (int k = 0; k < FFT_SIZE / 2; k++)
+                p.fftBuf[k] = { batch.re[k].v[l], batch.im[k].v[l] };
+            finishFrameT<Binning, Smoother, Gain, Encoder, Debug>(p, audioMax, bars[done + l]);
+        }
+    }
+}
+
+#endif // VIS_FFT_BATCH_H
@@ -0,0 +1,245 @@
+// fft_fixed.h — Fixed-point audio processor for low-power hosts.
+// The same pipeline as the float path in fft.h (sliding Hann window,
+// radix-2 FFT, log-frequency binning, per-bar EQ, auto-sensitivity,
+// asymmetric EMA + gravity) on S16 samples with integer arithmetic only:
+//   - Q15 window and twiddles, int16 complex buffer (half the bytes of
+//     the float buffer).
+//   - Block-floating-point FFT: the windowed input is normalized to fill
+//     ~14 bits, and a stage only shifts down when its butterflies could
+//     overflow.  The total shift is the block exponent.
+//   - Magnitudes by alpha-max-plus-beta-min (max error ~4%), stored as
+//     uint16.
+//   - Binning, sqrt compression, EQ and smoothing in Q16; the
+//     auto-sensitivity gain in Q30 so that its per-frame compounding
+//     (x1.002 for hundreds of frames) tracks the float path.
+// Floats only appear when the config snapshot derives its tables and in
+// the output encoder (the wire format is float32).
+// Header-only, no external dependencies.
+#ifndef VIS_FFT_FIXED_H
+#define VIS_FFT_FIXED_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "protocol.h"
+#include "fft.h"
+
+constexpr int ilog2(int n) { return n <= 1 ? 0 : 1 + ilog2(n / 2); }
+
+// Largest component allowed into a butterfly: u + w*v can grow by
+// 1 + sqrt(2), and the result must still fit in int16.
+constexpr int32_t FX_HEADROOM = 13500;
+
+// alpha-max-plus-beta-min coefficients in Q15 (alpha = 0.9604, beta = 0.3978).
+constexpr int32_t FX_MAG_ALPHA = 31470;
+constexpr int32_t FX_MAG_BETA  = 13036;
+
+// Tables (fxWindow / fxTwiddle / fxEq) and the tuning constants in Q16 /
+// Q30 come with the config snapshot; the fixed-point state is reset
+// whenever the processor's gen changes.
+static void initProcessorFixed(VisProcessor& p, const VisConfig& c) {
+    memset(p.fxInput, 0, sizeof(p.fxInput));
+    memset(p.fxMem, 0, sizeof(p.fxMem));
+    memset(p.fxPeak, 0, sizeof(p.fxPeak));
+    memset(p.fxFall, 0, sizeof(p.fxFall));
+    p.fxSens = c.fxSensInit;
+    p.fxSensInit = true;
+    p.fxGen = p.gen;
+}
+
+// Gain multiply in Q30, rounded.  The full product of two Q30 gains
+// near the configurable limits (sens_max 100 x sens_release 2) needs
+// ~68 bits, so each operand is split into its integer part (a >> 30,
+// floor) and its 30 fraction bits; only the fraction x fraction term is
+// shifted, and the result is exactly (a * b + 2^29) >> 30 wherever
+// that fits in int64.
+static inline int64_t fxSensMul(int64_t a, int64_t b) {
+    constexpr int64_t mask = ((int64_t)1 << FX_SENS_BITS) - 1;
+    const int64_t ah = a >> FX_SENS_BITS, al = a & mask;
+    const int64_t bh = b >> FX_SENS_BITS, bl = b & mask;
+    return ah * bh * (mask + 1) + ah * bl + al * bh +
+           ((al * bl + ((int64_t)1 << (FX_SENS_BITS - 1))) >> FX_SENS_BITS);
+}
+
+// Integer square root of a 64-bit value (floor).
+static inline uint32_t isqrt64(uint64_t x) {
+    uint64_t res = 0, bit = (uint64_t)1 << 62;
+    while (bit > x) bit >>= 2;
+    while (bit) {
+        if (x >= res + bit) { x -= res + bit; res = (res >> 1) + bit; }
+        else res >>= 1;
+        bit >>= 2;
+    }
+    return (uint32_t)res;
+}
+
+// ---- Block-floating-point radix-2 FFT on Q15 data ----
+// maxAbs is the largest |component| of the input.  Returns the number
+// of right shifts applied across all stages (the block exponent).
+static int fftQ15(const ComplexQ15* twiddle, ComplexQ15* buf, int n, int32_t maxAbs) {
+    bitReverse(buf, n);
+    int shifts = 0;
+    for (int len = 2; len <= n; len <<= 1) {
+        int s = 0;
+        while ((maxAbs >> s) > FX_HEADROOM) s++;
+        shifts += s;
+        const int32_t round = 1 << (14 + s);
+        const int sh = 15 + s;
+        const int half = len / 2, step = n / len;
+        int32_t newMax = 0;
+        // Twiddle-outer loop: one table load per twiddle, and the max
+        // is tracked as an OR of magnitudes (an upper bound under 2x the
+        // true max) to keep the loop free of compare chains.
+        for (int j = 0; j < half; j++) {
+            const int32_t wr = twiddle[j * step].re, wi = twiddle[j * step].im;
+            for (int i = j; i < n; i += len) {
+                ComplexQ15 a = buf[i];
+                ComplexQ15 b = buf[i + half];
+                int32_t tr = (wr * b.re - wi * b.im + round) >> sh;
+                int32_t ti = (wr * b.im + wi * b.re + round) >> sh;
+                int32_t ur = a.re >> s, ui = a.im >> s;
+                int32_t r0 = ur + tr, i0 = ui + ti, r1 = ur - tr, i1 = ui - ti;
+                buf[i]        = {(int16_t)r0, (int16_t)i0};
+                buf[i + half] = {(int16_t)r1, (int16_t)i1};
+                newMax |= abs(r0) | abs(i0) | abs(r1) | abs(i1);
+            }
+        }
+        maxAbs = newMax;
+    }
+    return shifts;
+}
+
+// Process one frame of FRAME_SAMPLES fresh S16 audio.
+// Output: bars[p.barCount] in [0, 1].
+static void processFrameFixed(VisProcessor& p, const int16_t* newSamples, float* bars) {
+    ConfigReader cfg(g_config);
+    beginFrame(p, cfg);
+    const VisConfig& c = *cfg;
+    if (p.fxGen != p.gen) initProcessorFixed(p, c);
+
+    // 1. Sliding window (S16 — half the memmove traffic of float).
+    memmove(p.fxInput, p.fxInput + FRAME_SAMPLES,
+            (FFT_SIZE - FRAME_SAMPLES) * sizeof(int16_t));
+    memcpy(p.fxInput + (FFT_SIZE - FRAME_SAMPLES), newSamples,
+           FRAME_SAMPLES * sizeof(int16_t));
+
+    int32_t audioMax = 0;
+    for (int i = 0; i < FRAME_SAMPLES; i++)
+        audioMax = std::max(audioMax, (int32_t)abs(newSamples[i]));
+
+    // 2. Window into Q30 products, then normalize into the butterfly
+    //    headroom: value = x * w * 2^(30 - r).
+    int32_t* windowed = p.fxWindowed;
+    int32_t peak = 0;
+    for (int i = 0; i < FFT_SIZE; i++) {
+        windowed[i] = (int32_t)p.fxInput[i] * c.fxWindow[i];
+        peak = std::max(peak, abs(windowed[i]));
+    }
+
+    uint16_t* mag = p.fxMag;
+    int expo = 0;   // spectrum value = X * 2^expo
+    if (peak == 0) {
+        memset(mag, 0, sizeof(p.fxMag));
+    } else {
+        int r = 0;
+        while ((peak >> r) > FX_HEADROOM) r++;
+        ComplexQ15* buf = p.fxBuf;
+        int32_t maxAbs = 0;
+        for (int i = 0; i < FFT_SIZE; i++) {
+            buf[i].re = (int16_t)(windowed[i] >> r);
+            buf[i].im = 0;
+            maxAbs = std::max(maxAbs, (int32_t)abs(buf[i].re));
+        }
+        int shifts = fftQ15(c.fxTwiddle, buf, FFT_SIZE, maxAbs);
+        expo = 30 - r - shifts;
+
+        // 3. Magnitude: alpha*max + beta*min.
+        for (int i = 0; i < FFT_SIZE / 2; i++) {
+            int32_t a = abs(buf[i].re), b = abs(buf[i].im);
+            int32_t hi = std::max(a, b), lo = std::min(a, b);
+            mag[i] = (uint16_t)((hi * FX_MAG_ALPHA + lo * FX_MAG_BETA) >> 15);
+        }
+    }
+
+    // 3b. Spectrum tap, if the owner set one: |X| = mag * 2^-expo
+    if (p.spectrumTap) {
+        const float scale = ldexpf(1.0f, -expo);
+        for (int i = 0; i < c.binTop; i++) p.mag[i] = mag[i] * scale;
+        p.spectrumTap(p.tapCtx, p, p.mag, c.binTop, ldexpf((float)p.fxSens, -FX_SENS_BITS));
+    }
+
+    // 4. Bin into bars.  With avg8 = average magnitude in Q8,
+    //    norm * 2^32 = avg8 * 2^(24 - expo - log2(N/2)), and its integer
+    //    square root is sqrt(norm) in Q16.
+    const int k = 24 - expo - ilog2(FFT_SIZE / 2);
+    int32_t rawBars[MAX_BAR_COUNT];
+    for (int b = 0; b < p.barCount; b++) {
+        uint32_t sum = 0;
+        int count = c.binHi[b] - c.binLo[b] + 1;
+        for (int i = c.binLo[b]; i <= c.binHi[b]; i++)
+            sum += mag[i];
+        uint64_t avg8 = count > 0 ? ((uint64_t)sum << 8) / (uint64_t)count : 0;
+        uint64_t norm = k >= 0 ? (avg8 << k) : (avg8 >> -k);
+        int64_t v = (int64_t)isqrt64(norm);
+        v = (v * c.fxEq[b] + (FX_ONE >> 1)) >> 16;
+        v = fxSensMul(v, p.fxSens);
+        rawBars[b] = (int32_t)std::min<int64_t>(v, INT32_MAX);
+    }
+
+    // 5. Asymmetric EMA + gravity in Q16.
+    bool overshoot = false;
+    for (int b = 0; b < p.barCount; b++) {
+        int64_t raw = rawBars[b], mem = p.fxMem[b];
+        int32_t a = raw > mem ? c.fxSmoothAttack : c.fxSmoothDecay;
+        p.fxMem[b] = (int32_t)((mem * a + raw * (FX_ONE - a) + (FX_ONE >> 1)) >> 16);
+
+        if (p.fxMem[b] >= p.fxPeak[b]) {
+            p.fxPeak[b] = p.fxMem[b];
+            p.fxFall[b] = 0;
+        } else {
+            p.fxFall[b] += c.fxGravity;
+            p.fxPeak[b] -= p.fxFall[b];
+            if (p.fxPeak[b] < p.fxMem[b]) p.fxPeak[b] = p.fxMem[b];
+            if (p.fxPeak[b] < 0) p.fxPeak[b] = 0;
+        }
+
+        if (p.fxPeak[b] > c.fxSensTarget) overshoot = true;
+        bars[b] = (float)std::min(p.fxPeak[b], FX_ONE) * (1.0f / FX_ONE);
+    }
+
+    // 6. Auto-sensitivity in Q30.
+    if (overshoot) {
+        p.fxSens = fxSensMul(p.fxSens, c.fxSensAttack);
+        p.fxSensInit = false;
+    } else if (audioMax >= c.fxSilence) {
+        p.fxSens = fxSensMul(p.fxSens, c.fxSensRelease);
+        if (p.fxSensInit) {
+            p.fxSens = fxSensMul(p.fxSens, c.fxSensInitBoost);
+            if (p.fxSens > c.fxSensInitCap)
+                p.fxSensInit = false;
+        }
+    }
+    p.fxSens = std::max(c.fxSensMin, std::min(c.fxSensMax, p.fxSens));
+}
+
+// Float32 → S16 with rounding and clipping (what PA does for S16LE capture).
+static inline void floatToS16(const float* in, int16_t* out, int n) {
+    for (int i = 0; i < n; i++) {
+        float v = in[i] * 32768.0f;
+        v = std::max(-32768.0f, std::min(32767.0f, v));
+        out[i] = (int16_t)lrintf(v);
+    }
+}
+
+// Float entry point for float-only capture paths (WASAPI mix format,
+// the harness): converts and runs the fixed pipeline.
+static void processFrameFixedF32(VisProcessor& p, const float* newSamples, float* bars) {
+    int16_t s16[FRAME_SAMPLES];
+    floatToS16(newSamples, s16, FRAME_SAMPLES);
+    processFrameFixed(p, s16, bars);
+}
+
+#endif // VIS_FFT_FIXED_H
@@ -0,0 +1,200 @@
+// fft_ref.h — Frozen reference implementation of the audio processor.
+// A copy of the original scalar processFrame path (radix-2 FFT,
+// averaged log-frequency binning, EMA + gravity, auto-sensitivity) with
+// its own state and tuning constants, so the differential harness in
+// native/tools can prove that optimized kernels in fft.h still produce
+// the same bars.  Do not optimize or "fix" this file — its only job is
+// to stay the same.
+// Header-only, no external dependencies.
+#ifndef VIS_FFT_REF_H
+#define VIS_FFT_REF_H
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#include "protocol.h"
+
+namespace vis_ref {
+
+constexpr float SMOOTH_ATTACK     = 0.4f;
+constexpr float SMOOTH_DECAY      = 0.85f;
+constexpr float GRAVITY           = 0.008f;
+constexpr float SILENCE_THRESHOLD = 1e-4f;
+constexpr float SENS_INIT         = 1.0f;
+constexpr float SENS_ATTACK       = 0.85f;
+constexpr float SENS_RELEASE      = 1.002f;
+constexpr float SENS_INIT_BOOST   = 1.05f;
+constexpr float SENS_INIT_CAP     = 5.0f;
+constexpr float SENS_TARGET       = 0.65f;
+constexpr float SENS_MIN          = 0.02f;
+constexpr float SENS_MAX          = 5.0f;
+constexpr float EQ_POWER          = 0.5f;
+
+struct Complex { float re, im; };
+
+static inline Complex cadd(Complex a, Complex b) { return {a.re+b.re, a.im+b.im}; }
+static inline Complex csub(Complex a, Complex b) { return {a.re-b.re, a.im-b.im}; }
+static inline Complex cmul(Complex a, Complex b) {
+    return {a.re*b.re - a.im*b.im, a.re*b.im + a.im*b.re};
+}
+
+static void bitReverse(Complex* buf, int n) {
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) { Complex t = buf[i]; buf[i] = buf[j]; buf[j] = t; }
+    }
+}
+
+static void fft(Complex* buf, int n) {
+    bitReverse(buf, n);
+    for (int len = 2; len <= n; len <<= 1) {
+        float angle = -2.0f * (float)M_PI / len;
+        Complex wn = {cosf(angle), sinf(angle)};
+        for (int i = 0; i < n; i += len) {
+            Complex w = {1.0f, 0.0f};
+            for (int j = 0; j < len / 2; j++) {
+                Complex u = buf[i + j];
+                Complex v = cmul(w, buf[i + j + len/2]);
+                buf[i + j]         = cadd(u, v);
+                buf[i + j + len/2] = csub(u, v);
+                w = cmul(w, wn);
+            }
+        }
+    }
+}
+
+static int   g_barCount = BAR_COUNT;
+static float g_freqMax  = FREQ_MAX;
+
+static float g_inputBuf[FFT_SIZE];
+static float g_window[FFT_SIZE];
+static int   g_binLo[MAX_BAR_COUNT];
+static int   g_binHi[MAX_BAR_COUNT];
+static float g_eq[MAX_BAR_COUNT];
+static float g_mem[MAX_BAR_COUNT];
+static float g_peak[MAX_BAR_COUNT];
+static float g_fall[MAX_BAR_COUNT];
+static float g_sens;
+static bool  g_sensInit;
+
+// Reset state for the given layout.
+static void initProcessor(int barCount, float freqMax) {
+    g_barCount = barCount;
+    g_freqMax  = freqMax;
+
+    for (int i = 0; i < FFT_SIZE; i++)
+        g_window[i] = 0.5f * (1.0f - cosf(2.0f * (float)M_PI * i / (FFT_SIZE - 1)));
+
+    float logMin = log10f(FREQ_MIN);
+    float logMax = log10f(g_freqMax);
+    int loCut[MAX_BAR_COUNT + 1];
+    for (int i = 0; i <= g_barCount; i++) {
+        float f = powf(10.0f, logMin + (float)i / g_barCount * (logMax - logMin));
+        loCut[i] = std::max(1, (int)roundf(f * FFT_SIZE / SAMPLE_RATE));
+    }
+    for (int i = 1; i <= g_barCount; i++) {
+        if (loCut[i] <= loCut[i - 1])
+            loCut[i] = loCut[i - 1] + 1;
+    }
+    for (int i = 0; i < g_barCount; i++) {
+        g_binLo[i] = loCut[i];
+        g_binHi[i] = std::max(loCut[i], loCut[i + 1] - 1);
+        g_binHi[i] = std::min(g_binHi[i], FFT_SIZE / 2 - 1);
+    }
+
+    for (int i = 0; i < g_barCount; i++) {
+        float fCenter = (float)(g_binLo[i] + g_binHi[i]) * 0.5f
+                        * (float)SAMPLE_RATE / (float)FFT_SIZE;
+        g_eq[i] = powf(std::max(fCenter, (float)FREQ_MIN) / (float)FREQ_MIN, EQ_POWER);
+    }
+
+    memset(g_inputBuf, 0, sizeof(g_inputBuf));
+    memset(g_mem, 0, sizeof(g_mem));
+    memset(g_peak, 0, sizeof(g_peak));
+    memset(g_fall, 0, sizeof(g_fall));
+    g_sens = SENS_INIT;
+    g_sensInit = true;
+}
+
+// Process one frame of FRAME_SAMPLES fresh audio.
+// Output: bars[g_barCount] in [0, 1].  No debug logging.
+static void processFrame(const float* newSamples, float* bars) {
+    memmove(g_inputBuf, g_inputBuf + FRAME_SAMPLES,
+            (FFT_SIZE - FRAME_SAMPLES) * sizeof(float));
+    memcpy(g_inputBuf + (FFT_SIZE - FRAME_SAMPLES), newSamples,
+           FRAME_SAMPLES * sizeof(float));
+
+    float audioMax = 0.0f;
+    for (int i = 0; i < FRAME_SAMPLES; i++) {
+        float a = fabsf(newSamples[i]);
+        if (a > audioMax) audioMax = a;
+    }
+
+    static Complex fftBuf[FFT_SIZE];
+    for (int i = 0; i < FFT_SIZE; i++) {
+        fftBuf[i].re = g_inputBuf[i] * g_window[i];
+        fftBuf[i].im = 0.0f;
+    }
+    fft(fftBuf, FFT_SIZE);
+
+    static float mag[FFT_SIZE / 2];
+    for (int i = 0; i < FFT_SIZE / 2; i++)
+        mag[i] = sqrtf(fftBuf[i].re * fftBuf[i].re + fftBuf[i].im * fftBuf[i].im);
+
+    bool silence = (audioMax < SILENCE_THRESHOLD);
+    float rawBars[MAX_BAR_COUNT];
+    for (int b = 0; b < g_barCount; b++) {
+        float sum = 0.0f;
+        int count = g_binHi[b] - g_binLo[b] + 1;
+        for (int k = g_binLo[b]; k <= g_binHi[b]; k++)
+            sum += mag[k];
+        float avg = count > 0 ? sum / count : 0.0f;
+        float norm = avg / (FFT_SIZE * 0.5f);
+        rawBars[b] = sqrtf(norm) * g_eq[b] * g_sens;
+    }
+
+    bool overshoot = false;
+    for (int b = 0; b < g_barCount; b++) {
+        float raw = rawBars[b];
+        if (raw > g_mem[b]) {
+            g_mem[b] = g_mem[b] * SMOOTH_ATTACK + raw * (1.0f - SMOOTH_ATTACK);
+        } else {
+            g_mem[b] = g_mem[b] * SMOOTH_DECAY + raw * (1.0f - SMOOTH_DECAY);
+        }
+        if (g_mem[b] >= g_peak[b]) {
+            g_peak[b] = g_mem[b];
+            g_fall[b] = 0.0f;
+        } else {
+            g_fall[b] += GRAVITY;
+            g_peak[b] -= g_fall[b];
+            if (g_peak[b] < g_mem[b]) g_peak[b] = g_mem[b];
+            if (g_peak[b] < 0.0f) g_peak[b] = 0.0f;
+        }
+        if (g_peak[b] > SENS_TARGET) overshoot = true;
+        bars[b] = std::min(g_peak[b], 1.0f);
+    }
+
+    if (overshoot) {
+        g_sens *= SENS_ATTACK;
+        g_sensInit = false;
+    } else if (!silence) {
+        g_sens *= SENS_RELEASE;
+        if (g_sensInit) {
+            g_sens *= SENS_INIT_BOOST;
+            if (g_sens > SENS_INIT_CAP)
+                g_sensInit = false;
+        }
+    }
+    g_sens = std::max(SENS_MIN, std::min(SENS_MAX, g_sens));
+}
+
+} // namespace vis_ref
+
+#endif // VIS_FFT_REF_H
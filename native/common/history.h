@@ -0,0 +1,392 @@
+// history.h — Long-range bar history for zoomable session overviews.
+// Every hop's bars go into a time pyramid of HISTORY_LEVELS rings.
+// Level 0 holds hop frames (60 Hz); each level above holds one record per
+// HISTORY_FANOUT records of the one below (6 Hz, 0.6 Hz, 0.06 Hz), with
+// the max and the mean of each bar.  Bars are stored as bytes.  The rings
+// live in a fixed-size memory-mapped file, so history survives restarts
+// and the footprint never grows: about 5 minutes of hops, 50 minutes at
+// 6 Hz, 8 hours at 0.6 Hz and 3.5 days at 0.06 Hz.
+// A query for a time range at a pixel width reads the coarsest level
+// that still has a record per column, so any zoom costs at most
+// HISTORY_FANOUT records per column and one byte per bar per column on
+// the wire.
+// Header-only, C++17 standard library + OS file mapping.
+#ifndef VIS_HISTORY_H
+#define VIS_HISTORY_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "protocol.h"
+
+constexpr int    HISTORY_LEVELS   = 4;
+constexpr int    HISTORY_FANOUT   = 10;         // records per record of the next level
+constexpr int    HISTORY_CAPACITY = 18000;      // records per level
+constexpr double HISTORY_HOP_MS   = 1000.0 * FRAME_SAMPLES / SAMPLE_RATE;
+
+struct HistoryRecord {
+    int64_t  ms;                        // wall clock, ms since the epoch, of its first hop
+    uint16_t count;                     // bars
+    uint16_t pad[3];
+    uint8_t  max[MAX_BAR_COUNT];        // 0..255 = 0..1
+    uint8_t  mean[MAX_BAR_COUNT];
+};
+
+// Start of the file.  A file written by a build with another layout is
+// started over.
+struct HistoryFileHeader {
+    char     magic[8];
+    uint32_t levels, capacity, maxBars, recordSize;
+    struct { uint32_t head, count; } ring[HISTORY_LEVELS];     // next slot, records held
+};
+constexpr size_t HISTORY_DATA_OFFSET = 64;
+static_assert(sizeof(HistoryFileHeader) <= HISTORY_DATA_OFFSET, "history header outgrew its slot");
+static constexpr char HISTORY_MAGIC[8] = "CVHIST1";
+
+// Default location: $XDG_CACHE_HOME/clear-vis/history (or ~/.cache/...),
+// %LOCALAPPDATA%\clear-vis\history on Windows.  Empty if no home.
+static inline std::string defaultHistoryPath() {
+    std::string dir;
+#ifdef _WIN32
+    if (const char* la = getenv("LOCALAPPDATA"); la && *la) dir = std::string(la) + "\\clear-vis";
+    if (dir.empty()) return "";
+    _mkdir(dir.c_str());
+    return dir + "\\history";
+#else
+    if (const char* x = getenv("XDG_CACHE_HOME"); x && *x) dir = std::string(x) + "/clear-vis";
+    else if (const char* h = getenv("HOME"); h && *h) dir = std::string(h) + "/.cache/clear-vis";
+    if (dir.empty()) return "";
+    mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0755);
+    mkdir(dir.c_str(), 0755);
+    return dir + "/history";
+#endif
+}
+
+class HistoryStore {
+public:
+    HistoryStore() = default;
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+    ~HistoryStore() { close(); }
+
+    // Map `path`, creating or starting it over as needed.  With an empty
+    // path, or if mapping fails, history is kept in memory for this run.
+    void open(const std::string& path) {
+        close();
+        const size_t size = HISTORY_DATA_OFFSET + (size_t)HISTORY_LEVELS * HISTORY_CAPACITY * sizeof(HistoryRecord);
+        if (!path.empty() && map(path, size)) {
+            fprintf(stderr, "[vis] History: %s (%zu MB)\n", path.c_str(), size >> 20);
+        } else {
+            mem.assign(size, 0);
+            base = mem.data();
+            fprintf(stderr, "[vis] History kept in memory only\n");
+        }
+        HistoryFileHeader* h = hdr();
+        if (memcmp(h->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC)) != 0 || h->levels != HISTORY_LEVELS ||
+            h->capacity != HISTORY_CAPACITY || h->maxBars != MAX_BAR_COUNT || h->recordSize != sizeof(HistoryRecord)) {
+            memset(h, 0, sizeof(*h));
+            memcpy(h->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC));
+            h->levels = HISTORY_LEVELS;
+            h->capacity = HISTORY_CAPACITY;
+            h->maxBars = MAX_BAR_COUNT;
+            h->recordSize = sizeof(HistoryRecord);
+        }
+        for (Pending& p : pending) p.n = 0;
+        lastMs = h->ring[0].count ? newest(0).ms : 0;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (mapped) {
+            UnmapViewOfFile(base);
+            CloseHandle(mapping);
+            CloseHandle(file);
+        }
+#else
+        if (mapped) {
+            munmap(base, mappedSize);
+            ::close(fd);
+        }
+#endif
+        mapped = false;
+        base = nullptr;
+        mem.clear();
+    }
+
+    bool isOpen() const { return base != nullptr; }
+
+    // One hop's bars (0..1), stamped with the wall clock.
+    void append(const float* bars, int count, int64_t ms) {
+        if (!base || count < 1 || count > MAX_BAR_COUNT) return;
+        ms = std::max(ms, lastMs);          // keep each ring sorted if the clock steps back
+        lastMs = ms;
+        HistoryRecord r;
+        r.ms = ms;
+        r.count = (uint16_t)count;
+        memset(r.pad, 0, sizeof(r.pad));
+        for (int b = 0; b < count; b++)
+            r.max[b] = r.mean[b] = (uint8_t)lrintf(std::min(1.0f, std::max(0.0f, bars[b])) * 255.0f);
+        push(0, r);
+
+        // Roll up: every HISTORY_FANOUT records make one on the next level
+        for (int level = 1; level < HISTORY_LEVELS; level++) {
+            Pending& p = pending[level];
+            if (p.n > 0 && p.count != r.count) p.n = 0;      // layout changed; start over
+            if (p.n == 0) {
+                p.ms = r.ms;
+                p.count = r.count;
+                memset(p.max, 0, sizeof(p.max));
+                memset(p.sum, 0, sizeof(p.sum));
+            }
+            for (int b = 0; b < r.count; b++) {
+                p.max[b] = std::max(p.max[b], r.max[b]);
+                p.sum[b] += r.mean[b];
+            }
+            if (++p.n < HISTORY_FANOUT) break;
+            r.ms = p.ms;
+            for (int b = 0; b < r.count; b++) {
+                r.max[b] = p.max[b];
+                r.mean[b] = (uint8_t)((p.sum[b] + HISTORY_FANOUT / 2) / HISTORY_FANOUT);
+            }
+            p.n = 0;
+            push(level, r);
+        }
+    }
+
+    // Bars over [fromMs, toMs) in `columns` equal time columns: out gets
+    // columns x bars bytes (max or mean of the records in each column),
+    // valid[c] whether column c had any.  Bars follow the newest record in
+    // range; records from another layout are skipped.  Returns the level
+    // read, or -1 with nothing in range.
+    int query(int64_t fromMs, int64_t toMs, int columns, bool mean,
+              uint8_t* out, uint8_t* valid, int* bars) const {
+        if (!base || columns < 1 || toMs <= fromMs) return -1;
+        const double perColumn = (double)(toMs - fromMs) / columns;
+        int level = 0;
+        double interval = HISTORY_HOP_MS;
+        while (level + 1 < HISTORY_LEVELS && interval * HISTORY_FANOUT <= perColumn) {
+            level++;
+            interval *= HISTORY_FANOUT;
+        }
+        // Too fine to reach back to fromMs: a coarser level that does wins
+        while (level + 1 < HISTORY_LEVELS && held(level + 1) &&
+               (!held(level) || (at(level, 0).ms > fromMs && at(level + 1, 0).ms < at(level, 0).ms)))
+            level++;
+
+        const uint32_t first = lowerBound(level, fromMs), end = lowerBound(level, toMs);
+        if (first >= end) return -1;
+        const int count = at(level, end - 1).count;
+        *bars = count;
+        memset(out, 0, (size_t)columns * count);
+        memset(valid, 0, columns);
+
+        uint32_t sum[MAX_BAR_COUNT];
+        int sumCol = -1, sumN = 0;
+        auto flush = [&]() {
+            if (sumCol < 0 || !mean) return;
+            uint8_t* o = out + (size_t)sumCol * count;
+            for (int b = 0; b < count; b++) o[b] = (uint8_t)((sum[b] + sumN / 2) / sumN);
+        };
+        for (uint32_t i = first; i < end; i++) {
+            const HistoryRecord& r = at(level, i);
+            if (r.count != count) continue;
+            const int col = std::min(columns - 1, (int)((r.ms - fromMs) / perColumn));
+            valid[col] = 1;
+            if (!mean) {
+                uint8_t* o = out + (size_t)col * count;
+                for (int b = 0; b < count; b++) o[b] = std::max(o[b], r.max[b]);
+                continue;
+            }
+            if (col != sumCol) {
+                flush();
+                sumCol = col;
+                sumN = 0;
+                memset(sum, 0, sizeof(sum));
+            }
+            for (int b = 0; b < count; b++) sum[b] += r.mean[b];
+            sumN++;
+        }
+        flush();
+        return level;
+    }
+
+private:
+    struct Pending {
+        uint8_t  max[MAX_BAR_COUNT];
+        uint32_t sum[MAX_BAR_COUNT];
+        int      n = 0, count = 0;
+        int64_t  ms = 0;
+    };
+
+    uint8_t* base = nullptr;
+    std::vector<uint8_t> mem;           // when not mapped
+    bool mapped = false;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    Pending pending[HISTORY_LEVELS];    // rolling into level i (i >= 1); this run only
+    int64_t lastMs = 0;
+
+    HistoryFileHeader* hdr() const { return (HistoryFileHeader*)base; }
+    HistoryRecord* slots(int level) const {
+        return (HistoryRecord*)(base + HISTORY_DATA_OFFSET) + (size_t)level * HISTORY_CAPACITY;
+    }
+    uint32_t held(int level) const { return hdr()->ring[level].count; }
+    // i-th oldest record held
+    const HistoryRecord& at(int level, uint32_t i) const {
+        const auto& ring = hdr()->ring[level];
+        return slots(level)[(ring.head + HISTORY_CAPACITY - ring.count + i) % HISTORY_CAPACITY];
+    }
+    const HistoryRecord& newest(int level) const { return at(level, held(level) - 1); }
+    // First record at or after ms
+    uint32_t lowerBound(int level, int64_t ms) const {
+        uint32_t lo = 0, hi = held(level);
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (at(level, mid).ms < ms) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+    void push(int level, const HistoryRecord& r) {
+        auto& ring = hdr()->ring[level];
+        memcpy(&slots(level)[ring.head], &r, sizeof(r));
+        ring.head = (ring.head + 1) % HISTORY_CAPACITY;
+        if (ring.count < (uint32_t)HISTORY_CAPACITY) ring.count++;
+    }
+
+    bool map(const std::string& path, size_t size) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, nullptr);
+        void* p = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : nullptr;
+        if (!p) {
+            fprintf(stderr, "[vis] History: cannot map %s (error %lu)\n", path.c_str(), GetLastError());
+            if (mapping) CloseHandle(mapping);
+            CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+            mapping = nullptr;
+            return false;
+        }
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        struct stat st;
+        void* p = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && ((size_t)st.st_size == size || ftruncate(fd, (off_t)size) == 0))
+            p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "[vis] History: cannot map %s: %s\n", path.c_str(), strerror(errno));
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+#endif
+        base = (uint8_t*)p;
+        mapped = true;
+        mappedSize = size;
+        return true;
+    }
+};
+
+// A HISTORY: answer on its way to one client, a frame at a time as the
+// client's queue has room (see protocol.h for the frame layout).
+struct HistoryReply {
+    std::vector<uint8_t> data;          // columns x bars
+    std::vector<uint8_t> valid;         // per column
+    int64_t fromMs = 0, toMs = 0;
+    int level = 0, columns = 0, bars = 0, next = 0;
+    bool mean = false;
+
+    bool pending() const { return next < columns; }
+    void cancel() { next = columns = 0; }
+
+    // Run the query; false (nothing pending) when the range is empty.
+    bool start(const HistoryStore& store, int64_t from, int64_t to, int cols, bool useMean) {
+        data.resize((size_t)cols * MAX_BAR_COUNT);
+        valid.resize(cols);
+        level = store.query(from, to, cols, useMean, data.data(), valid.data(), &bars);
+        fromMs = from;
+        toMs = to;
+        mean = useMean;
+        columns = level < 0 ? 0 : cols;
+        next = 0;
+        return level >= 0;
+    }
+
+    // Encode the next frame's worth of columns into buf; the number of
+    // columns it holds goes to *taken (add to `next` once it is sent).
+    size_t encode(uint8_t* buf, size_t cap, int* taken) const {
+        const int fit = (int)((cap - HISTORY_HEADER_BYTES) / (1 + bars));
+        const int n = std::min(fit, columns - next);
+        uint8_t* p = buf;
+        auto u16 = [&p](int v) { *p++ = (uint8_t)(v & 0xFF); *p++ = (uint8_t)(v >> 8); };
+        auto i64 = [&p](int64_t v) { for (int i = 0; i < 8; i++) *p++ = (uint8_t)((uint64_t)v >> (8 * i)); };
+        *p++ = FRAME_KIND_HISTORY;
+        *p++ = (uint8_t)level;
+        u16(n);
+        u16(next);
+        u16(columns);
+        u16(bars);
+        *p++ = mean ? 1 : 0;
+        *p++ = 0;
+        i64(fromMs);
+        i64(toMs);
+        for (int c = next; c < next + n; c++) {
+            *p++ = valid[c];
+            memcpy(p, data.data() + (size_t)c * bars, bars);
+            p += bars;
+        }
+        *taken = n;
+        return (size_t)(p - buf);
+    }
+};
+
+// "HISTORY:<fromMs>,<toMs>,<columns>,<max|mean>"
+static inline bool parseHistoryQuery(std::string_view arg, int64_t* fromMs, int64_t* toMs, int* columns, bool* mean) {
+    char buf[96];
+    if (arg.empty() || arg.size() >= sizeof(buf)) return false;
+    memcpy(buf, arg.data(), arg.size());
+    buf[arg.size()] = '\0';
+    char* end;
+    long long f = strtoll(buf, &end, 10);
+    if (*end != ',') return false;
+    long long t = strtoll(end + 1, &end, 10);
+    if (*end != ',') return false;
+    long c = strtol(end + 1, &end, 10);
+    if (*end != ',') return false;
+    const char* r = end + 1;
+    if (strcmp(r, "max") == 0) *mean = false;
+    else if (strcmp(r, "mean") == 0) *mean = true;
+    else return false;
+    if (t <= f || c < 1 || c > HISTORY_MAX_COLUMNS) return false;
+    *fromMs = f;
+    *toMs = t;
+    *columns = (int)c;
+    return true;
+}
+
+#endif // VIS_HISTORY_H
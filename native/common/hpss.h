@@ -0,0 +1,138 @@
+// hpss.h — Harmonic / percussive bar layers.
+// Median-filtering HPSS (Fitzgerald 2010) over each hop's magnitude
+// spectrum, run as a VisProcessor spectrum tap:
+//   - harmonic estimate: per bin, the median of its last HPSS_TIME hops
+//     (sustained tones are steady across time),
+//   - percussive estimate: per hop, the median of HPSS_FREQ neighbouring
+//     bins (hits are flat across frequency),
+//   - Wiener masks H^2 / (H^2 + P^2) and P^2 / (H^2 + P^2) split the
+//     magnitudes into two layers, each binned, scaled and smoothed the
+//     way the main bars are.
+// The time filter is causal, so harmonic onsets lag by about half its
+// window.  Both medians are kept incrementally: every window is a sorted
+// array, and a step replaces the value leaving it with the one entering
+// and moves that one slot into place, so nothing is ever re-sorted and a
+// step costs a binary search plus the distance the value travels.
+// Header-only, no external dependencies.
+#ifndef VIS_HPSS_H
+#define VIS_HPSS_H
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "fft.h"
+
+constexpr int HPSS_TIME = 17;           // hops, ~280 ms
+constexpr int HPSS_FREQ = 17;           // bins, ~180 Hz
+constexpr int HPSS_BINS = FFT_SIZE / 2;
+
+// Sorted window win[n]: replace `out` (which it holds) with `in`.
+// Returns the median.
+static inline float hpssSlide(float* win, int n, float out, float in) {
+    int i = (int)(std::lower_bound(win, win + n, out) - win);
+    if (in > out) {
+        for (; i + 1 < n && win[i + 1] < in; i++) win[i] = win[i + 1];
+    } else {
+        for (; i > 0 && win[i - 1] > in; i--) win[i] = win[i - 1];
+    }
+    win[i] = in;
+    return win[n / 2];
+}
+
+struct HpssLayers {
+    // Time medians: per bin, a sorted window and the values in hop order
+    float timeSorted[HPSS_BINS][HPSS_TIME];
+    float timeHist[HPSS_TIME][HPSS_BINS];
+    int   histHead = 0;
+    unsigned gen = ~0u;                 // processor reset this state follows
+
+    // Per layer (0 = harmonic, 1 = percussive) smoothing, then output
+    float mem[2][MAX_BAR_COUNT], peak[2][MAX_BAR_COUNT], fall[2][MAX_BAR_COUNT];
+    float harmonic[MAX_BAR_COUNT];
+    float percussive[MAX_BAR_COUNT];
+    int   count = 0;                    // bars in each layer
+
+    // Scratch
+    float layer[2][HPSS_BINS];
+
+    void reset() {
+        memset(timeSorted, 0, sizeof(timeSorted));
+        memset(timeHist, 0, sizeof(timeHist));
+        histHead = 0;
+        memset(mem, 0, sizeof(mem));
+        memset(peak, 0, sizeof(peak));
+        memset(fall, 0, sizeof(fall));
+        count = 0;
+    }
+};
+
+// VisProcessor::spectrumTap; ctx is the HpssLayers.
+static void hpssTap(void* ctx, const VisProcessor& p, const float* mag, int bins, float gain) {
+    HpssLayers& h = *(HpssLayers*)ctx;
+    const VisConfig& c = *p.cfg;
+    if (h.gen != p.gen) {
+        h.reset();
+        h.gen = p.gen;
+    }
+
+    // Frequency window, centred on bin k, zero beyond the edges
+    constexpr int half = HPSS_FREQ / 2;
+    float freqSorted[HPSS_FREQ];
+    for (int j = 0; j < HPSS_FREQ; j++) {
+        int k = j - half;
+        freqSorted[j] = k >= 0 && k < bins ? mag[k] : 0.0f;
+    }
+    std::sort(freqSorted, freqSorted + HPSS_FREQ);
+    float freqMedian = freqSorted[half];
+
+    float* old = h.timeHist[h.histHead];
+    for (int k = 0; k < bins; k++) {
+        if (k > 0) {
+            int out = k - half - 1, in = k + half;
+            freqMedian = hpssSlide(freqSorted, HPSS_FREQ, out >= 0 ? mag[out] : 0.0f, in < bins ? mag[in] : 0.0f);
+        }
+        const float harm = hpssSlide(h.timeSorted[k], HPSS_TIME, old[k], mag[k]);
+        old[k] = mag[k];
+
+        const float hh = harm * harm, pp = freqMedian * freqMedian, sum = hh + pp;
+        const float mh = sum > 0.0f ? hh / sum : 0.5f;
+        h.layer[0][k] = mag[k] * mh;
+        h.layer[1][k] = mag[k] * (1.0f - mh);
+    }
+    h.histHead = (h.histHead + 1) % HPSS_TIME;
+
+    // Bin and smooth each layer like the main bars (AverageBinning +
+    // BranchlessEmaGravitySmoother)
+    const VisTuning& t = c.tune;
+    float* outs[2] = { h.harmonic, h.percussive };
+    for (int l = 0; l < 2; l++) {
+        for (int b = 0; b < p.barCount; b++) {
+            float sum = 0.0f;
+            const int count = c.binHi[b] - c.binLo[b] + 1;
+            for (int k = c.binLo[b]; k <= c.binHi[b]; k++) sum += h.layer[l][k];
+            const float avg = count > 0 ? sum / count : 0.0f;
+            const float raw = sqrtf(avg / (FFT_SIZE * 0.5f)) * c.eq[b] * gain;
+
+            const float a = raw > h.mem[l][b] ? t.smoothAttack : t.smoothDecay;
+            const float m = h.mem[l][b] * a + raw * (1.0f - a);
+            const bool rise = m >= h.peak[l][b];
+            const float fall = rise ? 0.0f : h.fall[l][b] + t.gravity;
+            const float pk = std::max(std::max(rise ? m : h.peak[l][b] - fall, m), 0.0f);
+            h.mem[l][b] = m;
+            h.fall[l][b] = fall;
+            h.peak[l][b] = pk;
+            outs[l][b] = std::min(pk, 1.0f);
+        }
+    }
+    h.count = p.barCount;
+}
+
+// Route p's spectrum through h from its next frame (nullptr stops it).
+static inline void attachHpss(VisProcessor& p, HpssLayers* h) {
+    if (h) h->gen = ~0u;                // start clean
+    p.tapCtx = h;
+    p.spectrumTap = h ? hpssTap : nullptr;
+}
+
+#endif // VIS_HPSS_H
@@ -0,0 +1,143 @@
+// interp.h — Display-rate frame interpolation for the visualizer.
+// The DSP produces one bar frame per hop (FRAME_SAMPLES, ~16.7 ms).
+// A client that sends SET_REFRESH:<hz> instead gets frames at its
+// display rate, each sampled from the last few hop outputs with a
+// monotone cubic (Fritsch–Carlson) so motion is smooth and bars never
+// overshoot the values the DSP produced.  Sampling runs one hop behind
+// the newest output, so there is always a segment to interpolate.
+// Header-only, C++17 standard library + OS timers.
+#ifndef VIS_INTERP_H
+#define VIS_INTERP_H
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#ifdef _WIN32
+  #ifndef WIN32_LEAN_AND_MEAN
+  #define WIN32_LEAN_AND_MEAN
+  #endif
+  #include <windows.h>
+#else
+  #include <time.h>
+  #include <errno.h>
+#endif
+
+#include "protocol.h"
+
+constexpr int     INTERP_KEYS     = 4;      // hop outputs kept per stream
+constexpr int64_t HOP_NS          = (int64_t)1000000000 * FRAME_SAMPLES / SAMPLE_RATE;
+// Render time lags the clock by one hop plus a margin for DSP time and
+// capture jitter, so the newest output is (nearly) always past it.
+constexpr int64_t INTERP_DELAY_NS = HOP_NS + 4000000;
+
+// ---- Keyframes + monotone cubic sampling, one per bar stream ----
+struct BarInterpolator {
+    float   keys[INTERP_KEYS][MAX_BAR_COUNT];   // oldest first
+    int64_t t[INTERP_KEYS];                     // steady-clock ns of each key
+    int     count = 0;
+    int     barCount = 0;
+
+    void clear() { count = 0; }
+
+    // Add one hop output.  A layout change restarts the history.  Keys
+    // that arrive in a burst (capture delivered several hops at once)
+    // are spread half a hop apart so every segment has a length.
+    void push(const float* bars, int n, int64_t tNs) {
+        if (n != barCount) { barCount = n; count = 0; }
+        if (count > 0) tNs = std::max(tNs, t[count - 1] + HOP_NS / 2);
+        if (count == INTERP_KEYS) {
+            memmove(keys[0], keys[1], sizeof(keys[0]) * (INTERP_KEYS - 1));
+            memmove(t, t + 1, sizeof(t[0]) * (INTERP_KEYS - 1));
+            count--;
+        }
+        memcpy(keys[count], bars, n * sizeof(float));
+        t[count++] = tNs;
+    }
+
+    // Bars at time tNs into out[]; returns the bar count (0 if empty).
+    // Outside the held keys the nearest key is held.
+    int sample(int64_t tNs, float* out) const {
+        if (count == 0) return 0;
+        if (count == 1 || tNs <= t[0]) { memcpy(out, keys[0], barCount * sizeof(float)); return barCount; }
+        if (tNs >= t[count - 1]) { memcpy(out, keys[count - 1], barCount * sizeof(float)); return barCount; }
+
+        int k = 0;                                  // segment [k, k+1]
+        while (tNs > t[k + 1]) k++;
+        const float h  = (float)(t[k + 1] - t[k]);
+        const float s  = (float)(tNs - t[k]) / h;
+        const float s2 = s * s, s3 = s2 * s;
+        const float h00 = 2 * s3 - 3 * s2 + 1, h10 = s3 - 2 * s2 + s;
+        const float h01 = -2 * s3 + 3 * s2,    h11 = s3 - s2;
+        // Secant slopes either side of the segment, per unit of h.
+        const bool  hasPrev = k > 0, hasNext = k + 2 < count;
+        const float hp = hasPrev ? (float)(t[k] - t[k - 1]) / h : 1.0f;
+        const float hn = hasNext ? (float)(t[k + 2] - t[k + 1]) / h : 1.0f;
+        const float* p0 = keys[hasPrev ? k - 1 : k];
+        const float* p1 = keys[k];
+        const float* p2 = keys[k + 1];
+        const float* p3 = keys[hasNext ? k + 2 : k + 1];
+
+        for (int b = 0; b < barCount; b++) {
+            float d  = p2[b] - p1[b];
+            float dp = hasPrev ? (p1[b] - p0[b]) / hp : d;
+            float dn = hasNext ? (p3[b] - p2[b]) / hn : d;
+            // Fritsch–Carlson: flat tangent at a local extremum, else the
+            // mean secant limited to 3x the segment's so it stays monotone.
+            float m1 = dp * d <= 0.0f ? 0.0f : 0.5f * (dp + d);
+            float m2 = d * dn <= 0.0f ? 0.0f : 0.5f * (d + dn);
+            float lim = 3.0f * fabsf(d);
+            m1 = std::max(-lim, std::min(lim, m1));
+            m2 = std::max(-lim, std::min(lim, m2));
+            out[b] = h00 * p1[b] + h10 * m1 + h01 * p2[b] + h11 * m2;
+        }
+        return barCount;
+    }
+};
+
+// ---- Per-client display clock ----
+// Frames are due every 1/hz on a fixed grid (no drift); a client that
+// falls more than a period behind resynchronises rather than bursting.
+struct RefreshClock {
+    int     hz = 0;                             // 0 = off (hop-rate frames)
+    int64_t periodNs = 0;
+    int64_t nextNs = 0;
+
+    void set(int rate, int64_t nowNs) {
+        hz = rate;
+        periodNs = rate > 0 ? 1000000000LL / rate : 0;
+        nextNs = nowNs;
+    }
+
+    bool due(int64_t nowNs) {
+        if (hz == 0 || nowNs < nextNs) return false;
+        nextNs += periodNs;
+        if (nextNs <= nowNs) nextNs = nowNs + periodNs;
+        return true;
+    }
+};
+
+// Sleep until a steady-clock deadline (ns, as WsServer::nowNs()) with
+// sub-millisecond precision: an absolute CLOCK_MONOTONIC sleep on Linux,
+// a high-resolution waitable timer on Windows (Sleep() rounds to the
+// 15.6 ms tick there).
+static inline void sleepUntilNs(int64_t deadlineNs, int64_t nowNs) {
+    if (deadlineNs <= nowNs) return;
+#ifdef _WIN32
+    static HANDLE timer = CreateWaitableTimerExW(nullptr, nullptr,
+        0x00000002 /* CREATE_WAITABLE_TIMER_HIGH_RESOLUTION */, TIMER_ALL_ACCESS);
+    if (!timer) { Sleep((DWORD)((deadlineNs - nowNs + 999999) / 1000000)); return; }
+    LARGE_INTEGER due;
+    due.QuadPart = -(LONGLONG)((deadlineNs - nowNs + 99) / 100);   // relative, 100 ns units
+    SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE);
+    WaitForSingleObject(timer, INFINITE);
+#else
+    // steady_clock is CLOCK_MONOTONIC on Linux, so the deadline is
+    // already on the right clock.
+    timespec ts{ (time_t)(deadlineNs / 1000000000), (long)(deadlineNs % 1000000000) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+#endif
+}
+
+#endif // VIS_INTERP_H
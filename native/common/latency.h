@@ -0,0 +1,118 @@
+// latency.h — Client render-latency feedback for the visualizer.
+// Clients may echo a binary frame's sequence number with the times they
+// received and painted it (see LATENCY: in protocol.h).  The daemon folds
+// each echo into per-client histograms and reports them via GET_METRICS.
+// Header-only, no dependencies beyond the C/C++ standard library.
+#ifndef VIS_LATENCY_H
+#define VIS_LATENCY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <string_view>
+
+// Bucket upper bounds in ms, roughly doubling; the last bucket is open.
+constexpr int   LAT_BUCKETS = 14;
+static const float LAT_BOUNDS_MS[LAT_BUCKETS - 1] = {
+    0.5f, 1, 2, 4, 8, 12, 16, 24, 33, 50, 100, 250, 1000
+};
+
+struct LatencyHistogram {
+    uint32_t counts[LAT_BUCKETS] = {};
+    uint32_t n = 0;
+    float    maxMs = 0.0f;
+    double   sumMs = 0.0;
+
+    void clear() { *this = LatencyHistogram{}; }
+
+    void add(float ms) {
+        int b = 0;
+        while (b < LAT_BUCKETS - 1 && ms > LAT_BOUNDS_MS[b]) b++;
+        counts[b]++;
+        n++;
+        sumMs += ms;
+        maxMs = std::max(maxMs, ms);
+    }
+
+    // Upper bound of the bucket holding the p-th percentile (p in 0..1);
+    // the open last bucket reports the observed max.
+    float percentile(float p) const {
+        if (n == 0) return 0.0f;
+        uint32_t want = (uint32_t)(p * (float)(n - 1)) + 1, seen = 0;
+        for (int b = 0; b < LAT_BUCKETS - 1; b++) {
+            seen += counts[b];
+            if (seen >= want) return std::min(LAT_BOUNDS_MS[b], maxMs);
+        }
+        return maxMs;
+    }
+
+    // {"n":..,"mean":..,"p50":..,"p95":..,"p99":..,"max":..,"buckets":[..]}
+    int toJson(char* out, size_t cap) const {
+        int len = snprintf(out, cap, "{\"n\":%u,\"mean\":%.2f,\"p50\":%.2f,\"p95\":%.2f,\"p99\":%.2f,\"max\":%.2f,\"buckets\":[",
+                           n, n ? sumMs / n : 0.0, percentile(0.5f), percentile(0.95f),
+                           percentile(0.99f), maxMs);
+        for (int b = 0; b < LAT_BUCKETS && len > 0 && (size_t)len < cap; b++)
+            len += snprintf(out + len, cap - len, b ? ",%u" : "%u", counts[b]);
+        if (len > 0 && (size_t)len < cap) len += snprintf(out + len, cap - len, "]}");
+        return (len > 0 && (size_t)len < cap) ? len : -1;
+    }
+};
+
+// Per-client view of one echoed frame, all in ms:
+//   render  = paint - receive, on the client's clock
+//   network = one-way estimate, (daemon round trip - render) / 2
+//   total   = capture -> queued on the daemon + network + render,
+//             i.e. glass-to-glass from the end of the audio chunk.
+struct ClientLatency {
+    LatencyHistogram network, render, total;
+    uint32_t echoes = 0;
+    uint32_t unmatched = 0;     // echo for a frame we no longer remember
+
+    void clear() { *this = ClientLatency{}; }
+
+    void add(float sentAgeMs, float rttMs, float renderMs) {
+        renderMs = std::max(0.0f, renderMs);
+        float networkMs = std::max(0.0f, (rttMs - renderMs) * 0.5f);
+        network.add(networkMs);
+        render.add(renderMs);
+        total.add(std::max(0.0f, sentAgeMs) + networkMs + renderMs);
+        echoes++;
+    }
+
+    int toJson(char* out, size_t cap) const {
+        int len = snprintf(out, cap, "{\"echoes\":%u,\"unmatched\":%u,\"network\":", echoes, unmatched);
+        const LatencyHistogram* h[3] = { &network, &render, &total };
+        const char* names[3] = { "", ",\"render\":", ",\"total\":" };
+        for (int i = 0; i < 3 && len > 0 && (size_t)len < cap; i++) {
+            if (i) len += snprintf(out + len, cap - len, "%s", names[i]);
+            if ((size_t)len >= cap) return -1;
+            int n = h[i]->toJson(out + len, cap - len);
+            if (n < 0) return -1;
+            len += n;
+        }
+        if (len > 0 && (size_t)len < cap) len += snprintf(out + len, cap - len, "}");
+        return (len > 0 && (size_t)len < cap) ? len : -1;
+    }
+};
+
+// Parse "seq,recvMs,paintMs" (the part after "LATENCY:").  The times are
+// doubles: performance.now() outgrows float precision within hours.
+static bool parseLatencyEcho(std::string_view arg, uint32_t* seq, double* recvMs, double* paintMs) {
+    char buf[96];
+    if (arg.empty() || arg.size() >= sizeof(buf)) return false;
+    memcpy(buf, arg.data(), arg.size());
+    buf[arg.size()] = '\0';
+    char* end;
+    unsigned long s = strtoul(buf, &end, 10);
+    if (*end != ',') return false;
+    *recvMs = strtod(end + 1, &end);
+    if (*end != ',') return false;
+    *paintMs = strtod(end + 1, &end);
+    if (*end != '\0') return false;
+    *seq = (uint32_t)s;
+    return true;
+}
+
+#endif // VIS_LATENCY_H
@@ -0,0 +1,228 @@
+// loudness.h — EBU R128 loudness and true-peak meter for one source.
+// Runs in the time domain on each incoming hop, alongside (not inside)
+// the FFT pipeline, and only while a client subscribes (SET_LOUDNESS):
+//   - K-weighting (BS.1770 pre-filter shelf + RLB high-pass) as two
+//     biquads, coefficients derived for SAMPLE_RATE,
+//   - mean square per 100 ms sub-block (6 hops), from which momentary
+//     (400 ms) and short-term (3 s) loudness are sliding means,
+//   - integrated loudness with the BS.1770-4 gates (absolute -70 LUFS,
+//     relative -10 LU) over every 400 ms block at 75% overlap, kept as
+//     a 0.1 LU histogram so the memory is fixed however long it runs,
+//   - true peak from 4x polyphase oversampling (48-tap windowed sinc).
+// Capture is mono, so the BS.1770 channel sum is the one channel.  The
+// biquads carry a sample-to-sample dependency and stay scalar; the
+// oversampling FIR (most of the work) and the energy sums are plain
+// loops over contiguous arrays that the compiler vectorises.
+// Header-only, C++17 standard library only.
+#ifndef VIS_LOUDNESS_H
+#define VIS_LOUDNESS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include "protocol.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+constexpr int   LOUD_SUBBLOCK_HOPS = SAMPLE_RATE / 10 / FRAME_SAMPLES;   // 100 ms = 6 hops
+constexpr int   LOUD_MOMENTARY     = 4;         // sub-blocks per 400 ms
+constexpr int   LOUD_SHORT_TERM    = 30;        // sub-blocks per 3 s
+constexpr float LOUD_ABS_GATE      = -70.0f;    // LUFS
+constexpr float LOUD_REL_GATE      = -10.0f;    // LU below the absolute-gated mean
+constexpr int   LOUD_HIST_BINS     = 800;       // 0.1 LU from -70 to +10 LUFS
+constexpr int   TP_OVERSAMPLE      = 4;
+constexpr int   TP_TAPS            = 12;        // per phase (48-tap prototype)
+static_assert(LOUD_SUBBLOCK_HOPS * FRAME_SAMPLES * 10 == SAMPLE_RATE, "sub-blocks must be whole hops");
+
+// LUFS / dBTP; -INFINITY until there is something to measure.
+struct LoudnessReading {
+    float momentary, shortTerm, integrated;
+    float truePeak;                     // last 100 ms
+    float truePeakMax;                  // since reset
+};
+
+static inline float energyToLufs(double ms) {
+    return ms > 0.0 ? -0.691f + 10.0f * (float)log10(ms) : -INFINITY;
+}
+
+struct LoudnessMeter {
+    // K-weighting, transposed direct form II
+    float b[2][3], a[2][2];
+    float z[2][2];
+
+    // 100 ms sub-blocks
+    double subSum;
+    int    subHops;
+    double sub[LOUD_SHORT_TERM];        // mean square of the last 30, ring
+    int    subHead, subCount;
+
+    // Gated integration
+    uint32_t histCount[LOUD_HIST_BINS];
+    double   histEnergy[LOUD_HIST_BINS];
+
+    // True peak
+    float tpCoef[TP_OVERSAMPLE][TP_TAPS];
+    float tpLine[TP_TAPS - 1 + FRAME_SAMPLES];  // history, then this hop
+    float tpPeak, tpMax;                // linear
+
+    LoudnessMeter() { reset(); }
+
+    void reset() {
+        // BS.1770 stage 1: high shelf, +4 dB above ~1.7 kHz
+        {
+            const double f0 = 1681.974450955533, g = 3.999843853973347, q = 0.7071752369554196;
+            const double k = tan(M_PI * f0 / SAMPLE_RATE), vh = pow(10.0, g / 20.0), vb = pow(vh, 0.4996667741545416);
+            const double a0 = 1.0 + k / q + k * k;
+            b[0][0] = (float)((vh + vb * k / q + k * k) / a0);
+            b[0][1] = (float)(2.0 * (k * k - vh) / a0);
+            b[0][2] = (float)((vh - vb * k / q + k * k) / a0);
+            a[0][0] = (float)(2.0 * (k * k - 1.0) / a0);
+            a[0][1] = (float)((1.0 - k / q + k * k) / a0);
+        }
+        // Stage 2: RLB high-pass at ~38 Hz
+        {
+            const double f0 = 38.13547087602444, q = 0.5003270373238773;
+            const double k = tan(M_PI * f0 / SAMPLE_RATE), a0 = 1.0 + k / q + k * k;
+            b[1][0] = 1.0f;
+            b[1][1] = -2.0f;
+            b[1][2] = 1.0f;
+            a[1][0] = (float)(2.0 * (k * k - 1.0) / a0);
+            a[1][1] = (float)((1.0 - k / q + k * k) / a0);
+        }
+        memset(z, 0, sizeof(z));
+
+        subSum = 0.0;
+        subHops = 0;
+        subHead = subCount = 0;
+        memset(histCount, 0, sizeof(histCount));
+        memset(histEnergy, 0, sizeof(histEnergy));
+
+        // Hann-windowed sinc, cutoff at the original Nyquist, gain
+        // TP_OVERSAMPLE so each phase passes DC at unity
+        const int taps = TP_OVERSAMPLE * TP_TAPS;
+        for (int j = 0; j < taps; j++) {
+            double x = (j - (taps - 1) / 2.0) / TP_OVERSAMPLE;
+            double sinc = x == 0.0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double w = 0.5 - 0.5 * cos(2.0 * M_PI * (j + 0.5) / taps);
+            tpCoef[j % TP_OVERSAMPLE][j / TP_OVERSAMPLE] = (float)(sinc * w);
+        }
+        for (int p = 0; p < TP_OVERSAMPLE; p++) {
+            float sum = 0.0f;
+            for (int k = 0; k < TP_TAPS; k++) sum += tpCoef[p][k];
+            for (int k = 0; k < TP_TAPS; k++) tpCoef[p][k] /= sum;
+        }
+        memset(tpLine, 0, sizeof(tpLine));
+        tpPeak = tpMax = 0.0f;
+    }
+
+    // Feed one hop (n <= FRAME_SAMPLES, mono, full scale +-1).  Returns
+    // true when a 100 ms sub-block completed and `out` holds a reading.
+    bool push(const float* x, int n, LoudnessReading& out) {
+        // K-weighted energy
+        float z00 = z[0][0], z01 = z[0][1], z10 = z[1][0], z11 = z[1][1];
+        double sum = 0.0;
+        for (int i = 0; i < n; i++) {
+            float s = x[i];
+            float y1 = b[0][0] * s + z00;
+            z00 = b[0][1] * s - a[0][0] * y1 + z01;
+            z01 = b[0][2] * s - a[0][1] * y1;
+            float y2 = b[1][0] * y1 + z10;
+            z10 = b[1][1] * y1 - a[1][0] * y2 + z11;
+            z11 = b[1][2] * y1 - a[1][1] * y2;
+            sum += (double)y2 * y2;
+        }
+        z[0][0] = z00; z[0][1] = z01; z[1][0] = z10; z[1][1] = z11;
+        subSum += sum;
+
+        // True peak: every phase at every input sample
+        memcpy(tpLine + TP_TAPS - 1, x, n * sizeof(float));
+        float peak = tpPeak;
+        for (int p = 0; p < TP_OVERSAMPLE; p++) {
+            const float* c = tpCoef[p];
+            for (int i = 0; i < n; i++) {
+                const float* line = tpLine + i;
+                float y = 0.0f;
+                for (int k = 0; k < TP_TAPS; k++) y += c[k] * line[TP_TAPS - 1 - k];
+                peak = std::fmax(peak, std::fabs(y));
+            }
+        }
+        tpPeak = peak;
+        memmove(tpLine, tpLine + n, (TP_TAPS - 1) * sizeof(float));
+
+        if (++subHops < LOUD_SUBBLOCK_HOPS) return false;
+        finishSubBlock(out);
+        return true;
+    }
+
+private:
+    void finishSubBlock(LoudnessReading& out) {
+        sub[subHead] = subSum / (LOUD_SUBBLOCK_HOPS * FRAME_SAMPLES);
+        subHead = (subHead + 1) % LOUD_SHORT_TERM;
+        if (subCount < LOUD_SHORT_TERM) subCount++;
+        subSum = 0.0;
+        subHops = 0;
+
+        auto meanOfLast = [this](int blocks) {
+            double e = 0.0;
+            for (int i = 1; i <= blocks; i++) e += sub[(subHead - i + LOUD_SHORT_TERM) % LOUD_SHORT_TERM];
+            return e / blocks;
+        };
+        out.momentary = out.shortTerm = -INFINITY;
+        if (subCount >= LOUD_MOMENTARY) {
+            double block = meanOfLast(LOUD_MOMENTARY);
+            out.momentary = energyToLufs(block);
+            // Every 400 ms block (75% overlap) goes to the gated integral
+            if (out.momentary > LOUD_ABS_GATE) {
+                int bin = std::min(LOUD_HIST_BINS - 1, (int)((out.momentary - LOUD_ABS_GATE) * 10.0f));
+                histCount[bin]++;
+                histEnergy[bin] += block;
+            }
+        }
+        // Over what there is until the first 3 s have passed
+        if (subCount >= LOUD_MOMENTARY) out.shortTerm = energyToLufs(meanOfLast(subCount));
+        out.integrated = integrated();
+
+        tpMax = std::fmax(tpMax, tpPeak);
+        out.truePeak    = tpPeak > 0.0f ? 20.0f * log10f(tpPeak) : -INFINITY;
+        out.truePeakMax = tpMax > 0.0f ? 20.0f * log10f(tpMax) : -INFINITY;
+        tpPeak = 0.0f;
+    }
+
+    float integrated() const {
+        double e = 0.0;
+        uint64_t n = 0;
+        for (int i = 0; i < LOUD_HIST_BINS; i++) { e += histEnergy[i]; n += histCount[i]; }
+        if (n == 0) return -INFINITY;
+        // Relative gate; the bin it falls in counts if its centre is above
+        const float gate = energyToLufs(e / n) + LOUD_REL_GATE;
+        e = 0.0;
+        n = 0;
+        for (int i = 0; i < LOUD_HIST_BINS; i++) {
+            if (LOUD_ABS_GATE + (i + 0.5f) * 0.1f <= gate) continue;
+            e += histEnergy[i];
+            n += histCount[i];
+        }
+        return n ? energyToLufs(e / n) : -INFINITY;
+    }
+};
+
+// {"loudness":{"channel":0,"m":-14.2,"s":-15.0,"i":-16.1,"tp":-1.3,"tpMax":-0.4}}
+// with null for values not measurable yet.  Returns the length, or -1.
+static inline int loudnessJson(char* buf, size_t cap, int channel, const LoudnessReading& r) {
+    char v[5][16];
+    const float vals[5] = { r.momentary, r.shortTerm, r.integrated, r.truePeak, r.truePeakMax };
+    for (int i = 0; i < 5; i++) {
+        if (std::isfinite(vals[i])) snprintf(v[i], sizeof(v[i]), "%.1f", vals[i]);
+        else strcpy(v[i], "null");
+    }
+    int n = snprintf(buf, cap, "{\"loudness\":{\"channel\":%d,\"m\":%s,\"s\":%s,\"i\":%s,\"tp\":%s,\"tpMax\":%s}}",
+                     channel, v[0], v[1], v[2], v[3], v[4]);
+    return n > 0 && (size_t)n < cap ? n : -1;
+}
+
+#endif // VIS_LOUDNESS_H
@@ -0,0 +1,120 @@
+// pcm_ingest.h — PCM streamed in by a WebSocket client as a source.
+// A client that has no capture device of its own (a browser in a
+// sandbox, a remote app) declares its format with PCM_START and then
+// sends interleaved little-endian samples as binary frames.  This turns
+// them into the FRAME_SAMPLES mono chunks at SAMPLE_RATE that a
+// processor takes: downmix by averaging the channels, then a linear
+// resampler (no anti-alias filter; content above 22 kHz in a 96/192 kHz
+// stream can fold back, which the bar layout never reaches in practice).
+// Frames may split a sample anywhere; the remainder waits for the next.
+// Header-only, C++17 standard library only.
+#ifndef VIS_PCM_INGEST_H
+#define VIS_PCM_INGEST_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#include "protocol.h"
+
+enum class PcmFormat { F32, S16 };
+
+struct PcmIngest {
+    PcmFormat format = PcmFormat::F32;
+    int    rate = SAMPLE_RATE;
+    int    channels = 1;
+    double step = 1.0;                  // input samples per output sample
+    double pos = 1.0;                   // next output, in input samples after `prev`
+    float  prev = 0.0f;                 // last mono input sample
+    uint8_t carry[PCM_MAX_CHANNELS * sizeof(float)];   // partial input frame
+    int    carryLen = 0;
+    float  chunk[FRAME_SAMPLES];        // output being filled
+    int    chunkLen = 0;
+
+    int frameBytes() const { return channels * (format == PcmFormat::F32 ? 4 : 2); }
+
+    // Parse "<f32|s16>,<rate>,<channels>" and reset.  False if malformed
+    // or out of range (state untouched).
+    bool start(std::string_view spec) {
+        PcmFormat f;
+        if (spec.substr(0, 4) == "f32,") f = PcmFormat::F32;
+        else if (spec.substr(0, 4) == "s16,") f = PcmFormat::S16;
+        else return false;
+        char buf[32];
+        std::string_view rest = spec.substr(4);
+        if (rest.size() >= sizeof(buf)) return false;
+        memcpy(buf, rest.data(), rest.size());
+        buf[rest.size()] = '\0';
+        char* end;
+        long r = strtol(buf, &end, 10);
+        if (end == buf || *end != ',') return false;
+        const char* c0 = end + 1;
+        long ch = strtol(c0, &end, 10);
+        if (end == c0 || *end) return false;
+        if (r < PCM_MIN_RATE || r > PCM_MAX_RATE || ch < 1 || ch > PCM_MAX_CHANNELS) return false;
+
+        format = f;
+        rate = (int)r;
+        channels = (int)ch;
+        step = (double)rate / SAMPLE_RATE;
+        pos = 1.0;
+        prev = 0.0f;
+        carryLen = 0;
+        chunkLen = 0;
+        return true;
+    }
+
+    // Feed raw bytes; emit(const float* chunk) runs once per completed
+    // FRAME_SAMPLES chunk.
+    template <class Emit>
+    void push(const uint8_t* data, size_t len, Emit&& emit) {
+        const int fb = frameBytes();
+        if (carryLen > 0) {
+            size_t take = std::min(len, (size_t)(fb - carryLen));
+            memcpy(carry + carryLen, data, take);
+            carryLen += (int)take;
+            data += take;
+            len -= take;
+            if (carryLen < fb) return;
+            addFrame(carry, emit);
+            carryLen = 0;
+        }
+        for (; len >= (size_t)fb; data += fb, len -= fb) addFrame(data, emit);
+        memcpy(carry, data, len);
+        carryLen = (int)len;
+    }
+
+private:
+    template <class Emit>
+    void addFrame(const uint8_t* frame, Emit& emit) {
+        float sum = 0.0f;
+        if (format == PcmFormat::F32) {
+            for (int c = 0; c < channels; c++) {
+                float v;
+                memcpy(&v, frame + c * 4, 4);
+                // Full scale is +-1; NaN / inf must not reach the FFT
+                if (std::isfinite(v)) sum += std::max(-1.0f, std::min(1.0f, v));
+            }
+        } else {
+            for (int c = 0; c < channels; c++)
+                sum += (int16_t)(frame[c * 2] | (frame[c * 2 + 1] << 8)) * (1.0f / 32768.0f);
+        }
+        const float x = sum / channels;
+        // Outputs falling between prev and x
+        while (pos <= 1.0) {
+            chunk[chunkLen++] = prev + (x - prev) * (float)pos;
+            if (chunkLen == FRAME_SAMPLES) {
+                emit((const float*)chunk);
+                chunkLen = 0;
+            }
+            pos += step;
+        }
+        pos -= 1.0;
+        prev = x;
+    }
+};
+
+#endif // VIS_PCM_INGEST_H
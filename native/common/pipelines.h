@@ -0,0 +1,203 @@
+// pipelines.h — Pre-instantiated processing variants for the visualizer.
+// Every variant is a complete processFrame implementation: either a
+// processFrameT<> instantiation of the float policies in fft.h, or the
+// fixed-point pipeline in fft_fixed.h.  One is chosen at startup
+// (--pipeline NAME); processFrame() is then a single indirect call.
+// Float variants also carry a grid of interchangeable kernels
+// (transform x binning x smoother) that the autotuner (autotune.h)
+// picks from per host, and batched forms of the table-twiddle ones
+// (fft_batch.h) for draining a backlog of hops.
+// Header-only, no external dependencies.
+#ifndef VIS_PIPELINES_H
+#define VIS_PIPELINES_H
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+
+#include "protocol.h"
+#include "fft.h"
+#include "fft_fixed.h"
+#include "fft_batch.h"
+
+typedef void (*ProcessFn)(VisProcessor& p, const float* newSamples, float* bars);
+typedef void (*ProcessS16Fn)(VisProcessor& p, const int16_t* newSamples, float* bars);
+
+// ---- Kernel grid ----
+// Every combination of the interchangeable stage kernels, for one gain
+// and debug policy.  Index = transform * 4 + binning * 2 + smoother;
+// kernel 0 is the baseline (radix2 + average + branchy), i.e. the
+// variant's own fn.
+constexpr int KERNEL_TRANSFORMS = 2;
+constexpr int KERNEL_BINNINGS   = 2;
+constexpr int KERNEL_SMOOTHERS  = 2;
+constexpr int KERNEL_COUNT      = KERNEL_TRANSFORMS * KERNEL_BINNINGS * KERNEL_SMOOTHERS;
+
+static const char* const g_transformNames[KERNEL_TRANSFORMS] = { Radix2Transform::kName, TableRadix2Transform::kName };
+static const char* const g_binningNames[KERNEL_BINNINGS]     = { AverageBinning::kName, PrefixSumBinning::kName };
+static const char* const g_smootherNames[KERNEL_SMOOTHERS]   = { EmaGravitySmoother::kName, BranchlessEmaGravitySmoother::kName };
+
+// Kernels reorder float arithmetic (table twiddles, double prefix
+// sums), so they are held to the baseline within these bounds rather
+// than bit-exactly; see vis-diff for the per-kernel numbers.
+constexpr float KERNEL_MAX_ERR = 0.02f;
+constexpr float KERNEL_RMS_ERR = 1e-3f;
+
+template <class Gain, class Debug>
+struct KernelGrid {
+    template <class T, class B, class S>
+    static constexpr ProcessFn fn = processFrameT<HannWindow, T, B, S, Gain, Float32Encoder, Debug>;
+
+    static constexpr ProcessFn fns[KERNEL_COUNT] = {
+        fn<Radix2Transform, AverageBinning, EmaGravitySmoother>,
+        fn<Radix2Transform, AverageBinning, BranchlessEmaGravitySmoother>,
+        fn<Radix2Transform, PrefixSumBinning, EmaGravitySmoother>,
+        fn<Radix2Transform, PrefixSumBinning, BranchlessEmaGravitySmoother>,
+        fn<TableRadix2Transform, AverageBinning, EmaGravitySmoother>,
+        fn<TableRadix2Transform, AverageBinning, BranchlessEmaGravitySmoother>,
+        fn<TableRadix2Transform, PrefixSumBinning, EmaGravitySmoother>,
+        fn<TableRadix2Transform, PrefixSumBinning, BranchlessEmaGravitySmoother>,
+    };
+
+    // The batched form of each kernel, or nullptr.  The batch transform
+    // is fftTable()'s, so only the table kernels have one; a radix2
+    // kernel drains a backlog hop by hop and its numerics never depend
+    // on how far behind the worker is.
+    template <class B, class S>
+    static constexpr ProcessBatchFn batchFn = processFramesT<B, S, Gain, Float32Encoder, Debug>;
+
+    static constexpr ProcessBatchFn batchFns[KERNEL_COUNT] = {
+        nullptr, nullptr, nullptr, nullptr,
+        batchFn<AverageBinning, EmaGravitySmoother>,
+        batchFn<AverageBinning, BranchlessEmaGravitySmoother>,
+        batchFn<PrefixSumBinning, EmaGravitySmoother>,
+        batchFn<PrefixSumBinning, BranchlessEmaGravitySmoother>,
+    };
+};
+
+// "table+prefix+branchless"
+static inline void kernelName(int k, char* out, size_t cap) {
+    snprintf(out, cap, "%s+%s+%s", g_transformNames[k / 4], g_binningNames[(k / 2) % 2], g_smootherNames[k % 2]);
+}
+
+// Inverse of kernelName(); "baseline" is kernel 0.  -1 if unknown.
+static inline int parseKernelName(const char* name) {
+    if (strcmp(name, "baseline") == 0) return 0;
+    char buf[64];
+    for (int k = 0; k < KERNEL_COUNT; k++) {
+        kernelName(k, buf, sizeof(buf));
+        if (strcmp(buf, name) == 0) return k;
+    }
+    return -1;
+}
+
+struct PipelineVariant {
+    const char*  name;
+    const char*  desc;
+    ProcessFn    fn;            // float32 input (always set)
+    ProcessS16Fn fnS16;         // native S16 input, or nullptr for float-only
+    float        refMaxErr;     // allowed per-bar max error vs fft_ref.h, 0 = not comparable
+    float        refRmsErr;     // allowed RMS error vs fft_ref.h
+    const ProcessFn* kernels;   // KERNEL_COUNT alternatives to fn, or nullptr
+    const ProcessFn* tuneKernels; // the same without debug output, for timing
+    const ProcessBatchFn* batchKernels; // batched form of each kernel (nullptr if none), or nullptr
+};
+
+static const PipelineVariant g_pipelines[] = {
+    { "default",    "auto-sensitivity, debug log every second",
+      processFrameT<HannWindow, Radix2Transform, AverageBinning, EmaGravitySmoother,
+                    AutoSensGain, Float32Encoder, FrameDebugLog>, nullptr, 1e-6f, 1e-7f,
+      KernelGrid<AutoSensGain, FrameDebugLog>::fns, KernelGrid<AutoSensGain, NoDebug>::fns,
+      KernelGrid<AutoSensGain, FrameDebugLog>::batchFns },
+    { "quiet",      "auto-sensitivity, no debug log",
+      processFrameT<HannWindow, Radix2Transform, AverageBinning, EmaGravitySmoother,
+                    AutoSensGain, Float32Encoder, NoDebug>, nullptr, 1e-6f, 1e-7f,
+      KernelGrid<AutoSensGain, NoDebug>::fns, KernelGrid<AutoSensGain, NoDebug>::fns,
+      KernelGrid<AutoSensGain, NoDebug>::batchFns },
+    { "fixed-gain", "unity gain (absolute levels), no debug log",
+      processFrameT<HannWindow, Radix2Transform, AverageBinning, EmaGravitySmoother,
+                    FixedGain, Float32Encoder, NoDebug>, nullptr, 0.0f, 0.0f,
+      KernelGrid<FixedGain, NoDebug>::fns, KernelGrid<FixedGain, NoDebug>::fns,
+      KernelGrid<FixedGain, NoDebug>::batchFns },
+    // Approximate kernels are judged mostly on RMS: a small difference in
+    // one bar can flip an auto-sensitivity overshoot decision, and the
+    // gains then differ by one 0.85x step until they re-converge.
+    { "fixed-q15",  "integer pipeline on S16 capture (low-power hosts)",
+      processFrameFixedF32, processFrameFixed, 0.15f, 0.03f, nullptr, nullptr, nullptr },
+};
+constexpr int PIPELINE_COUNT = (int)(sizeof(g_pipelines) / sizeof(g_pipelines[0]));
+
+static const PipelineVariant* g_pipeline = &g_pipelines[0];
+// Index into g_pipeline->kernels and batchKernels.  A kernel and its
+// batched form are looked up from one load, so a reader never pairs
+// one kernel's hops with another's batch.
+static std::atomic<int> g_kernel{0};
+
+static inline ProcessFn kernelFn(int k) {
+    return g_pipeline->kernels ? g_pipeline->kernels[k] : g_pipeline->fn;
+}
+
+static inline ProcessBatchFn kernelBatchFn(int k) {
+    return g_pipeline->batchKernels ? g_pipeline->batchKernels[k] : nullptr;
+}
+
+// Select a pipeline variant by name.  Returns false (and keeps the
+// current one) if the name is unknown.
+static inline bool selectPipeline(const char* name) {
+    for (int i = 0; i < PIPELINE_COUNT; i++) {
+        if (strcmp(g_pipelines[i].name, name) == 0) {
+            g_pipeline = &g_pipelines[i];
+            g_kernel = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Switch the selected float pipeline to kernel k.  Safe while frames
+// are being processed: kernels share processor state and tables.
+static inline bool selectKernel(int k) {
+    if (!g_pipeline->kernels || k < 0 || k >= KERNEL_COUNT) return false;
+    g_kernel = k;
+    return true;
+}
+
+static inline void listPipelines() {
+    for (int i = 0; i < PIPELINE_COUNT; i++)
+        fprintf(stderr, "  %-12s %s\n", g_pipelines[i].name, g_pipelines[i].desc);
+}
+
+// Process one frame of FRAME_SAMPLES fresh audio with the selected variant.
+// Output: bars[p.barCount] in [0, 1].
+static inline void processFrame(VisProcessor& p, const float* newSamples, float* bars) {
+    kernelFn(g_kernel.load(std::memory_order_relaxed))(p, newSamples, bars);
+}
+
+// True if the selected kernel has a batched form.
+static inline bool kernelBatches() {
+    return kernelBatchFn(g_kernel.load(std::memory_order_relaxed)) != nullptr;
+}
+
+// Process `count` consecutive hops (oldest first) into bars[0..count).
+// A run of two or more goes through the selected kernel's batched form
+// when it has one; otherwise, or with no scratch, through the same kernel
+// one hop at a time.
+static inline void processFrames(VisProcessor& p, FrameBatch* batch, const float* const* chunks, int count,
+                                 float (*bars)[MAX_BAR_COUNT]) {
+    const int k = g_kernel.load(std::memory_order_relaxed);
+    ProcessBatchFn batchFn = kernelBatchFn(k);
+    if (batchFn && batch && count > 1) {
+        batchFn(p, *batch, chunks, count, bars);
+        return;
+    }
+    ProcessFn fn = kernelFn(k);
+    for (int i = 0; i < count; i++) fn(p, chunks[i], bars[i]);
+}
+
+// S16 entry point, for capture paths that honour fnS16.
+static inline void processFrameS16(VisProcessor& p, const int16_t* newSamples, float* bars) {
+    g_pipeline->fnS16(p, newSamples, bars);
+}
+
+#endif // VIS_PIPELINES_H
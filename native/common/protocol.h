@@ -6,11 +6,102 @@
 constexpr int    WS_PORT       = 7700;
 constexpr int    BAR_COUNT     = 72;        // default bar count
 constexpr int    MAX_BAR_COUNT = 144;       // max allowed (arrays sized to this)
+// Analysis size, fixed at build time.  16K-64K sizes are not offered:
+// a cache-blocked four-step FFT over the worker pool measured slower
+// than fftTable at every size up to 64K.
 constexpr int    FFT_SIZE      = 4096;
 constexpr int    SAMPLE_RATE   = 44100;
 constexpr int    SEND_FPS      = 60;
 constexpr int    FRAME_SAMPLES = SAMPLE_RATE / SEND_FPS;  // 735
 constexpr float  FREQ_MIN      = 50.0f;
 constexpr float  FREQ_MAX      = 12000.0f;  // default upper cutoff
+constexpr int    MAX_SOURCES   = 4;         // concurrently analysed sources
+
+// Tagged binary frames, for streams beyond the primary bar set (which
+// stays a bare float32 array for compatibility).  Only sent to clients
+// that asked for such a stream.
+//   [u8 kind][u8 channel][u16 count, little-endian][count x float32]
+constexpr int    FRAME_TAG_BYTES   = 4;
+constexpr int    FRAME_KIND_BARS   = 1;     // bars of source `channel` (1..MAX_SOURCES-1)
+constexpr int    FRAME_KIND_HISTORY = 2;    // a HISTORY: reply, below
+constexpr int    FRAME_KIND_HARMONIC   = 3;  // SET_LAYERS, below; channel 0..MAX_SOURCES-1
+constexpr int    FRAME_KIND_PERCUSSIVE = 4;
+
+// Optional latency echo, client -> daemon text message:
+//   LATENCY:<seq>,<recvMs>,<paintMs>
+// seq is the 1-based count of binary frames the client has received on
+// this connection; both times are on the client's clock (performance.now()).
+// The daemon reports per-client histograms in reply to GET_METRICS.
+constexpr int    LATENCY_ECHO_EVERY = 15;   // client echoes every Nth binary frame
+
+// Optional display-rate streaming, client -> daemon text message:
+//   SET_REFRESH:<hz>
+// The client then gets bar frames at its display refresh rate,
+// interpolated between DSP hops, instead of hop frames at the SET_FPS
+// rate.  0 switches back.  Replies {"refreshChanged":<hz>}.
+constexpr int    MIN_REFRESH_HZ = 24;
+constexpr int    MAX_REFRESH_HZ = 360;
+
+// Optional PCM ingest, for clients with audio but no capture device:
+//   PCM_START:<f32|s16>,<rate>,<channels>
+// then binary frames of interleaved little-endian samples (split
+// anywhere, up to WS_MAX_RX_PAYLOAD bytes each).  The audio is analysed
+// like a captured source and its bars go back to that client only, as
+// FRAME_KIND_BARS frames for the channel in the reply
+// {"pcmStarted":<channel>}.  PCM_STOP or disconnecting ends it
+// ({"pcmStopped":<channel>}); failures reply {"pcmError":"..."}.
+constexpr int    PCM_MIN_RATE     = 8000;
+constexpr int    PCM_MAX_RATE     = 192000;
+constexpr int    PCM_MAX_CHANNELS = 8;
+
+// Optional loudness side channel (loudness.h), client -> daemon:
+//   SET_LOUDNESS:<0|1>
+// Replies {"loudnessChanged":<0|1>}.  While on, the client gets a text
+// message per source it receives bars for, every 100 ms:
+//   {"loudness":{"channel":<n>,"m":<LUFS>,"s":<LUFS>,"i":<LUFS>,"tp":<dBTP>,"tpMax":<dBTP>}}
+// EBU R128 momentary (400 ms), short-term (3 s) and gated integrated
+// loudness, true peak over the last 100 ms and since the source (re)started;
+// null until measurable.  Metering runs only while some client is on.
+
+// Optional harmonic / percussive layers (hpss.h), client -> daemon:
+//   SET_LAYERS:<0|1>
+// Replies {"layersChanged":<0|1>}.  While on, the client also gets each
+// source's bars split into a tonal and a drums layer, as tagged frames of
+// kind FRAME_KIND_HARMONIC and FRAME_KIND_PERCUSSIVE (same layout as
+// FRAME_KIND_BARS, channel 0 included), at the SET_FPS rate.  The
+// separation runs only while some client is on.
+
+// Bar history of the primary source (history.h), client -> daemon:
+//   HISTORY:<fromMs>,<toMs>,<columns>,<max|mean>
+// Times are wall clock ms since the Unix epoch.  The range is split into
+// `columns` equal time columns, answered from the coarsest stored level
+// (60, 6, 0.6 or 0.06 Hz) with at least one record per column, in one or
+// more binary frames, little-endian:
+//   [u8 kind = FRAME_KIND_HISTORY][u8 level][u16 columns in this frame]
+//   [u16 first column][u16 total columns][u16 bars][u8 0 = max, 1 = mean][u8 0]
+//   [i64 fromMs][i64 toMs]
+//   then per column: [u8 1 if any data][bars x u8, 0..255 = 0..1]
+// A new query replaces an unfinished one.  Nothing in range, or a bad
+// query, replies {"historyError":"..."}.
+constexpr int    HISTORY_HEADER_BYTES = 28;
+constexpr int    HISTORY_MAX_COLUMNS  = 4096;
+
+// Optional trigger rules (triggers.h), client -> daemon:
+//   TRIGGER:<id>,<channel>,<firstBar>,<lastBar>,<level|rise>,<on>,<off>,<minMs>
+//   TRIGGER_CLEAR:<id>          (-1 clears all of the client's rules)
+// A rule watches the loudest of bars firstBar..lastBar of source
+// `channel`, either its level or its rise since the previous hop, on
+// every hop.  When the value reaches `on` (and no "on" was sent in the
+// last minMs) the client gets
+//   {"trigger":{"id":<id>,"channel":<n>,"edge":"on","value":<v>}}
+// and the rule waits until the value falls to `off` (<= on), which sends
+// the same with "edge":"off".  TRIGGER with an id in use replaces that
+// rule.  Replies {"triggerAdded":<id>}, {"triggerRemoved":<id>} or
+// {"triggerError":"..."}.  While a client has rules it gets their events
+// instead of bar frames (hop-rate and SET_REFRESH alike); clearing them
+// all brings the frames back.
+constexpr int    TRIGGER_MAX_RULES       = 16;      // per client
+constexpr int    TRIGGER_MAX_ID          = 65535;
+constexpr int    TRIGGER_MAX_INTERVAL_MS = 600000;
 
 #endif // VIS_PROTOCOL_H
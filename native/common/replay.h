@@ -0,0 +1,115 @@
+// replay.h — Stand-in capture source for the visualizer daemon.
+// Delivers a looped mono float32 signal at SAMPLE_RATE in real time,
+// one FRAME_SAMPLES hop per HOP_NS, the way a blocking PulseAudio read
+// would.  The daemon can then run (and be measured, see tools/vis-power)
+// on hosts without a sound server.  Sources:
+//   synthetic:music    drums, bass and a chord, 10 s loop
+//   synthetic:silence  digital silence
+//   synthetic:stall    never delivers (a suspended stream)
+//   FILE.f32           raw mono float32 at SAMPLE_RATE
+// Header-only, C++17 standard library + OS timers.
+#ifndef VIS_REPLAY_H
+#define VIS_REPLAY_H
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "protocol.h"
+#include "interp.h"
+
+struct ReplaySource {
+    std::vector<float> pcm;
+    size_t  pos = 0;
+    bool    stall = false;
+    int64_t nextNs = 0;                 // when the next hop is due (0 = now)
+
+    // Load or generate `spec`.  On failure `err` says why.
+    bool open(const std::string& spec, std::string& err) {
+        pcm.clear();
+        pos = 0;
+        stall = false;
+        if (spec == "synthetic:stall") {
+            stall = true;
+            return true;
+        }
+        if (spec == "synthetic:silence") {
+            pcm.assign(SAMPLE_RATE, 0.0f);
+            return true;
+        }
+        if (spec == "synthetic:music") {
+            synthMusic();
+            return true;
+        }
+        if (spec.compare(0, 10, "synthetic:") == 0) {
+            err = "unknown synthetic source (music, silence, stall)";
+            return false;
+        }
+        FILE* f = fopen(spec.c_str(), "rb");
+        if (!f) {
+            err = strerror(errno);
+            return false;
+        }
+        float buf[4096];
+        size_t n;
+        while ((n = fread(buf, sizeof(float), 4096, f)) > 0) pcm.insert(pcm.end(), buf, buf + n);
+        fclose(f);
+        if (pcm.size() < (size_t)FRAME_SAMPLES) {
+            err = "shorter than one hop";
+            return false;
+        }
+        return true;
+    }
+
+    // After an idle spell: deliver the next hop straight away.
+    void resync() { nextNs = 0; }
+
+    // Block until the next hop is due, then copy it to out[FRAME_SAMPLES].
+    // A stalled source waits 100 ms and returns false.
+    bool read(float* out) {
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (stall) {
+            sleepUntilNs(now + 100000000, now);
+            return false;
+        }
+        // Fell more than a hop behind (or first read): restart the grid
+        if (nextNs == 0 || nextNs < now - HOP_NS) nextNs = now;
+        sleepUntilNs(nextNs, now);
+        nextNs += HOP_NS;
+        for (int i = 0; i < FRAME_SAMPLES; i++) {
+            out[i] = pcm[pos];
+            if (++pos == pcm.size()) pos = 0;
+        }
+        return true;
+    }
+
+private:
+    // 120 bpm: kick on every beat, hat on the off-beats, a 55 Hz bass and
+    // an A major chord with slow tremolo.  Deterministic.
+    void synthMusic() {
+        const int n = 10 * SAMPLE_RATE, beat = SAMPLE_RATE / 2;
+        const float sr = (float)SAMPLE_RATE, twoPi = 2.0f * (float)M_PI;
+        uint32_t rng = 12345;
+        pcm.resize(n);
+        for (int i = 0; i < n; i++) {
+            float t = i / sr;
+            float tb = (float)(i % beat) / sr;                  // time since the beat
+            float th = (float)((i + beat / 2) % beat) / sr;     // time since the off-beat
+            rng = rng * 1664525u + 1013904223u;
+            float noise = (float)(rng >> 8) / 8388608.0f - 1.0f;
+            float kick = 0.6f * expf(-tb * 18.0f) * sinf(twoPi * (50.0f + 90.0f * expf(-tb * 30.0f)) * tb);
+            float hat  = 0.15f * expf(-th * 60.0f) * noise;
+            float bass = 0.25f * sinf(twoPi * 55.0f * t);
+            float chord = 0.08f * (1.0f + 0.3f * sinf(twoPi * 0.5f * t)) *
+                          (sinf(twoPi * 440.0f * t) + sinf(twoPi * 554.4f * t) + sinf(twoPi * 659.3f * t));
+            pcm[i] = kick + hat + bass + chord;
+        }
+    }
+};
+
+#endif // VIS_REPLAY_H
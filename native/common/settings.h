@@ -0,0 +1,187 @@
+// settings.h — Settings file for the visualizer daemon.
+// Plain "key = value" lines; '#' starts a comment, lists are comma
+// separated, unknown keys and out-of-range values are errors (the whole
+// file is rejected and the previous settings stay).  Every key is
+// optional and defaults to the compile-time constant:
+//
+//   port             = 7700               # applies on restart
+//   bar_count        = 72                 # startup layout
+//   freq_max         = 12000
+//   fps              = 30                 # startup send rate
+//   bar_counts       = 8,16,24,36,72,100,144   # what SET_BAR_COUNT accepts
+//   freq_maxes       = 10000,12000,14000,16000,18000
+//   fps_rates        = 24,30,60
+//   smooth_attack    = 0.4                # fft.h tuning constants
+//   smooth_decay     = 0.85
+//   gravity          = 0.008
+//   silence_threshold = 0.0001
+//   sens_init, sens_attack, sens_release, sens_init_boost,
+//   sens_init_cap, sens_target, sens_min, sens_max, eq_power
+//
+// Reloading (SIGHUP on Linux, RELOAD_CONFIG from a client) swaps the new
+// tuning into the processors through a config snapshot (fft.h): sockets,
+// capture streams and smoothing / gain state are kept.
+// Header-only, C++17 standard library only.
+#ifndef VIS_SETTINGS_H
+#define VIS_SETTINGS_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "protocol.h"
+#include "fft.h"
+
+struct VisSettings {
+    int   port     = WS_PORT;
+    int   barCount = BAR_COUNT;
+    float freqMax  = FREQ_MAX;
+    int   fps      = 30;
+    std::vector<int> barCounts { 8, 16, 24, 36, 72, 100, 144 };
+    std::vector<int> freqMaxes { 10000, 12000, 14000, 16000, 18000 };
+    std::vector<int> fpsRates  { 24, 30, 60 };
+    VisTuning tune;
+};
+
+static inline bool settingsAllow(const std::vector<int>& list, int v) {
+    return std::find(list.begin(), list.end(), v) != list.end();
+}
+
+// Default location: $XDG_CONFIG_HOME/clear-vis/vis.conf (or
+// ~/.config/...), %APPDATA%\clear-vis\vis.conf on Windows.
+static std::string defaultSettingsPath() {
+#ifdef _WIN32
+    if (const char* a = getenv("APPDATA"); a && *a) return std::string(a) + "\\clear-vis\\vis.conf";
+#else
+    if (const char* x = getenv("XDG_CONFIG_HOME"); x && *x) return std::string(x) + "/clear-vis/vis.conf";
+    if (const char* h = getenv("HOME"); h && *h) return std::string(h) + "/.config/clear-vis/vis.conf";
+#endif
+    return "";
+}
+
+// Tuning keys, with the range each value must fall in.
+struct TuningKey { const char* name; float VisTuning::* field; float lo, hi; };
+static const TuningKey g_tuningKeys[] = {
+    { "smooth_attack",     &VisTuning::smoothAttack,     0.0f,  0.999f },
+    { "smooth_decay",      &VisTuning::smoothDecay,      0.0f,  0.999f },
+    { "gravity",           &VisTuning::gravity,          0.0f,  1.0f   },
+    { "silence_threshold", &VisTuning::silenceThreshold, 0.0f,  0.1f   },
+    { "sens_init",         &VisTuning::sensInit,         0.01f, 100.0f },
+    { "sens_attack",       &VisTuning::sensAttack,       0.01f, 1.0f   },
+    { "sens_release",      &VisTuning::sensRelease,      1.0f,  2.0f   },
+    { "sens_init_boost",   &VisTuning::sensInitBoost,    1.0f,  2.0f   },
+    { "sens_init_cap",     &VisTuning::sensInitCap,      0.01f, 100.0f },
+    { "sens_target",       &VisTuning::sensTarget,       0.05f, 1.0f   },
+    { "sens_min",          &VisTuning::sensMin,          0.001f, 100.0f },
+    { "sens_max",          &VisTuning::sensMax,          0.001f, 100.0f },
+    { "eq_power",          &VisTuning::eqPower,          0.0f,  2.0f   },
+};
+
+// Comma-separated ints, each in [lo, hi].
+static bool parseIntList(const char* s, int lo, int hi, std::vector<int>& out) {
+    out.clear();
+    for (;;) {
+        char* end;
+        long v = strtol(s, &end, 10);
+        if (end == s || v < lo || v > hi) return false;
+        out.push_back((int)v);
+        while (*end == ' ' || *end == '\t') end++;
+        if (*end == '\0') return true;
+        if (*end != ',') return false;
+        s = end + 1;
+    }
+}
+
+// Parse `path` into `out`.  On failure `out` is untouched and `err`
+// says why (first bad line; the path is left to the caller).
+static bool loadSettings(const std::string& path, VisSettings& out, std::string& err) {
+    FILE* f = path.empty() ? nullptr : fopen(path.c_str(), "r");
+    if (!f) {
+        err = path.empty() ? "no settings path" : strerror(errno);
+        return false;
+    }
+    VisSettings s;
+    char line[512];
+    int lineNo = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        lineNo++;
+        if (char* hash = strchr(line, '#')) *hash = '\0';
+        char* eq = strchr(line, '=');
+        char* key = line;
+        while (*key == ' ' || *key == '\t') key++;
+        if (!eq) {
+            // Blank (or comment-only) lines are fine
+            if (strspn(key, " \t\r\n") == strlen(key)) continue;
+            ok = false;
+            break;
+        }
+        char* kend = eq;
+        while (kend > key && (kend[-1] == ' ' || kend[-1] == '\t')) kend--;
+        *kend = '\0';
+        char* val = eq + 1;
+        while (*val == ' ' || *val == '\t') val++;
+        size_t vlen = strlen(val);
+        while (vlen && strchr(" \t\r\n", val[vlen - 1])) val[--vlen] = '\0';
+
+        char* end = nullptr;
+        if (strcmp(key, "port") == 0) {
+            long v = strtol(val, &end, 10);
+            ok = *val && !*end && v > 0 && v < 65536;
+            s.port = (int)v;
+        } else if (strcmp(key, "bar_count") == 0) {
+            long v = strtol(val, &end, 10);
+            ok = *val && !*end && v >= 1 && v <= MAX_BAR_COUNT;
+            s.barCount = (int)v;
+        } else if (strcmp(key, "freq_max") == 0) {
+            float v = strtof(val, &end);
+            ok = *val && !*end && v > FREQ_MIN * 2 && v <= SAMPLE_RATE / 2;
+            s.freqMax = v;
+        } else if (strcmp(key, "fps") == 0) {
+            long v = strtol(val, &end, 10);
+            ok = *val && !*end && v >= 1 && v <= SEND_FPS;
+            s.fps = (int)v;
+        } else if (strcmp(key, "bar_counts") == 0) {
+            ok = parseIntList(val, 1, MAX_BAR_COUNT, s.barCounts);
+        } else if (strcmp(key, "freq_maxes") == 0) {
+            ok = parseIntList(val, (int)FREQ_MIN * 2 + 1, SAMPLE_RATE / 2, s.freqMaxes);
+        } else if (strcmp(key, "fps_rates") == 0) {
+            ok = parseIntList(val, 1, SEND_FPS, s.fpsRates);
+        } else {
+            const TuningKey* k = nullptr;
+            for (const TuningKey& t : g_tuningKeys)
+                if (strcmp(key, t.name) == 0) k = &t;
+            if (!k) {
+                err = "line " + std::to_string(lineNo) + ": unknown key '" + key + "'";
+                fclose(f);
+                return false;
+            }
+            float v = strtof(val, &end);
+            ok = *val && !*end && v >= k->lo && v <= k->hi;
+            s.tune.*(k->field) = v;
+        }
+    }
+    fclose(f);
+    if (!ok) {
+        err = "line " + std::to_string(lineNo) + ": bad value";
+        return false;
+    }
+    if (s.tune.sensMin > s.tune.sensMax) {
+        err = "sens_min is above sens_max";
+        return false;
+    }
+    out = s;
+    return true;
+}
+
+static inline bool settingsFileExists(const std::string& path) {
+    FILE* f = path.empty() ? nullptr : fopen(path.c_str(), "r");
+    if (f) fclose(f);
+    return f != nullptr;
+}
+
+#endif // VIS_SETTINGS_H
@@ -0,0 +1,170 @@
+// snapshot.h — Lock-free publication of immutable snapshots.
+// A writer builds a complete new object off the hot path and publishes
+// it with one atomic pointer swap; readers pin the current one for the
+// length of a read (one frame) without taking a lock or waiting on the
+// writer.  Replaced snapshots are reclaimed by epochs: each is retired
+// with the epoch its swap started, and freed once every reader thread
+// is either outside a read or pinned at that epoch or later.
+// Header-only, C++17 standard library only.
+#ifndef VIS_SNAPSHOT_H
+#define VIS_SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+// ---- Epoch domain (shared by every SnapshotCell) ----
+// One slot per reader thread, claimed on the thread's first read and
+// released when it exits.  Readers are the DSP threads plus whichever
+// thread runs commands, so this is far more than ever needed.
+constexpr int      EPOCH_READERS = 64;
+constexpr uint64_t EPOCH_IDLE    = UINT64_MAX;   // slot not inside a read
+
+struct EpochDomain {
+    std::atomic<uint64_t> epoch{1};
+    std::atomic<uint64_t> pinned[EPOCH_READERS];
+    std::atomic<bool>     claimed[EPOCH_READERS];
+
+    EpochDomain() {
+        for (int i = 0; i < EPOCH_READERS; i++) {
+            pinned[i].store(EPOCH_IDLE, std::memory_order_relaxed);
+            claimed[i].store(false, std::memory_order_relaxed);
+        }
+    }
+
+    // Oldest epoch any reader is pinned at (EPOCH_IDLE if none).
+    uint64_t oldestPinned() const {
+        uint64_t oldest = EPOCH_IDLE;
+        for (int i = 0; i < EPOCH_READERS; i++) {
+            uint64_t e = pinned[i].load(std::memory_order_seq_cst);
+            if (e < oldest) oldest = e;
+        }
+        return oldest;
+    }
+};
+
+static EpochDomain g_epochs;
+
+// This thread's reader slot.  Reads may nest; only the outermost pins.
+struct EpochReader {
+    int slot = -1;
+    int depth = 0;
+
+    ~EpochReader() {
+        if (slot >= 0) {
+            g_epochs.pinned[slot].store(EPOCH_IDLE, std::memory_order_release);
+            g_epochs.claimed[slot].store(false, std::memory_order_release);
+        }
+    }
+
+    void enter() {
+        if (depth++ > 0) return;
+        if (slot < 0) claim();
+        // Pin before loading any snapshot pointer: a swap that this load
+        // misses is then retired with an epoch newer than the pin, and
+        // is kept until the read ends.
+        g_epochs.pinned[slot].store(g_epochs.epoch.load(std::memory_order_seq_cst),
+                                    std::memory_order_seq_cst);
+    }
+
+    void leave() {
+        if (--depth > 0) return;
+        g_epochs.pinned[slot].store(EPOCH_IDLE, std::memory_order_release);
+    }
+
+private:
+    void claim() {
+        for (int i = 0; i < EPOCH_READERS; i++) {
+            if (!g_epochs.claimed[i].exchange(true, std::memory_order_acq_rel)) {
+                slot = i;
+                return;
+            }
+        }
+        fprintf(stderr, "[vis] FATAL: more than %d snapshot reader threads\n", EPOCH_READERS);
+        abort();
+    }
+};
+
+static inline EpochReader& epochReader() {
+    static thread_local EpochReader r;
+    return r;
+}
+
+// ---- SnapshotCell ----
+// Owns the current snapshot and the retired ones still waiting for
+// readers.  Writers serialise on a mutex that readers never touch.
+template <class T>
+class SnapshotCell {
+public:
+    explicit SnapshotCell(const T* initial) : cur(initial) {}
+    ~SnapshotCell() {
+        delete cur.load();
+        for (const Retired& r : retired) delete r.snap;
+    }
+    SnapshotCell(const SnapshotCell&) = delete;
+    SnapshotCell& operator=(const SnapshotCell&) = delete;
+
+    // Pins the current snapshot for the guard's lifetime.  Never blocks.
+    class Reader {
+    public:
+        explicit Reader(const SnapshotCell& cell) {
+            epochReader().enter();
+            snap = cell.cur.load(std::memory_order_seq_cst);
+        }
+        ~Reader() { epochReader().leave(); }
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        const T* get() const { return snap; }
+        const T* operator->() const { return snap; }
+        const T& operator*() const { return *snap; }
+
+    private:
+        const T* snap;
+    };
+
+    // Take ownership of `next` and make it current.  The replaced
+    // snapshot is freed now if no reader can still hold it, otherwise by
+    // a later publish() or reclaim().
+    void publish(const T* next) {
+        std::lock_guard<std::mutex> lock(writeMtx);
+        const T* old = cur.exchange(next, std::memory_order_seq_cst);
+        uint64_t e = g_epochs.epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+        retired.push_back({old, e});
+        pending.store((int)retired.size(), std::memory_order_relaxed);
+        reclaimLocked();
+    }
+
+    // Free retired snapshots no reader can see any more.  Cheap when
+    // there are none; returns how many are still waiting.
+    int reclaim() {
+        if (pending.load(std::memory_order_relaxed) == 0) return 0;
+        std::lock_guard<std::mutex> lock(writeMtx);
+        return reclaimLocked();
+    }
+
+private:
+    struct Retired { const T* snap; uint64_t epoch; };
+
+    int reclaimLocked() {
+        uint64_t oldest = g_epochs.oldestPinned();
+        size_t keep = 0;
+        for (size_t i = 0; i < retired.size(); i++) {
+            if (retired[i].epoch <= oldest) delete retired[i].snap;
+            else retired[keep++] = retired[i];
+        }
+        retired.resize(keep);
+        pending.store((int)keep, std::memory_order_relaxed);
+        return (int)keep;
+    }
+
+    std::atomic<const T*> cur;
+    std::mutex writeMtx;
+    std::vector<Retired> retired;
+    std::atomic<int> pending{0};
+};
+
+#endif // VIS_SNAPSHOT_H
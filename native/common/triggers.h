@@ -0,0 +1,218 @@
+// triggers.h — Server-side trigger rules: events instead of bar frames.
+// A client that only needs to know when a band crosses a level (a light
+// bridge, a dimmer, a status widget) registers rules with TRIGGER: and
+// gets a small text event when one fires, instead of every bar frame.
+// A rule watches the loudest bar in a band of one source, either its
+// level or its rise since the previous hop (a cheap onset / beat cue),
+// and fires
+//   - "on" when the value reaches `on` while armed, at most once per
+//     `minMs`; the rule then disarms,
+//   - "off" when the value falls back to `off` or below, re-arming it.
+// Rules are evaluated on every hop's smoothed bars by the thread that
+// made them, so a crossing shorter than the send interval still fires:
+// a max over the band plus a few comparisons per rule.  The rule list is
+// an immutable snapshot (snapshot.h) the command thread republishes on
+// every change; each evaluator keeps its own per-rule state, matched to
+// rules by a uid that is never reused.
+// Header-only, C++17 standard library only.
+#ifndef VIS_TRIGGERS_H
+#define VIS_TRIGGERS_H
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+#include "protocol.h"
+#include "snapshot.h"
+
+constexpr int TRIGGER_MAX_ACTIVE  = 64;     // rules across every client
+constexpr int TRIGGER_EVENT_QUEUE = 32;     // events per source between network passes
+
+struct TriggerRule {
+    uint32_t uid;               // daemon-wide, never reused: keys evaluator state
+    int      client;            // connection slot it belongs to
+    int      id;                // the client's own id
+    int      channel;           // source
+    int      firstBar, lastBar;
+    bool     rise;              // value is the hop-to-hop rise, else the level
+    float    on, off;           // fire at >= on, re-arm at <= off
+    int64_t  minNs;             // minimum time between "on" events
+};
+
+struct TriggerEvent {
+    uint32_t uid;
+    int      client, id, channel;
+    bool     on;                // "on" or "off" edge
+    float    value;
+};
+
+// The current rules.  Built and republished by the command thread only.
+struct TriggerSet {
+    uint64_t gen = 0;           // bumped by every change
+    uint32_t nextUid = 1;
+    int      count = 0;
+    TriggerRule rules[TRIGGER_MAX_ACTIVE];
+
+    // Connection slots with at least one rule.
+    uint32_t clients() const {
+        uint32_t set = 0;
+        for (int i = 0; i < count; i++) set |= 1u << rules[i].client;
+        return set;
+    }
+
+    const TriggerRule* find(uint32_t uid) const {
+        for (int i = 0; i < count; i++)
+            if (rules[i].uid == uid) return &rules[i];
+        return nullptr;
+    }
+
+    // Add r, or replace the client's rule with the same id (its state
+    // starts over).  Returns false if the client or the daemon is full.
+    bool put(TriggerRule r) {
+        int own = 0, at = -1;
+        for (int i = 0; i < count; i++) {
+            if (rules[i].client != r.client) continue;
+            own++;
+            if (rules[i].id == r.id) at = i;
+        }
+        if (at < 0 && (own >= TRIGGER_MAX_RULES || count >= TRIGGER_MAX_ACTIVE)) return false;
+        r.uid = nextUid++;
+        rules[at < 0 ? count++ : at] = r;
+        gen++;
+        return true;
+    }
+
+    // Remove the client's rule `id`, or all of its rules for id < 0.
+    // Returns how many went.
+    int remove(int client, int id) {
+        int keep = 0;
+        for (int i = 0; i < count; i++) {
+            if (rules[i].client == client && (id < 0 || rules[i].id == id)) continue;
+            rules[keep++] = rules[i];
+        }
+        int removed = count - keep;
+        count = keep;
+        if (removed) gen++;
+        return removed;
+    }
+};
+
+static SnapshotCell<TriggerSet> g_triggerSet{new TriggerSet};
+
+typedef SnapshotCell<TriggerSet>::Reader TriggerReader;
+
+// Per-source rule state, owned by whichever thread processes the source.
+struct TriggerEvaluator {
+    struct State {
+        uint32_t uid;
+        bool     armed;
+        float    prev;          // band level on the previous hop
+        int64_t  lastOnNs;
+    };
+    State    state[TRIGGER_MAX_ACTIVE];
+    int      count = 0;
+    uint64_t gen = ~0ull;       // rule set the states line up with
+
+    // Evaluate the rules for `channel` on one hop's bars (captured at
+    // `ns`).  Writes up to `cap` events to `out`; returns how many.
+    int run(const TriggerSet& set, int channel, const float* bars, int barCount, int64_t ns,
+            TriggerEvent* out, int cap) {
+        if (gen != set.gen) follow(set);
+        int n = 0;
+        for (int i = 0; i < set.count; i++) {
+            const TriggerRule& r = set.rules[i];
+            if (r.channel != channel || r.firstBar >= barCount) continue;
+            State& s = state[i];
+            const int last = r.lastBar < barCount ? r.lastBar : barCount - 1;
+            float level = bars[r.firstBar];
+            for (int b = r.firstBar + 1; b <= last; b++) level = bars[b] > level ? bars[b] : level;
+            const float v = r.rise ? level - s.prev : level;
+            s.prev = level;
+
+            bool edge = false;
+            if (s.armed && v >= r.on && ns - s.lastOnNs >= r.minNs) {
+                s.armed = false;
+                s.lastOnNs = ns;
+                edge = true;
+            } else if (!s.armed && v <= r.off) {
+                s.armed = true;
+                edge = true;
+            }
+            if (edge && n < cap) out[n++] = { r.uid, r.client, r.id, channel, !s.armed, v };
+        }
+        return n;
+    }
+
+private:
+    // Carry state over to a new rule list: kept rules keep theirs, new
+    // (or replaced) ones start armed.
+    void follow(const TriggerSet& set) {
+        State old[TRIGGER_MAX_ACTIVE];
+        memcpy(old, state, count * sizeof(State));
+        for (int i = 0; i < set.count; i++) {
+            State s{ set.rules[i].uid, true, 0.0f, INT64_MIN / 2 };
+            for (int j = 0; j < count; j++) {
+                if (old[j].uid == s.uid) { s = old[j]; break; }
+            }
+            state[i] = s;
+        }
+        count = set.count;
+        gen = set.gen;
+    }
+};
+
+// "TRIGGER:<id>,<channel>,<firstBar>,<lastBar>,<level|rise>,<on>,<off>,<minMs>"
+// Fills everything but uid and client.
+static inline bool parseTrigger(std::string_view arg, TriggerRule* r) {
+    char buf[128];
+    if (arg.empty() || arg.size() >= sizeof(buf)) return false;
+    memcpy(buf, arg.data(), arg.size());
+    buf[arg.size()] = '\0';
+    char* end;
+    long id = strtol(buf, &end, 10);
+    if (*end != ',') return false;
+    long ch = strtol(end + 1, &end, 10);
+    if (*end != ',') return false;
+    long first = strtol(end + 1, &end, 10);
+    if (*end != ',') return false;
+    long last = strtol(end + 1, &end, 10);
+    if (*end != ',') return false;
+    char* kind = end + 1;
+    char* comma = strchr(kind, ',');
+    if (!comma) return false;
+    *comma = '\0';
+    if (strcmp(kind, "level") == 0) r->rise = false;
+    else if (strcmp(kind, "rise") == 0) r->rise = true;
+    else return false;
+    float on = strtof(comma + 1, &end);
+    if (*end != ',') return false;
+    float off = strtof(end + 1, &end);
+    if (*end != ',') return false;
+    long minMs = strtol(end + 1, &end, 10);
+    if (*end != '\0') return false;
+    if (id < 0 || id > TRIGGER_MAX_ID || ch < 0 || ch >= MAX_SOURCES) return false;
+    if (first < 0 || last < first || last >= MAX_BAR_COUNT) return false;
+    if (!std::isfinite(on) || !std::isfinite(off) || off > on) return false;
+    if (minMs < 0 || minMs > TRIGGER_MAX_INTERVAL_MS) return false;
+    r->id = (int)id;
+    r->channel = (int)ch;
+    r->firstBar = (int)first;
+    r->lastBar = (int)last;
+    r->on = on;
+    r->off = off;
+    r->minNs = (int64_t)minMs * 1000000;
+    return true;
+}
+
+// {"trigger":{"id":3,"channel":0,"edge":"on","value":0.812}}
+// Returns the length, or -1.
+static inline int triggerJson(char* buf, size_t cap, const TriggerEvent& e) {
+    int n = snprintf(buf, cap, "{\"trigger\":{\"id\":%d,\"channel\":%d,\"edge\":\"%s\",\"value\":%.3f}}",
+                     e.id, e.channel, e.on ? "on" : "off", e.value);
+    return n > 0 && (size_t)n < cap ? n : -1;
+}
+
+#endif // VIS_TRIGGERS_H
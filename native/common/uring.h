@@ -0,0 +1,157 @@
+// uring.h — Minimal io_uring ring for the visualizer's network path (Linux).
+// Raw syscalls + the kernel UAPI header, no liburing.  Just enough to
+// queue SQEs, submit them with one io_uring_enter(), and reap CQEs from
+// the shared ring without a syscall.  Header-only.
+#ifndef VIS_URING_H
+#define VIS_URING_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+class URing {
+public:
+    URing() = default;
+    ~URing() { close(); }
+    URing(const URing&) = delete;
+    URing& operator=(const URing&) = delete;
+
+    // Create the ring and check the kernel supports every op in `ops`.
+    // Returns 0 or a negative errno; on failure the ring is left closed
+    // and the caller should use its fallback path.
+    int open(unsigned entries, const uint8_t* ops, int opCount) {
+        io_uring_params p{};
+        int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (fd < 0) return -errno;
+        ringFd = fd;
+
+        sqRingBytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqRingBytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+
+        sqRing = mmap(nullptr, sqRingBytes, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) { sqRing = nullptr; return fail(); }
+        if (single) {
+            cqRing = sqRing;
+        } else {
+            cqRing = mmap(nullptr, cqRingBytes, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) { cqRing = nullptr; return fail(); }
+        }
+        sqeBytes = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = (io_uring_sqe*)mmap(nullptr, sqeBytes, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) { sqes = nullptr; return fail(); }
+
+        uint8_t* sq = (uint8_t*)sqRing;
+        sqHead  = (unsigned*)(sq + p.sq_off.head);
+        sqTail  = (unsigned*)(sq + p.sq_off.tail);
+        sqMask  = *(unsigned*)(sq + p.sq_off.ring_mask);
+        sqArray = (unsigned*)(sq + p.sq_off.array);
+        sqSize  = p.sq_entries;
+        uint8_t* cq = (uint8_t*)cqRing;
+        cqHead  = (unsigned*)(cq + p.cq_off.head);
+        cqTail  = (unsigned*)(cq + p.cq_off.tail);
+        cqMask  = *(unsigned*)(cq + p.cq_off.ring_mask);
+        cqes    = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        localTail = *sqTail;
+
+        // The probe itself needs 5.6, which is also where SEND/RECV landed.
+        uint8_t probeBuf[sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op)] = {};
+        io_uring_probe* probe = (io_uring_probe*)probeBuf;
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+            return fail();
+        for (int i = 0; i < opCount; i++) {
+            if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+                errno = EOPNOTSUPP;
+                return fail();
+            }
+        }
+        return 0;
+    }
+
+    void close() {
+        if (sqes) munmap(sqes, sqeBytes);
+        if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingBytes);
+        if (sqRing) munmap(sqRing, sqRingBytes);
+        if (ringFd >= 0) ::close(ringFd);
+        sqes = nullptr; sqRing = cqRing = nullptr; ringFd = -1;
+    }
+
+    bool isOpen() const { return ringFd >= 0; }
+    // Pollable: readable while completions are waiting.
+    int fd() const { return ringFd; }
+
+    // Pin one buffer for IORING_OP_WRITE_FIXED (buf_index 0).
+    int registerBuffer(void* base, size_t len) {
+        iovec iov{base, len};
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+            return -errno;
+        return 0;
+    }
+
+    // Next free SQE, zeroed, or nullptr if the SQ is full.
+    io_uring_sqe* sqe() {
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (localTail - head >= sqSize) return nullptr;
+        unsigned idx = localTail & sqMask;
+        io_uring_sqe* e = &sqes[idx];
+        memset(e, 0, sizeof(*e));
+        sqArray[idx] = idx;
+        localTail++;
+        return e;
+    }
+
+    // Publish queued SQEs and submit them in one syscall.  Returns the
+    // number submitted or a negative errno.
+    int submit() {
+        unsigned pending = localTail - *sqTail;
+        if (pending == 0) return 0;
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+        enters++;
+        int r = (int)syscall(__NR_io_uring_enter, ringFd, pending, 0, 0, nullptr, 0);
+        return r < 0 ? -errno : r;
+    }
+
+    // Visit every available completion; no syscall.
+    template<class F> int reap(F&& fn) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        int n = 0;
+        for (; head != tail; head++, n++)
+            fn(cqes[head & cqMask]);
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        return n;
+    }
+
+    uint64_t enters = 0;    // io_uring_enter() calls so far
+
+private:
+    int fail() {
+        int e = errno;
+        close();
+        return -e;
+    }
+
+    int ringFd = -1;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqRingBytes = 0, cqRingBytes = 0, sqeBytes = 0;
+    unsigned *sqHead = nullptr, *sqTail = nullptr, *sqArray = nullptr;
+    unsigned *cqHead = nullptr, *cqTail = nullptr;
+    unsigned sqMask = 0, cqMask = 0, sqSize = 0;
+    unsigned localTail = 0;
+    io_uring_cqe* cqes = nullptr;
+};
+
+#endif // VIS_URING_H
@@ -0,0 +1,83 @@
+// worker_pool.h — Small fixed-size thread pool for the visualizer.
+// Jobs are plain function pointer + argument pairs kept in a fixed ring,
+// so submitting work never allocates.  Used to run per-source processors
+// in parallel.  Header-only, C++17 standard library only.
+#ifndef VIS_WORKER_POOL_H
+#define VIS_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+class WorkerPool {
+public:
+    typedef void (*JobFn)(void* arg);
+
+    // threads <= 0 picks one per core, capped at MAX_THREADS.
+    explicit WorkerPool(int threads = 0) {
+        if (threads <= 0)
+            threads = std::max(1, std::min((int)std::thread::hardware_concurrency(), MAX_THREADS));
+        for (int i = 0; i < threads; i++)
+            workers.emplace_back([this] { run(); });
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Queue a job.  Returns false if the queue is full.
+    bool submit(JobFn fn, void* arg) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (count == QUEUE_SIZE) return false;
+            queue[(head + count) % QUEUE_SIZE] = {fn, arg};
+            count++;
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    int size() const { return (int)workers.size(); }
+
+    static constexpr int MAX_THREADS = 8;
+
+private:
+    struct Job { JobFn fn; void* arg; };
+    static constexpr int QUEUE_SIZE = 64;
+
+    void run() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping || count > 0; });
+                if (stopping && count == 0) return;
+                job = queue[head];
+                head = (head + 1) % QUEUE_SIZE;
+                count--;
+            }
+            job.fn(job.arg);
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cv;
+    Job  queue[QUEUE_SIZE];
+    int  head = 0;
+    int  count = 0;
+    bool stopping = false;
+};
+
+#endif // VIS_WORKER_POOL_H
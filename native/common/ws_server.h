@@ -1,7 +1,8 @@
-// ws_server.h — Minimal single-client WebSocket server for the visualizer.
+// ws_server.h — Minimal multi-client WebSocket server for the visualizer.
 // Handles the HTTP upgrade handshake, sends binary/text frames,
-// and reads incoming text commands from the client.  Header-only.
-// No external dependencies beyond POSIX sockets + <cstdint>.
+// and reads incoming text commands from clients.  Header-only.
+// No external dependencies beyond POSIX sockets + <cstdint>
+// (and the kernel's io_uring/epoll interfaces on Linux).
 #ifndef VIS_WS_SERVER_H
 #define VIS_WS_SERVER_H
 
@@ -10,7 +11,9 @@
 #include <cstring>
 #include <cstdlib>
 #include <string>
+#include <string_view>
 #include <functional>
+#include <chrono>
 
 // ---- Platform socket abstraction ----
 #ifdef _WIN32
@@ -30,6 +33,12 @@
   #include <arpa/inet.h>
   #include <fcntl.h>
   #include <errno.h>
+  #include <sys/uio.h>
+  #include <poll.h>
+  #ifdef __linux__
+    #include <sys/epoll.h>
+    #include "uring.h"
+  #endif
   typedef int sock_t;
   #define SOCK_INVALID (-1)
   static void sock_close(sock_t s) { close(s); }
@@ -100,15 +109,51 @@ static std::string base64Encode(const uint8_t* data, size_t len) {
     return out;
 }
 
+// Largest incoming payload we accept, and largest outgoing payload a
+// queued frame can carry.  Everything below is a fixed buffer so the
+// streaming path never touches the heap.
+constexpr size_t WS_MAX_RX_PAYLOAD = 16384;  // PCM ingest: ~2 hops of 48 kHz stereo float
+constexpr size_t WS_MAX_TX_PAYLOAD = 8192;
+constexpr int    WS_MAX_CLIENTS    = 8;
+constexpr int    WS_FRAME_SLOTS    = 40;   // encoded frames, shared by every client they go to
+constexpr int    WS_REPLY_SLOTS    = 8;    // of those, kept for text and control frames
+constexpr int    WS_CLIENT_QUEUE   = 16;   // frames queued per client
+constexpr int    WS_CLIENT_BACKLOG = 4;    // bar frames are skipped for a client this far behind
+constexpr size_t WS_RX_BUF         = 2 * (14 + WS_MAX_RX_PAYLOAD);
+constexpr int    WS_SENT_RING      = 128;  // binary frames remembered per client for latency echoes
+constexpr size_t WS_MAX_UPGRADE    = 4096; // HTTP upgrade request, headers included
+constexpr int64_t WS_UPGRADE_TIMEOUT_NS = 2000000000;  // accepted but not upgraded: dropped after this
+static_assert(WS_MAX_CLIENTS <= 32, "client sets are 32-bit masks");
+
+// How socket I/O is driven.  io_uring batches every client's writes and
+// reads into one submission per poll(); epoll is the fallback on kernels
+// without it (or where it is blocked); plain non-blocking sockets on Windows.
+enum class WsBackend { Plain, Epoll, URing };
+
 // ---- WebSocket server ----
+// Multi-client.  Outgoing frames are encoded once into a shared slot and
+// queued by reference on every client they go to; poll() then moves
+// queued frames and incoming control frames for all clients at once.
 class WsServer {
 public:
-    WsServer() : listenSock(SOCK_INVALID), clientSock(SOCK_INVALID) {}
+    WsServer() = default;
     ~WsServer() { stop(); }
 
-    // Optional callback for text messages from the client.
-    // Set before calling poll().
-    std::function<void(const std::string&)> onText;
+    // Optional callback for text messages from a client.  Set before
+    // calling poll().  The view points into that client's receive buffer
+    // and is only valid for the duration of the call.
+    std::function<void(int client, std::string_view)> onText;
+
+    // Optional callback for binary messages (PCM ingest), same rules.
+    // Fragmented messages are not reassembled.
+    std::function<void(int client, const uint8_t* data, size_t len)> onBinary;
+
+    // Optional callback when a client completes the handshake; client
+    // ids are slots and get reused, so per-client state resets here.
+    std::function<void(int client)> onConnect;
+
+    // Linux: try io_uring first (set false before start() to force epoll).
+    bool preferUring = true;
 
     bool start(int port) {
         sock_init();
@@ -129,65 +174,478 @@ public:
             listenSock = SOCK_INVALID;
             return false;
         }
-        listen(listenSock, 1);
+        listen(listenSock, WS_MAX_CLIENTS);
 
         // Non-blocking listen socket so we can poll
-#ifdef _WIN32
-        u_long mode = 1;
-        ioctlsocket(listenSock, FIONBIO, &mode);
-#else
-        fcntl(listenSock, F_SETFL, O_NONBLOCK);
-#endif
+        setBlocking(listenSock, false);
+        startBackend();
         fprintf(stderr, "[ws] listening on 127.0.0.1:%d\n", port);
         return true;
     }
 
     void stop() {
-        if (clientSock != SOCK_INVALID) { sock_close(clientSock); clientSock = SOCK_INVALID; }
+#ifdef __linux__
+        // In-flight ops pin their sockets until they complete; shut them
+        // down first so the port is free as soon as we exit, then let
+        // closing the ring cancel the rest.
+        if (ring.isOpen()) {
+            if (listenSock != SOCK_INVALID) shutdown(listenSock, SHUT_RDWR);
+            for (WsClient& c : clients)
+                if (c.sock != SOCK_INVALID) shutdown(c.sock, SHUT_RDWR);
+        }
+        ring.close();
+        if (epollFd >= 0) { close(epollFd); epollFd = -1; }
+#endif
+        for (WsClient& c : clients) {
+            if (c.sock != SOCK_INVALID) sock_close(c.sock);
+            c.reset();
+        }
+        for (WsFrame& f : frames) f.refs = 0;
         if (listenSock != SOCK_INVALID) { sock_close(listenSock); listenSock = SOCK_INVALID; }
         sock_cleanup();
     }
 
-    // Call each frame: accepts new client if none connected,
-    // performs handshake if needed.  Also drains any incoming client
-    // data (close/pong frames) so the TCP receive buffer doesn't fill.
+    // Call each hop: accepts new clients and moves their handshakes on,
+    // dispatches complete incoming frames to onText, and writes everything
+    // queued since the last call.  Under io_uring this is a single submission.
     void poll() {
-        if (clientSock != SOCK_INVALID) {
-            drainClient();
-            return;
+        expireUpgrades();
+#ifdef __linux__
+        if (backend == WsBackend::URing) { pollUring(); return; }
+        if (backend == WsBackend::Epoll) { pollEpoll(); return; }
+#endif
+        pollPlain();
+    }
+
+#ifndef _WIN32
+    // Have wait() also return when fd turns readable (an eventfd other
+    // threads signal on); wait() drains it.  -1 for none.
+    void setWakeFd(int fd) { wakeFd = fd; }
+
+    // Block until poll() has something to do (a connection, incoming
+    // data, a finished io_uring op), the wake fd fires, or the
+    // steady-clock deadline passes.
+    void wait(int64_t deadlineNs) {
+        pollfd fds[WS_MAX_CLIENTS + 2];
+        int n = 0;
+        if (wakeFd >= 0) fds[n++] = { wakeFd, POLLIN, 0 };
+#ifdef __linux__
+        if (backend == WsBackend::URing) fds[n++] = { ring.fd(), POLLIN, 0 };
+        else if (backend == WsBackend::Epoll) fds[n++] = { epollFd, POLLIN, 0 };
+        else
+#endif
+        {
+            if (listenSock != SOCK_INVALID) fds[n++] = { listenSock, POLLIN, 0 };
+            for (const WsClient& c : clients)
+                if (c.open()) fds[n++] = { c.sock, POLLIN, 0 };
+        }
+        int64_t left = deadlineNs - nowNs();
+        if (left <= 0) return;
+#ifdef __linux__
+        timespec ts{ (time_t)(left / 1000000000), (long)(left % 1000000000) };
+        int r = ::ppoll(fds, n, &ts, nullptr);
+#else
+        int r = ::poll(fds, n, (int)((left + 999999) / 1000000));
+#endif
+        if (r > 0 && wakeFd >= 0 && (fds[0].revents & POLLIN)) {
+            uint64_t count;
+            (void)!read(wakeFd, &count, sizeof(count));
+        }
+    }
+#endif
+
+    // Write queued frames now, without accepting or reading.
+    void flush() {
+#ifdef __linux__
+        if (backend == WsBackend::URing) { prepUring(false); ring.submit(); return; }
+#endif
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) writeClient(i);
+    }
+
+    // Queue a binary frame for every client.  Clients that have fallen
+    // WS_CLIENT_BACKLOG frames behind skip it rather than fall further
+    // behind.  Returns false if nobody took it.  Each client numbers the
+    // binary frames it actually gets from 1; `originNs` (steady clock,
+    // e.g. when the audio behind the frame was captured) is remembered
+    // with the send time under that number, see sentFrame().
+    bool sendBinary(const void* data, size_t len, int64_t originNs = 0) {
+        return broadcast(0x82, data, len, true, originNs);
+    }
+
+    // The same for a set of clients (bit i = client i), encoded once.
+    bool sendBinaryTo(uint32_t clientSet, const void* data, size_t len, int64_t originNs = 0) {
+        return broadcast(0x82, data, len, true, originNs, clientSet);
+    }
+
+    // Queue a text frame for every client.  Bar frames never take the
+    // WS_REPLY_SLOTS or the queue room past WS_CLIENT_BACKLOG, so this
+    // only fails for a client that has stopped reading; that is logged.
+    bool sendText(std::string_view msg) {
+        return broadcast(0x81, msg.data(), msg.size(), false);
+    }
+
+    // Queue a text frame for one client (e.g. a reply from onText).
+    bool sendTextTo(int client, std::string_view msg) {
+        if (client < 0 || client >= WS_MAX_CLIENTS || !clients[client].active()) return false;
+        int slot = encodeFrame(0x81, msg.data(), msg.size(), false);
+        if (slot >= 0 && enqueue(client, slot, false)) return true;
+        fprintf(stderr, "[ws] client %d: text reply dropped, %s full\n", client, slot < 0 ? "frame slots" : "queue");
+        return false;
+    }
+
+    // Send and origin time (steady clock ns) of the client's seq-th
+    // binary frame, if it is still in the ring.
+    bool sentFrame(int client, uint32_t seq, int64_t* sentNs, int64_t* originNs) const {
+        if (client < 0 || client >= WS_MAX_CLIENTS || !clients[client].active()) return false;
+        const SentFrame& f = clients[client].sent[seq % WS_SENT_RING];
+        if (seq == 0 || f.seq != seq) return false;
+        *sentNs = f.sentNs;
+        *originNs = f.originNs;
+        return true;
+    }
+
+    bool hasClient() const { return clientCount() > 0; }
+
+    // Connected clients as a set (bit i = client i).
+    uint32_t clientSet() const {
+        uint32_t set = 0;
+        for (int i = 0; i < WS_MAX_CLIENTS; i++)
+            if (clients[i].active()) set |= 1u << i;
+        return set;
+    }
+
+    int clientCount() const {
+        int n = 0;
+        for (const WsClient& c : clients) n += c.active();
+        return n;
+    }
+
+    WsBackend backendKind() const { return backend; }
+
+    const char* backendName() const {
+        return backend == WsBackend::URing ? "io_uring" : backend == WsBackend::Epoll ? "epoll" : "plain";
+    }
+
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    struct WsFrame {
+        uint8_t data[10 + WS_MAX_TX_PAYLOAD];
+        uint32_t len = 0;
+        int refs = 0;                       // client queues holding this frame
+    };
+
+    struct SentFrame {
+        uint32_t seq = 0;
+        int64_t sentNs = 0, originNs = 0;
+    };
+
+    struct WsClient {
+        sock_t sock = SOCK_INVALID;
+        bool closing = false;               // shut down; freed once no I/O is in flight
+        bool closeAfterFlush = false;       // close handshake done, drop once the queue drains
+        bool upgrading = false;             // accepted, HTTP upgrade request still arriving (in rx)
+        int64_t acceptNs = 0;
+        uint8_t queue[WS_CLIENT_QUEUE];     // frame slots, oldest first
+        int qHead = 0, qCount = 0;
+        uint32_t qOff = 0;                  // bytes of the head frame already written
+        int inflight = 0;                   // io_uring: frames covered by the send in flight
+        bool recvBusy = false;              // io_uring: a recv is in flight
+        uint32_t rxLen = 0;
+        uint32_t fragLen = 0;               // fragmented message so far, at the head of rx
+        uint8_t fragOp = 0;                 // its opcode, 0 = none
+        uint8_t rx[WS_RX_BUF];
+        uint32_t binSeq = 0;                // binary frames queued so far
+        SentFrame sent[WS_SENT_RING];
+#ifdef __linux__
+        iovec iov[WS_CLIENT_QUEUE];
+        msghdr msg;
+#endif
+        bool open() const { return sock != SOCK_INVALID && !closing; }
+        bool active() const { return open() && !upgrading; }
+        void reset() {
+            sock = SOCK_INVALID;
+            closing = closeAfterFlush = upgrading = recvBusy = false;
+            qHead = qCount = inflight = 0;
+            qOff = rxLen = fragLen = binSeq = 0;
+            fragOp = 0;
+            for (SentFrame& f : sent) f.seq = 0;
+        }
+    };
+
+    // ---- Frames and queues ----
+
+    // Encode one frame (header + payload) into a free slot.  -1 if the
+    // frame is too large or every slot is still queued somewhere; bulk
+    // (bar) frames also leave the last WS_REPLY_SLOTS free ones alone.
+    int encodeFrame(uint8_t opcode, const void* data, size_t len, bool bulk) {
+        if (len > WS_MAX_TX_PAYLOAD) {
+            fprintf(stderr, "[ws] dropping %zu-byte frame (max %zu)\n", len, WS_MAX_TX_PAYLOAD);
+            return -1;
+        }
+        int slot = -1, idle = 0;
+        for (int i = 0; i < WS_FRAME_SLOTS; i++) {
+            int s = (nextSlot + i) % WS_FRAME_SLOTS;
+            if (frames[s].refs != 0) continue;
+            if (slot < 0) slot = s;
+            idle++;
+        }
+        if (slot < 0 || (bulk && idle <= WS_REPLY_SLOTS)) return -1;
+        nextSlot = (slot + 1) % WS_FRAME_SLOTS;
+
+        WsFrame& f = frames[slot];
+        int hdrLen;
+        f.data[0] = opcode; // FIN + opcode
+        if (len < 126) {
+            f.data[1] = (uint8_t)len;
+            hdrLen = 2;
+        } else {
+            f.data[1] = 126;
+            f.data[2] = (uint8_t)(len >> 8);
+            f.data[3] = (uint8_t)(len);
+            hdrLen = 4;
         }
-        if (listenSock == SOCK_INVALID) return;
+        memcpy(f.data + hdrLen, data, len);
+        f.len = (uint32_t)(hdrLen + len);
+        return slot;
+    }
 
-        struct sockaddr_in ca{};
-        socklen_t cl = sizeof(ca);
-        sock_t s = accept(listenSock, (struct sockaddr*)&ca, &cl);
-        if (s == SOCK_INVALID) return;
+    bool broadcast(uint8_t opcode, const void* data, size_t len, bool bulk, int64_t originNs = 0,
+                   uint32_t clientSet = ~0u) {
+        bool anyone = false;
+        for (int i = 0; i < WS_MAX_CLIENTS; i++)
+            anyone |= ((clientSet >> i) & 1) && clients[i].active();
+        if (!anyone) return false;
+        int slot = encodeFrame(opcode, data, len, bulk);
+        if (slot < 0) {
+            if (!bulk) fprintf(stderr, "[ws] text frame dropped, frame slots full\n");
+            return false;
+        }
+        bool any = false;
+        int64_t now = opcode == 0x82 ? nowNs() : 0;
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+            if (!((clientSet >> i) & 1) || !clients[i].active()) continue;
+            if (!enqueue(i, slot, bulk)) {
+                if (!bulk) fprintf(stderr, "[ws] client %d: text frame dropped, queue full\n", i);
+                continue;
+            }
+            any = true;
+            if (opcode == 0x82) {
+                WsClient& c = clients[i];
+                SentFrame& f = c.sent[++c.binSeq % WS_SENT_RING];
+                f.seq = c.binSeq;
+                f.sentNs = now;
+                f.originNs = originNs;
+            }
+        }
+        return any;
+    }
+
+    bool enqueue(int ci, int slot, bool bulk) {
+        WsClient& c = clients[ci];
+        if (c.qCount >= (bulk ? WS_CLIENT_BACKLOG : WS_CLIENT_QUEUE)) return false;
+        c.queue[(c.qHead + c.qCount) % WS_CLIENT_QUEUE] = (uint8_t)slot;
+        c.qCount++;
+        frames[slot].refs++;
+        return true;
+    }
 
-        // Client socket must be BLOCKING for reliable WebSocket framing.
-        // (listen socket is non-blocking for polling, but accepted sockets
-        //  inherit that — partial sends would corrupt the WS stream.)
+    // `bytes` of the client's queue were written: release finished frames.
+    void advance(WsClient& c, size_t bytes) {
+        while (bytes > 0 && c.qCount > 0) {
+            WsFrame& f = frames[c.queue[c.qHead]];
+            size_t left = f.len - c.qOff;
+            if (bytes < left) { c.qOff += (uint32_t)bytes; return; }
+            bytes -= left;
+            c.qOff = 0;
+            f.refs--;
+            c.qHead = (c.qHead + 1) % WS_CLIENT_QUEUE;
+            c.qCount--;
+        }
+    }
+
+    void releaseQueue(WsClient& c) {
+        for (int i = 0; i < c.qCount; i++)
+            frames[c.queue[(c.qHead + i) % WS_CLIENT_QUEUE]].refs--;
+        c.qCount = 0;
+    }
+
+    // ---- Incoming frames ----
+
+    // Parse every complete frame in the client's receive buffer.
+    // Handles text and binary messages (dispatched to onText / onBinary),
+    // fragmented ones included, and close; pong and other frames are
+    // silently consumed.  Fragments are gathered at the head of rx (the
+    // buffer holds a whole message plus one frame) up to
+    // WS_MAX_RX_PAYLOAD; a longer message is refused with close 1009.
+    void parseRx(int ci) {
+        WsClient& c = clients[ci];
+        uint32_t pos = c.fragLen;
+        while (c.active() && !c.closeAfterFlush) {
+            uint8_t* p = c.rx + pos;
+            uint32_t avail = c.rxLen - pos;
+            if (avail < 2) break;
+
+            uint8_t opcode = p[0] & 0x0F;
+            bool fin = (p[0] & 0x80) != 0;
+            bool masked = (p[1] & 0x80) != 0;
+            uint64_t payLen = p[1] & 0x7F;
+            uint32_t hdrLen = 2;
+            if (payLen == 126) {
+                if (avail < 4) break;
+                payLen = ((uint64_t)p[2] << 8) | p[3];
+                hdrLen = 4;
+            } else if (payLen == 127) {
+                if (avail < 10) break;
+                payLen = 0;
+                for (int i = 0; i < 8; i++) payLen = (payLen << 8) | p[2 + i];
+                hdrLen = 10;
+            }
+            // Larger than any message we accept — drop the connection
+            if (payLen > WS_MAX_RX_PAYLOAD) { dropClient(ci); return; }
+            uint32_t maskOff = hdrLen;
+            if (masked) hdrLen += 4;
+            if (avail < hdrLen + payLen) break;
+
+            uint8_t* payload = p + hdrLen;
+            if (masked) {
+                const uint8_t* mask = p + maskOff;
+                for (size_t i = 0; i < payLen; i++)
+                    payload[i] ^= mask[i % 4];
+            }
+            pos += hdrLen + (uint32_t)payLen;
+
+            if (opcode == 0x08) {
+                // Close frame — send close back, drop once it's out
+                sendClose(ci, 0);
+                continue;
+            }
+            if (opcode > 0x02) continue;
+            // A continuation (opcode 0) only inside a fragmented message,
+            // and no new message until that one is finished.
+            if ((opcode == 0x00) != (c.fragOp != 0)) {
+                fprintf(stderr, "[ws] client %d: bad fragment sequence, closing\n", ci);
+                sendClose(ci, 1002);
+                break;
+            }
+            if (opcode == 0x00 || !fin) {
+                if (c.fragLen + payLen > WS_MAX_RX_PAYLOAD) {
+                    fprintf(stderr, "[ws] client %d: fragmented message over %zu bytes, closing\n",
+                            ci, WS_MAX_RX_PAYLOAD);
+                    sendClose(ci, 1009);
+                    break;
+                }
+                if (opcode) c.fragOp = opcode;
+                memmove(c.rx + c.fragLen, payload, (size_t)payLen);
+                c.fragLen += (uint32_t)payLen;
+                if (!fin) continue;
+                opcode = c.fragOp;
+                payload = c.rx;
+                payLen = c.fragLen;
+                c.fragOp = 0;
+                c.fragLen = 0;
+            }
+            if (opcode == 0x01) {
+                // Text message — dispatch to callback
+                if (onText) onText(ci, std::string_view((const char*)payload, (size_t)payLen));
+            } else {
+                if (onBinary) onBinary(ci, payload, (size_t)payLen);
+            }
+        }
+        // Keep the fragments gathered so far, drop the frames consumed
+        if (pos > c.fragLen && c.sock != SOCK_INVALID) {
+            memmove(c.rx + c.fragLen, c.rx + pos, c.rxLen - pos);
+            c.rxLen -= pos - c.fragLen;
+        }
+    }
+
+    // Start the close handshake (with `status`, 0 = none) and drop the
+    // client once the close frame is out.
+    void sendClose(int ci, uint16_t status) {
+        const uint8_t code[2] = { (uint8_t)(status >> 8), (uint8_t)status };
+        int slot = encodeFrame(0x88, code, status ? 2 : 0, false);
+        if (slot >= 0 && enqueue(ci, slot, false)) clients[ci].closeAfterFlush = true;
+        else dropClient(ci);
+    }
+
+    // ---- Connections ----
+
+    static void setBlocking(sock_t s, bool blocking) {
+#ifdef _WIN32
+        u_long mode = blocking ? 0 : 1;
+        ioctlsocket(s, FIONBIO, &mode);
+#else
+        int flags = fcntl(s, F_GETFL, 0);
+        fcntl(s, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+#endif
+    }
+
+    static bool wouldBlock() {
 #ifdef _WIN32
-        { u_long mode = 0; ioctlsocket(s, FIONBIO, &mode); }
+        return WSAGetLastError() == WSAEWOULDBLOCK;
 #else
-        { int flags = fcntl(s, F_GETFL, 0); fcntl(s, F_SETFL, flags & ~O_NONBLOCK); }
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
 #endif
-        // Disable Nagle so the 4-byte header and 280-byte payload sent in
-        // two send() calls go out immediately without coalescing delay.
+    }
+
+    // Give a freshly accepted socket a slot.  Its HTTP upgrade request is
+    // read like any other data and answered by finishUpgrade() once the
+    // headers are in, so a slow or silent client holds up nobody; one
+    // still not upgraded after WS_UPGRADE_TIMEOUT_NS is dropped.
+    void acceptClient(sock_t s) {
+        // Disable Nagle so each frame goes out immediately without
+        // coalescing delay.
         { int one = 1; setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one)); }
 
-        // Read HTTP upgrade request
-        char buf[4096];
-        int n = recv(s, buf, sizeof(buf)-1, 0);
-        if (n <= 0) { sock_close(s); return; }
-        buf[n] = '\0';
+        int ci = -1;
+        for (int i = 0; i < WS_MAX_CLIENTS && ci < 0; i++)
+            if (clients[i].sock == SOCK_INVALID) ci = i;
+        if (ci < 0) {
+            fprintf(stderr, "[ws] rejecting client: %d already connected\n", WS_MAX_CLIENTS);
+            sock_close(s);
+            return;
+        }
+
+        // Non-blocking on every backend, so no direct send() (the 101
+        // response, a Plain write) can stall the loop on one slow client.
+        // io_uring still waits for readiness itself; a kernel that
+        // answers -EAGAIN instead just gets the op again next poll().
+        setBlocking(s, false);
+#ifdef __linux__
+        if (backend == WsBackend::Epoll) {
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = (uint64_t)ci;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, s, &ev);
+        }
+#endif
+        clients[ci].reset();
+        clients[ci].sock = s;
+        clients[ci].upgrading = true;
+        clients[ci].acceptNs = nowNs();
+    }
+
+    // The upgrade request so far is in rx.  Once its headers are complete,
+    // answer 101 and take the slot on as a client; anything the client
+    // sent after them is parsed as frames.
+    void finishUpgrade(int ci) {
+        WsClient& c = clients[ci];
+        std::string_view req((const char*)c.rx, c.rxLen);
+        size_t end = req.find("\r\n\r\n");
+        if (end == std::string_view::npos) {
+            if (c.rxLen >= WS_MAX_UPGRADE) dropClient(ci);
+            return;
+        }
+        req = req.substr(0, end + 2);
 
         // Extract Sec-WebSocket-Key
-        const char* keyHdr = strstr(buf, "Sec-WebSocket-Key: ");
-        if (!keyHdr) { sock_close(s); return; }
-        keyHdr += 19;
-        const char* keyEnd = strstr(keyHdr, "\r\n");
-        if (!keyEnd) { sock_close(s); return; }
-        std::string key(keyHdr, keyEnd - keyHdr);
+        size_t keyAt = req.find("Sec-WebSocket-Key: ");
+        if (keyAt == std::string_view::npos) { dropClient(ci); return; }
+        keyAt += 19;
+        std::string key(req.substr(keyAt, req.find("\r\n", keyAt) - keyAt));
 
         // Compute accept value
         std::string concat = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
@@ -195,168 +653,273 @@ public:
         sha1((const uint8_t*)concat.c_str(), concat.size(), hash);
         std::string accept = base64Encode(hash, 20);
 
-        // Send 101 response
+        // Send 101 response; a fresh socket's buffer always has room
         std::string resp = "HTTP/1.1 101 Switching Protocols\r\n"
                            "Upgrade: websocket\r\n"
                            "Connection: Upgrade\r\n"
                            "Sec-WebSocket-Accept: " + accept + "\r\n\r\n";
-        send(s, resp.c_str(), (int)resp.size(), 0);
+        if (send(c.sock, resp.c_str(), (int)resp.size(), 0) != (int)resp.size()) { dropClient(ci); return; }
+
+        c.rxLen -= (uint32_t)(end + 4);
+        memmove(c.rx, c.rx + end + 4, c.rxLen);
+        c.upgrading = false;
+        fprintf(stderr, "[ws] client %d connected (%d total)\n", ci, clientCount());
+        if (onConnect) onConnect(ci);
+        if (c.rxLen) parseRx(ci);
+    }
 
-        clientSock = s;
-        fprintf(stderr, "[ws] client connected\n");
+    void expireUpgrades() {
+        const int64_t now = nowNs();
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+            const WsClient& c = clients[i];
+            if (c.open() && c.upgrading && now - c.acceptNs > WS_UPGRADE_TIMEOUT_NS) {
+                fprintf(stderr, "[ws] no upgrade request on slot %d, dropping\n", i);
+                dropClient(i);
+            }
+        }
     }
 
-    // Send a binary WebSocket frame.  Returns false if send failed
-    // (client disconnected).
-    bool sendBinary(const void* data, size_t len) {
-        return sendFrame(0x82, data, len);
+    // New bytes in the client's rx: its upgrade request or frames.
+    void received(int ci) {
+        if (clients[ci].upgrading) finishUpgrade(ci);
+        else parseRx(ci);
     }
 
-    // Send a text WebSocket frame.
-    bool sendText(const std::string& msg) {
-        return sendFrame(0x81, msg.data(), msg.size());
+    void dropClient(int ci) {
+        WsClient& c = clients[ci];
+        if (!c.open()) return;
+        c.closing = true;
+        if (!c.upgrading) fprintf(stderr, "[ws] client %d disconnected\n", ci);
+#ifdef __linux__
+        // In-flight ops still reference the socket and our buffers:
+        // shutdown() completes them, finishClose() frees the slot after.
+        if (backend == WsBackend::URing) { shutdown(c.sock, SHUT_RDWR); return; }
+#endif
+        finishClose(c);
     }
 
-    bool hasClient() const { return clientSock != SOCK_INVALID; }
+    void finishClose(WsClient& c) {
+        if (c.recvBusy || c.inflight) return;
+        releaseQueue(c);
+        sock_close(c.sock);
+        c.reset();
+    }
 
-private:
-    // Generic frame sender (opcode 0x81 = text, 0x82 = binary).
-    bool sendFrame(uint8_t opcode, const void* data, size_t len) {
-        if (clientSock == SOCK_INVALID) return false;
+    // ---- Plain / epoll: readiness-driven non-blocking sockets ----
 
-        uint8_t hdr[10];
-        int hdrLen = 0;
-        hdr[0] = opcode; // FIN + opcode
-        if (len < 126) {
-            hdr[1] = (uint8_t)len;
-            hdrLen = 2;
-        } else if (len < 65536) {
-            hdr[1] = 126;
-            hdr[2] = (uint8_t)(len >> 8);
-            hdr[3] = (uint8_t)(len);
-            hdrLen = 4;
-        } else {
-            // Payloads > 64K not needed for 24 floats
-            hdr[1] = 127;
-            hdrLen = 10;
-            memset(hdr+2, 0, 8);
-            hdr[6] = (uint8_t)(len >> 24);
-            hdr[7] = (uint8_t)(len >> 16);
-            hdr[8] = (uint8_t)(len >> 8);
-            hdr[9] = (uint8_t)(len);
+    void readClient(int ci) {
+        WsClient& c = clients[ci];
+        while (c.open()) {
+            int n = recv(c.sock, (char*)c.rx + c.rxLen, (int)(WS_RX_BUF - c.rxLen), 0);
+            if (n > 0) { c.rxLen += n; received(ci); continue; }
+            if (n < 0 && wouldBlock()) return;
+            dropClient(ci);
         }
-
-        // Send header + payload via sendAll to handle partial sends.
-        if (!sendAll((const char*)hdr, hdrLen)) { dropClient(); return false; }
-        if (!sendAll((const char*)data, (int)len)) { dropClient(); return false; }
-
-        return true;
     }
-    // Send all bytes, retrying on partial sends.
-    bool sendAll(const char* buf, int len) {
-        int flags = 0;
+
+    // Write as much of the client's queue as the socket takes.
+    void writeClient(int ci) {
+        WsClient& c = clients[ci];
+        while (c.active() && c.qCount > 0) {
 #ifdef __linux__
-        flags = MSG_NOSIGNAL;
+            // One sendmsg() for the whole queue.
+            int iovs = fillIov(c);
+            msghdr msg{};
+            msg.msg_iov = c.iov;
+            msg.msg_iovlen = iovs;
+            ssize_t n = sendmsg(c.sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            const WsFrame& f = frames[c.queue[c.qHead]];
+            int n = send(c.sock, (const char*)f.data + c.qOff, (int)(f.len - c.qOff), 0);
 #endif
-        int off = 0;
-        while (off < len) {
-            int n = send(clientSock, buf + off, len - off, flags);
-            if (n <= 0) return false;
-            off += n;
+            if (n > 0) { advance(c, (size_t)n); continue; }
+            if (n < 0 && wouldBlock()) return;
+            dropClient(ci);
         }
-        return true;
+        if (c.active() && c.closeAfterFlush && c.qCount == 0) dropClient(ci);
     }
 
-    // Non-blocking read + parse of incoming WebSocket frames.
-    // Handles text messages (dispatched to onText callback), close, pong.
-    // Detects client disconnect so we can accept a new connection.
-    void drainClient() {
-        if (clientSock == SOCK_INVALID) return;
-
-        // Peek to see if there's data without blocking.
-        uint8_t peek;
-#ifdef _WIN32
-        u_long avail = 0;
-        ioctlsocket(clientSock, FIONREAD, &avail);
-        if (avail == 0) return;
-#else
-        int n = recv(clientSock, &peek, 1, MSG_PEEK | MSG_DONTWAIT);
-        if (n == 0) { dropClient(); return; }
-        if (n < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
-            dropClient(); return;
+    void acceptPending() {
+        for (;;) {
+            struct sockaddr_in ca{};
+            socklen_t cl = sizeof(ca);
+            sock_t s = accept(listenSock, (struct sockaddr*)&ca, &cl);
+            if (s == SOCK_INVALID) return;
+            acceptClient(s);
         }
-#endif
-
-        // There's data — read the frame header (2 bytes minimum).
-        uint8_t hdr[2];
-        if (!recvAll(hdr, 2)) { dropClient(); return; }
+    }
 
-        uint8_t opcode = hdr[0] & 0x0F;
-        bool masked = (hdr[1] & 0x80) != 0;
-        uint64_t payLen = hdr[1] & 0x7F;
+    void pollPlain() {
+        if (listenSock != SOCK_INVALID) acceptPending();
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+            readClient(i);
+            writeClient(i);
+        }
+    }
 
-        if (payLen == 126) {
-            uint8_t ext[2];
-            if (!recvAll(ext, 2)) { dropClient(); return; }
-            payLen = ((uint64_t)ext[0] << 8) | ext[1];
-        } else if (payLen == 127) {
-            uint8_t ext[8];
-            if (!recvAll(ext, 8)) { dropClient(); return; }
-            payLen = 0;
-            for (int i = 0; i < 8; i++) payLen = (payLen << 8) | ext[i];
+#ifdef __linux__
+    int fillIov(WsClient& c) {
+        for (int i = 0; i < c.qCount; i++) {
+            const WsFrame& f = frames[c.queue[(c.qHead + i) % WS_CLIENT_QUEUE]];
+            uint32_t off = i == 0 ? c.qOff : 0;
+            c.iov[i].iov_base = (void*)(f.data + off);
+            c.iov[i].iov_len = f.len - off;
         }
+        return c.qCount;
+    }
 
-        uint8_t mask[4] = {};
-        if (masked) {
-            if (!recvAll(mask, 4)) { dropClient(); return; }
+    void pollEpoll() {
+        epoll_event evs[WS_MAX_CLIENTS + 1];
+        int n = epoll_wait(epollFd, evs, WS_MAX_CLIENTS + 1, 0);
+        for (int i = 0; i < n; i++) {
+            if (evs[i].data.u64 == EPOLL_LISTEN) acceptPending();
+            else readClient((int)evs[i].data.u64);
         }
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) writeClient(i);
+    }
 
-        // Read payload (cap at 4 KB — we never expect large messages)
-        if (payLen > 4096) {
-            // Nonsensical — drop connection
-            dropClient(); return;
+    // ---- io_uring: one submission per poll() for every client ----
+
+    enum : uint64_t { OP_ACCEPT = 1, OP_RECV = 2, OP_SEND = 3 };
+    static uint64_t tag(uint64_t op, int ci) { return (op << 32) | (uint32_t)ci; }
+
+    void pollUring() {
+        // Completions are read straight from the shared ring.
+        ring.reap([&](const io_uring_cqe& e) { onCompletion(e); });
+        prepUring(true);
+        int r = ring.submit();
+        if (r < 0 && r != -EAGAIN && r != -EINTR && r != -EBUSY)
+            fprintf(stderr, "[ws] io_uring_enter: %s\n", strerror(-r));
+    }
+
+    void onCompletion(const io_uring_cqe& e) {
+        uint64_t op = e.user_data >> 32;
+        int ci = (int)(e.user_data & 0xFFFFFFFF);
+        if (op == OP_ACCEPT) {
+            acceptBusy = false;
+            if (e.res >= 0) acceptClient((sock_t)e.res);
+            return;
         }
-        std::string payload((size_t)payLen, '\0');
-        if (payLen > 0) {
-            if (!recvAll((uint8_t*)&payload[0], (int)payLen)) { dropClient(); return; }
-            if (masked) {
-                for (size_t i = 0; i < payLen; i++)
-                    payload[i] ^= mask[i % 4];
+        WsClient& c = clients[ci];
+        if (op == OP_RECV) {
+            c.recvBusy = false;
+            if (!c.closing) {
+                if (e.res > 0) { c.rxLen += e.res; received(ci); }
+                else if (e.res != -EAGAIN && e.res != -EINTR) dropClient(ci);
             }
+        } else if (op == OP_SEND) {
+            c.inflight = 0;
+            if (e.res >= 0) advance(c, (size_t)e.res);
+            else if (e.res != -EAGAIN && e.res != -EINTR && !c.closing) dropClient(ci);
+            if (c.active() && c.closeAfterFlush && c.qCount == 0) dropClient(ci);
         }
-
-        if (opcode == 0x08) {
-            // Close frame — send close back and drop
-            uint8_t close[4] = {0x88, 0x00};
-            sendAll((const char*)close, 2);
-            dropClient();
-        } else if (opcode == 0x01) {
-            // Text frame — dispatch to callback
-            if (onText) onText(payload);
-        }
-        // Pong (0x0A) and other frames are silently consumed.
+        if (c.closing) finishClose(c);
     }
 
-    // Blocking recv of exactly `len` bytes.
-    bool recvAll(uint8_t* buf, int len) {
-        int off = 0;
-        while (off < len) {
-            int n = recv(clientSock, (char*)buf + off, len - off, 0);
-            if (n <= 0) return false;
-            off += n;
+    // Queue SQEs for everything that can make progress: accept, a recv
+    // per idle client, and one send per client covering its whole queue.
+    // A lone frame goes out with WRITE_FIXED from the registered slots;
+    // several go as one SENDMSG over the same slots.
+    void prepUring(bool reads) {
+        io_uring_sqe* s;
+        if (reads && !acceptBusy && listenSock != SOCK_INVALID && (s = ring.sqe())) {
+            s->opcode = IORING_OP_ACCEPT;
+            s->fd = listenSock;
+            s->accept_flags = SOCK_CLOEXEC;
+            s->user_data = tag(OP_ACCEPT, 0);
+            acceptBusy = true;
+        }
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+            WsClient& c = clients[i];
+            if (!c.open()) continue;
+            if (reads && !c.recvBusy && c.rxLen < WS_RX_BUF && (s = ring.sqe())) {
+                s->opcode = IORING_OP_RECV;
+                s->fd = c.sock;
+                s->addr = (uint64_t)(uintptr_t)(c.rx + c.rxLen);
+                s->len = (uint32_t)(WS_RX_BUF - c.rxLen);
+                s->user_data = tag(OP_RECV, i);
+                c.recvBusy = true;
+            }
+            if (c.inflight == 0 && c.qCount > 0 && (s = ring.sqe())) {
+                if (c.qCount == 1) {
+                    const WsFrame& f = frames[c.queue[c.qHead]];
+                    s->opcode = fixedFrames ? IORING_OP_WRITE_FIXED : IORING_OP_SEND;
+                    s->fd = c.sock;
+                    s->addr = (uint64_t)(uintptr_t)(f.data + c.qOff);
+                    s->len = f.len - c.qOff;
+                    if (fixedFrames) s->buf_index = 0;
+                    else s->msg_flags = MSG_NOSIGNAL;
+                } else {
+                    memset(&c.msg, 0, sizeof(c.msg));
+                    c.msg.msg_iov = c.iov;
+                    c.msg.msg_iovlen = fillIov(c);
+                    s->opcode = IORING_OP_SENDMSG;
+                    s->fd = c.sock;
+                    s->addr = (uint64_t)(uintptr_t)&c.msg;
+                    s->len = 1;
+                    s->msg_flags = MSG_NOSIGNAL;
+                }
+                s->user_data = tag(OP_SEND, i);
+                c.inflight = c.qCount;
+            }
         }
-        return true;
     }
 
-    void dropClient() {
-        fprintf(stderr, "[ws] client disconnected\n");
-        sock_close(clientSock);
-        clientSock = SOCK_INVALID;
+    static constexpr uint64_t EPOLL_LISTEN = ~0ull;
+    // Per poll(): one accept, plus a recv and a send per client.
+    static constexpr unsigned WS_URING_ENTRIES = 32;
+    static_assert(2 * WS_MAX_CLIENTS + 1 <= WS_URING_ENTRIES, "SQ too small for every client");
+#endif
+
+    void startBackend() {
+#ifdef __linux__
+        if (preferUring) {
+            static const uint8_t ops[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND,
+                                           IORING_OP_SENDMSG, IORING_OP_WRITE_FIXED };
+            int r = ring.open(WS_URING_ENTRIES, ops, (int)sizeof(ops));
+            if (r == 0) {
+                backend = WsBackend::URing;
+                // Pin the frame slots so single-frame writes skip the
+                // per-op page lookup.  Without it (memlock limit) plain
+                // SEND does the same job.
+                int rb = ring.registerBuffer(frames, sizeof(frames));
+                fixedFrames = rb == 0;
+                fprintf(stderr, "[ws] network backend: io_uring%s\n",
+                        fixedFrames ? " (registered frame buffers)" : "");
+                if (!fixedFrames)
+                    fprintf(stderr, "[ws] io_uring buffer registration failed: %s\n", strerror(-rb));
+                return;
+            }
+            fprintf(stderr, "[ws] io_uring unavailable (%s), falling back to epoll\n", strerror(-r));
+        }
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd >= 0) {
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = EPOLL_LISTEN;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSock, &ev);
+            backend = WsBackend::Epoll;
+            fprintf(stderr, "[ws] network backend: epoll\n");
+            return;
+        }
+#endif
+        backend = WsBackend::Plain;
     }
 
-    sock_t listenSock;
-    sock_t clientSock;
+    sock_t listenSock = SOCK_INVALID;
+    WsBackend backend = WsBackend::Plain;
+    WsClient clients[WS_MAX_CLIENTS];
+    WsFrame frames[WS_FRAME_SLOTS];
+    int nextSlot = 0;
+#ifndef _WIN32
+    int wakeFd = -1;
+#endif
+#ifdef __linux__
+    URing ring;
+    bool fixedFrames = false;
+    bool acceptBusy = false;
+    int epollFd = -1;
+#endif
 };
 
 #endif // VIS_WS_SERVER_H
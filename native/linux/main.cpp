@@ -1,10 +1,12 @@
 // main.cpp — Linux audio capture for the Spotify visualizer.
 // Captures from PulseAudio/PipeWire monitor source, processes audio
 // with cava-style FFT + gravity smoothing, sends 70 bars over WebSocket.
-// Supports source enumeration and live source switching via WebSocket commands.
+// Supports source enumeration and live source switching via WebSocket commands,
+// and analysing several sources at once on a small worker pool.
 //
 // Build:  make
 // Run:    ./vis-capture
+//         ./vis-capture --replay synthetic:music   (no sound server needed)
 
 #include <cstdio>
 #include <cstdlib>
@@ -15,19 +17,38 @@
 #include <chrono>
 #include <thread>
 #include <string>
+#include <string_view>
+#include <charconv>
 #include <vector>
 #include <mutex>
+#include <memory>
 #include <pulse/simple.h>
 #include <pulse/error.h>
 #include <pulse/pulseaudio.h>
+#include <sys/eventfd.h>
 
 #include "../common/protocol.h"
 #include "../common/fft.h"
+#include "../common/pipelines.h"
+#include "../common/autotune.h"
 #include "../common/ws_server.h"
+#include "../common/worker_pool.h"
+#include "../common/latency.h"
+#include "../common/settings.h"
+#include "../common/interp.h"
+#include "../common/pcm_ingest.h"
+#include "../common/replay.h"
+#include "../common/loudness.h"
+#include "../common/history.h"
+#include "../common/hpss.h"
+#include "../common/triggers.h"
 
 static std::atomic<bool> g_running{true};
 
+static std::atomic<bool> g_reloadRequested{false};
+
 static void onSignal(int) { g_running = false; }
+static void onHangup(int) { g_reloadRequested = true; }
 
 // --- PulseAudio source enumeration ---
 struct SourceInfo {
@@ -92,140 +113,854 @@ static std::vector<SourceInfo> enumerateSources() {
     return result;
 }
 
+// Copy s into out as the body of a JSON string: quotes and backslashes
+// escaped, control characters as \u00XX.  Always NUL-terminated; cut
+// short (never mid-escape) if out is too small.  No allocation, so the
+// reply paths can use it.
+static void jsonEscape(std::string_view s, char* out, size_t cap) {
+    size_t n = 0;
+    for (char c : s) {
+        char esc[8];
+        int len;
+        if (c == '"' || c == '\\') len = snprintf(esc, sizeof(esc), "\\%c", c);
+        else if ((unsigned char)c < 0x20) len = snprintf(esc, sizeof(esc), "\\u%04x", (unsigned char)c);
+        else { esc[0] = c; len = 1; }
+        if (n + len >= cap) break;
+        memcpy(out + n, esc, len);
+        n += len;
+    }
+    out[n] = '\0';
+}
+
 // Build JSON source list: {"sources":[{"name":"...","desc":"..."},...]}
 static std::string buildSourcesJson(const std::vector<SourceInfo>& sources) {
     std::string json = "{\"sources\":[";
+    char name[512], desc[512];
     for (size_t i = 0; i < sources.size(); i++) {
         if (i > 0) json += ",";
-        // Escape quotes in descriptions
-        std::string desc = sources[i].description;
-        std::string name = sources[i].name;
-        for (auto* s : {&desc, &name}) {
-            size_t pos = 0;
-            while ((pos = s->find('"', pos)) != std::string::npos) {
-                s->replace(pos, 1, "\\\"");
-                pos += 2;
-            }
-        }
-        json += "{\"name\":\"" + name + "\",\"desc\":\"" + desc + "\"}";
+        jsonEscape(sources[i].name, name, sizeof(name));
+        jsonEscape(sources[i].description, desc, sizeof(desc));
+        json += std::string("{\"name\":\"") + name + "\",\"desc\":\"" + desc + "\"}";
     }
     json += "]}";
     return json;
 }
 
-int main() {
+// Integer argument of a "PREFIX:value" command, parsed in place so the
+// command path doesn't allocate.
+static bool commandInt(std::string_view msg, std::string_view prefix, int* out) {
+    if (msg.substr(0, prefix.size()) != prefix) return false;
+    std::string_view arg = msg.substr(prefix.size());
+    auto r = std::from_chars(arg.data(), arg.data() + arg.size(), *out);
+    return r.ec == std::errc();
+}
+
+// --- Capture channels ---
+// One per active source.  Channel 0 is the primary source (SET_SOURCE,
+// sent as bare float frames); channels 1.. are added with ADD_SOURCE and
+// sent as tagged frames.  Each channel has its own capture thread, which
+// blocks on pa_simple_read and pushes chunks into a small ring, and its
+// own processor.  Rings are drained on the worker pool, one job per
+// channel at a time, so channels run in parallel and a slow or stalled
+// source only ever holds up itself.
+constexpr int CHUNK_RING = 8;   // ~133 ms of audio per channel
+
+struct Channel {
+    int id = 0;
+    std::string source;
+    pa_simple* pa = nullptr;
+    std::unique_ptr<ReplaySource> replay;   // --replay: read instead of pa
+    std::thread capture;
+    std::atomic<bool> running{false};
+    std::atomic<bool> failed{false};
+    std::atomic<bool> reset{true};          // re-init processor before the next chunk
+
+    VisProcessor proc;                      // touched only by the job holding `scheduled`
+    LoudnessMeter meter;                    // likewise; fed while g_loudness is set
+    bool metering = false;
+    std::unique_ptr<HpssLayers> hpss;       // likewise; attached while g_layers is set
+    std::unique_ptr<FrameBatch> batch;      // likewise; allocated the first time chunks back up
+    TriggerEvaluator triggers;              // likewise; run while g_triggers is set
+
+    // SPSC chunk ring: capture thread produces, the scheduled job consumes.
+    union Chunk { float f32[FRAME_SAMPLES]; int16_t s16[FRAME_SAMPLES]; };
+    Chunk ring[CHUNK_RING];
+    int64_t stamp[CHUNK_RING];              // steady-clock ns when each chunk finished capturing
+    std::atomic<uint32_t> ringHead{0};
+    std::atomic<uint32_t> ringTail{0};
+    std::atomic<bool> scheduled{false};     // a job is queued or running
+    std::atomic<int>  inJob{0};             // a job is executing (last thing it clears)
+    std::atomic<uint32_t> dropped{0};
+
+    // Latest bars, read by the network loop.
+    std::mutex outMtx;
+    float out[MAX_BAR_COUNT];
+    int outCount = 0;
+    int64_t outStamp = 0;                   // capture stamp of the chunk behind `out`
+    uint32_t outSeq = 0;
+    uint32_t sentSeq = 0;                   // network loop only
+    BarInterpolator interp;                 // hop outputs for display-rate clients (network loop only)
+    uint32_t keySeq = 0;
+    float outLayers[2][MAX_BAR_COUNT];      // harmonic, percussive (SET_LAYERS)
+    int layerCount = 0;
+    int64_t layerStamp = 0;
+    uint32_t layerSeq = 0;
+    uint32_t layerSentSeq = 0;              // network loop only
+    LoudnessReading loud;                   // latest 100 ms reading, under outMtx
+    uint32_t loudSeq = 0;
+    uint32_t loudSentSeq = 0;               // network loop only
+    TriggerEvent events[TRIGGER_EVENT_QUEUE];   // fired since the last network pass, under outMtx
+    int eventCount = 0;
+
+    // PCM ingest (PCM_START): the network thread fills the ring instead
+    // of a capture thread, and only the streaming client gets the bars.
+    int owner = -1;                         // client slot, -1 = captured source
+    uint32_t clientSet = ~0u;               // clients that get this channel's frames
+                                            // (ADD_SOURCE / PCM_START: the requester)
+    PcmIngest ingest;
+};
+
+static WorkerPool* g_pool = nullptr;
+static std::atomic<bool> g_streaming{false};   // a client is connected
+static std::atomic<bool> g_loudness{false};    // a client is on SET_LOUDNESS
+static std::atomic<bool> g_layers{false};      // a client is on SET_LAYERS
+static std::atomic<bool> g_triggers{false};    // a client has TRIGGER rules
+static HistoryStore g_history;                 // primary source's bars (HISTORY:)
+static std::mutex g_historyMtx;
+static int g_wakeFd = -1;                      // eventfd the network thread waits on
+
+// Wake the network thread for output that should not wait for the next
+// send: trigger events, loudness readings, a failed source.
+static void wakeNetwork() {
+    uint64_t one = 1;
+    if (g_wakeFd >= 0) (void)!write(g_wakeFd, &one, sizeof(one));
+}
+
+static pa_simple* openCapture(const std::string& sourceName) {
+    // Integer pipelines take S16LE straight from PA (half the bytes
+    // per sample, no float conversion on the way in).
+    pa_sample_spec spec{};
+    spec.format   = g_pipeline->fnS16 ? PA_SAMPLE_S16LE : PA_SAMPLE_FLOAT32LE;
+    spec.rate     = SAMPLE_RATE;
+    spec.channels = 1;
+
+    pa_buffer_attr battr{};
+    battr.maxlength = (uint32_t)-1;
+    battr.tlength   = (uint32_t)-1;
+    battr.prebuf    = (uint32_t)-1;
+    battr.minreq    = (uint32_t)-1;
+    battr.fragsize  = FRAME_SAMPLES * (g_pipeline->fnS16 ? sizeof(int16_t) : sizeof(float));
+
+    int paErr;
+    pa_simple* pa = pa_simple_new(
+        nullptr, "ClearVis", PA_STREAM_RECORD,
+        sourceName.c_str(), "Audio Visualizer",
+        &spec, nullptr, &battr, &paErr
+    );
+    if (!pa) {
+        fprintf(stderr, "[vis] pa_simple_new(%s): %s\n", sourceName.c_str(), pa_strerror(paErr));
+        return nullptr;
+    }
+    fprintf(stderr, "[vis] PulseAudio connected to: %s\n", sourceName.c_str());
+    return pa;
+}
+
+// Worker job: drain the channel's ring through its processor.
+static void processChannel(void* arg) {
+    Channel* ch = (Channel*)arg;
+    const bool s16 = g_pipeline->fnS16 != nullptr;
+    float bars[FFT_BATCH][MAX_BAR_COUNT];
+    float mono[FRAME_SAMPLES];
+    ch->inJob++;
+    for (;;) {
+        uint32_t tail = ch->ringTail.load(std::memory_order_relaxed);
+        uint32_t head;
+        while (tail != (head = ch->ringHead.load(std::memory_order_acquire))) {
+            bool fresh = ch->reset.exchange(false);
+            if (fresh) initProcessor(ch->proc);
+            // Harmonic / percussive layers ride on the frame as a spectrum tap
+            const bool layers = g_layers.load(std::memory_order_relaxed);
+            if (layers != (ch->proc.spectrumTap != nullptr)) {
+                if (layers && !ch->hpss) ch->hpss = std::make_unique<HpssLayers>();
+                attachHpss(ch->proc, layers ? ch->hpss.get() : nullptr);
+            }
+
+            // Behind (stalled worker, ingest burst): take every queued
+            // chunk, up to a batch, through one batched transform.  The
+            // slots stay ours until the tail passes them.
+            int n = s16 ? 1 : (int)std::min<uint32_t>(head - tail, FFT_BATCH);
+            bool notify = false;
+            if (n > 1 && !ch->batch && kernelBatches()) ch->batch = std::make_unique<FrameBatch>();
+            if (s16) {
+                processFrameS16(ch->proc, ch->ring[tail % CHUNK_RING].s16, bars[0]);
+            } else {
+                const float* chunks[FFT_BATCH];
+                for (int i = 0; i < n; i++) chunks[i] = ch->ring[(tail + i) % CHUNK_RING].f32;
+                processFrames(ch->proc, ch->batch.get(), chunks, n, bars);
+            }
+
+            for (int i = 0; i < n; i++) {
+                Channel::Chunk& c = ch->ring[tail % CHUNK_RING];
+
+                // Loudness side channel; restarts with the source or the first subscriber
+                LoudnessReading loud;
+                bool measured = false;
+                if (g_loudness.load(std::memory_order_relaxed)) {
+                    if ((fresh && i == 0) || !ch->metering) ch->meter.reset();
+                    ch->metering = true;
+                    const float* x = c.f32;
+                    if (s16) {
+                        for (int k = 0; k < FRAME_SAMPLES; k++) mono[k] = c.s16[k] * (1.0f / 32768.0f);
+                        x = mono;
+                    }
+                    measured = ch->meter.push(x, FRAME_SAMPLES, loud);
+                } else {
+                    ch->metering = false;
+                }
+                int64_t stamp = ch->stamp[tail % CHUNK_RING];
+                ch->ringTail.store(++tail, std::memory_order_release);
+
+                // Trigger rules see every hop, not just the ones that get sent
+                TriggerEvent fired[TRIGGER_EVENT_QUEUE];
+                int nFired = 0;
+                if (g_triggers.load(std::memory_order_relaxed)) {
+                    TriggerReader rules(g_triggerSet);
+                    nFired = ch->triggers.run(*rules, ch->id, bars[i], ch->proc.barCount, stamp,
+                                              fired, TRIGGER_EVENT_QUEUE);
+                }
+
+                std::lock_guard<std::mutex> lock(ch->outMtx);
+                memcpy(ch->out, bars[i], ch->proc.barCount * sizeof(float));
+                ch->outCount = ch->proc.barCount;
+                ch->outStamp = stamp;
+                ch->outSeq++;
+                if (measured) {
+                    ch->loud = loud;
+                    ch->loudSeq++;
+                }
+                for (int k = 0; k < nFired && ch->eventCount < TRIGGER_EVENT_QUEUE; k++)
+                    ch->events[ch->eventCount++] = fired[k];
+                notify |= measured || nFired > 0;
+                // The tap has seen the whole batch; its layers are the last frame's
+                if (layers && ch->hpss->count && i == n - 1) {
+                    memcpy(ch->outLayers[0], ch->hpss->harmonic, ch->hpss->count * sizeof(float));
+                    memcpy(ch->outLayers[1], ch->hpss->percussive, ch->hpss->count * sizeof(float));
+                    ch->layerCount = ch->hpss->count;
+                    ch->layerStamp = stamp;
+                    ch->layerSeq++;
+                }
+                if (ch->id == 0 && g_history.isOpen()) {
+                    int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count();
+                    std::lock_guard<std::mutex> hl(g_historyMtx);
+                    g_history.append(bars[i], ch->proc.barCount, ms);
+                }
+            }
+            if (notify) wakeNetwork();
+        }
+        ch->scheduled.store(false, std::memory_order_release);
+        // A chunk may have landed between the last check and clearing the
+        // flag; take it unless the capture thread already rescheduled us.
+        if (tail == ch->ringHead.load(std::memory_order_acquire) || ch->scheduled.exchange(true))
+            break;
+    }
+    ch->inJob--;
+}
+
+static void scheduleChannel(Channel* ch) {
+    if (!ch->scheduled.exchange(true)) {
+        // Queue full: the next chunk retries.
+        if (!g_pool->submit(processChannel, ch)) ch->scheduled = false;
+    }
+}
+
+// Capture thread: blocking reads of exactly FRAME_SAMPLES (~16.67ms at
+// 44100 Hz).  While no client is connected the stream is left alone and
+// flushed on reconnect, like the single-source loop used to.
+static void captureLoop(Channel* ch) {
+    const bool s16 = g_pipeline->fnS16 != nullptr;
+    const size_t bytes = FRAME_SAMPLES * (s16 ? sizeof(int16_t) : sizeof(float));
+    Channel::Chunk overflow;
+    bool wasIdle = true;
+    while (ch->running) {
+        if (!g_streaming) {
+            wasIdle = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            continue;
+        }
+        if (wasIdle) {
+            if (ch->pa) pa_simple_flush(ch->pa, nullptr);
+            else ch->replay->resync();
+            ch->reset = true;
+            wasIdle = false;
+        }
+
+        // Ring full (DSP behind): keep reading so PA doesn't overrun, but
+        // drop the chunk rather than wait for the worker.
+        uint32_t head = ch->ringHead.load(std::memory_order_relaxed);
+        bool full = head - ch->ringTail.load(std::memory_order_acquire) >= CHUNK_RING;
+        void* dst = full ? (void*)&overflow : (void*)&ch->ring[head % CHUNK_RING];
+
+        int paErr;
+        if (ch->replay) {
+            float hop[FRAME_SAMPLES];
+            if (!ch->replay->read(hop)) continue;          // stalled source
+            if (s16) {
+                for (int i = 0; i < FRAME_SAMPLES; i++)
+                    ((int16_t*)dst)[i] = (int16_t)lrintf(std::max(-1.0f, std::min(1.0f, hop[i])) * 32767.0f);
+            } else {
+                memcpy(dst, hop, bytes);
+            }
+        } else if (pa_simple_read(ch->pa, dst, bytes, &paErr) < 0) {
+            fprintf(stderr, "[vis] pa_simple_read(%s): %s\n", ch->source.c_str(), pa_strerror(paErr));
+            ch->failed = true;
+            wakeNetwork();
+            break;
+        }
+        if (full) {
+            ch->dropped++;
+            continue;
+        }
+        ch->stamp[head % CHUNK_RING] = WsServer::nowNs();
+        ch->ringHead.store(head + 1, std::memory_order_release);
+        scheduleChannel(ch);
+    }
+}
+
+// Network thread: queue one chunk of ingested PCM the way captureLoop
+// queues a read (dropped if the DSP is behind).
+static void ingestChunk(Channel* ch, const float* mono) {
+    uint32_t head = ch->ringHead.load(std::memory_order_relaxed);
+    if (head - ch->ringTail.load(std::memory_order_acquire) >= CHUNK_RING) {
+        ch->dropped++;
+        return;
+    }
+    Channel::Chunk& c = ch->ring[head % CHUNK_RING];
+    if (g_pipeline->fnS16) {
+        for (int i = 0; i < FRAME_SAMPLES; i++)
+            c.s16[i] = (int16_t)lrintf(mono[i] * 32767.0f);
+    } else {
+        memcpy(c.f32, mono, sizeof(c.f32));
+    }
+    ch->stamp[head % CHUNK_RING] = WsServer::nowNs();
+    ch->ringHead.store(head + 1, std::memory_order_release);
+    scheduleChannel(ch);
+}
+
+static void startChannel(Channel* ch) {
+    ch->running = true;
+    ch->failed = false;
+    ch->reset = true;
+    ch->capture = std::thread(captureLoop, ch);
+}
+
+// Stop the capture thread, wait for any in-flight job, close the stream.
+static void stopChannel(Channel* ch) {
+    ch->running = false;
+    if (ch->capture.joinable()) ch->capture.join();
+    while (ch->scheduled || ch->inJob) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ch->ringTail.store(ch->ringHead.load());
+    if (ch->pa) { pa_simple_free(ch->pa); ch->pa = nullptr; }
+}
+
+static bool g_preferUring = true;   // WebSocket server tries io_uring first
+static std::string g_settingsPath = defaultSettingsPath();
+static bool g_settingsRequired = false;     // --config given: the file must load
+static std::string g_replay;                // --replay SPEC: primary channel reads replay.h
+static std::string g_historyPath;           // --history PATH|off; empty = defaultHistoryPath()
+
+// Command line: --pipeline NAME selects a processing variant,
+// --list-pipelines prints the available ones, --kernels NAME|auto
+// overrides the autotuner (--retune re-measures, --list-kernels lists),
+// --no-io-uring keeps the WebSocket server on epoll, --config PATH reads
+// settings from PATH instead of the default location, --replay SPEC
+// analyses a file or synthetic signal instead of the default monitor
+// (see replay.h), --history PATH|off moves or turns off the bar history
+// file (history.h).  Returns false to exit.
+static bool parseArgs(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (!selectPipeline(name)) {
+                fprintf(stderr, "[vis] unknown pipeline '%s', available:\n", name);
+                listPipelines();
+                return false;
+            }
+        } else if (strcmp(argv[i], "--list-pipelines") == 0) {
+            listPipelines();
+            return false;
+        } else if (strcmp(argv[i], "--kernels") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            g_kernelOverride = strcmp(name, "auto") == 0 ? -1 : parseKernelName(name);
+            if (g_kernelOverride < 0 && strcmp(name, "auto") != 0) {
+                fprintf(stderr, "[vis] unknown kernels '%s', available:\n", name);
+                listKernels();
+                return false;
+            }
+        } else if (strcmp(argv[i], "--retune") == 0) {
+            g_retune = true;
+        } else if (strcmp(argv[i], "--list-kernels") == 0) {
+            listKernels();
+            return false;
+        } else if (strcmp(argv[i], "--no-io-uring") == 0) {
+            g_preferUring = false;
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            g_settingsPath = argv[++i];
+            g_settingsRequired = true;
+        } else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+            g_historyPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            g_replay = argv[++i];
+        } else {
+            fprintf(stderr, "usage: vis-capture [--pipeline NAME] [--list-pipelines]\n"
+                            "                   [--kernels NAME|auto] [--retune] [--list-kernels] [--no-io-uring]\n"
+                            "                   [--config PATH] [--replay FILE.f32|synthetic:KIND]\n"
+                            "                   [--history PATH|off]\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (!parseArgs(argc, argv)) return 1;
     signal(SIGINT, onSignal);
     signal(SIGTERM, onSignal);
+    signal(SIGHUP, onHangup);
     signal(SIGPIPE, SIG_IGN);
 
     fprintf(stderr, "[vis] Spotify visualizer audio bridge (Linux)\n");
+
+    // --- Settings: the file if there is one, else the built-in defaults ---
+    VisSettings settings;
+    std::string settingsErr;
+    if (g_settingsRequired || settingsFileExists(g_settingsPath)) {
+        if (!loadSettings(g_settingsPath, settings, settingsErr)) {
+            fprintf(stderr, "[vis] FATAL: %s: %s\n", g_settingsPath.c_str(), settingsErr.c_str());
+            return 1;
+        }
+        fprintf(stderr, "[vis] settings: %s\n", g_settingsPath.c_str());
+    }
+    publishConfig(settings.barCount, settings.freqMax, settings.tune);
+    const int port = settings.port;
+
     fprintf(stderr, "[vis] FFT %d, bars %d, %d Hz, 1 snapshot/sec (%d samples/frame)\n",
-            FFT_SIZE, BAR_COUNT, SAMPLE_RATE, FRAME_SAMPLES);
+            FFT_SIZE, settings.barCount, SAMPLE_RATE, FRAME_SAMPLES);
+    fprintf(stderr, "[vis] pipeline: %s (%s)\n", g_pipeline->name, g_pipeline->desc);
+    configureKernels(true);
+
+    if (g_historyPath != "off") g_history.open(g_historyPath.empty() ? defaultHistoryPath() : g_historyPath);
 
     // --- WebSocket server ---
     WsServer ws;
-    if (!ws.start(WS_PORT)) {
+    ws.preferUring = g_preferUring;
+    if (!ws.start(port)) {
         fprintf(stderr, "[vis] FATAL: could not start WebSocket server\n");
         return 1;
     }
+    g_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ws.setWakeFd(g_wakeFd);
+
+    // --- Worker pool: one thread per core, no more than there can be sources ---
+    WorkerPool pool(std::min(std::max(1, (int)std::thread::hardware_concurrency()), MAX_SOURCES));
+    g_pool = &pool;
+    fprintf(stderr, "[vis] %d DSP worker(s), up to %d sources\n", pool.size(), MAX_SOURCES);
 
-    // --- Current source (default = system default monitor) ---
-    std::string currentSource = "@DEFAULT_MONITOR@";
+    // --- Channels (0 = primary, default = system default monitor) ---
+    std::unique_ptr<Channel> channels[MAX_SOURCES];
     std::atomic<bool> sourceChangeRequested{false};
     std::string pendingSource;
     std::mutex sourceMtx;
 
     // Dynamic send rate (default 30fps = 33ms)
-    std::atomic<int> sendIntervalMs{33};
+    int sendFps = settings.fps;
+    std::atomic<int> sendIntervalMs{1000 / sendFps};
+
+    // Reply storage for command responses, reused so that replying to a
+    // command never allocates.
+    char reply[512];
+
+    // Render-latency echoes, per client slot (network thread only).
+    ClientLatency latency[WS_MAX_CLIENTS];
+    // Display-rate clients (SET_REFRESH); hz == 0 gets hop frames at SET_FPS.
+    RefreshClock refresh[WS_MAX_CLIENTS];
+    // SET_LOUDNESS and SET_LAYERS subscribers (network thread only).
+    uint32_t loudnessSet = 0, layersSet = 0;
+    // HISTORY: answers still being sent, per client slot.
+    HistoryReply historyOut[WS_MAX_CLIENTS];
+    uint8_t historyFrame[WS_MAX_TX_PAYLOAD];
+    // TRIGGER rules (the master copy the workers' snapshot is made from),
+    // and the clients that get their events instead of bar frames.
+    static TriggerSet triggerRules;
+    uint32_t triggerClients = 0;
+    auto publishTriggers = [&]() {
+        g_triggerSet.publish(new TriggerSet(triggerRules));
+        g_triggers = triggerRules.count > 0;
+        triggerClients = triggerRules.clients();
+    };
+    // Channel a client streams PCM into, or -1.
+    auto ingestChannel = [&](int client) {
+        for (int i = 1; i < MAX_SOURCES; i++)
+            if (channels[i] && channels[i]->owner == client) return i;
+        return -1;
+    };
+    auto stopIngest = [&](int i) {
+        fprintf(stderr, "[vis] PCM ingest on channel %d from client %d stopped\n", i, channels[i]->owner);
+        stopChannel(channels[i].get());
+        channels[i].reset();
+    };
+    // An added source nobody is subscribed to any more.
+    auto dropSource = [&](int i) {
+        fprintf(stderr, "[vis] Source %d removed, its client left\n", i);
+        stopChannel(channels[i].get());
+        channels[i].reset();
+    };
+
+    ws.onConnect = [&](int client) {
+        latency[client].clear();
+        refresh[client].set(0, 0);
+        loudnessSet &= ~(1u << client);
+        g_loudness = loudnessSet != 0;
+        layersSet &= ~(1u << client);
+        g_layers = layersSet != 0;
+        historyOut[client].cancel();
+        if (triggerRules.remove(client, -1)) publishTriggers();
+        // The slot's previous client left without PCM_STOP
+        if (int i = ingestChannel(client); i >= 0) stopIngest(i);
+        // ...or without REMOVE_SOURCE: its sources must not reach the newcomer
+        for (int i = 1; i < MAX_SOURCES; i++)
+            if (channels[i] && channels[i]->owner < 0 && !(channels[i]->clientSet &= ~(1u << client)))
+                dropSource(i);
+    };
+    ws.onBinary = [&](int client, const uint8_t* data, size_t len) {
+        int i = ingestChannel(client);
+        if (i < 0) return;
+        Channel* ch = channels[i].get();
+        ch->ingest.push(data, len, [ch](const float* mono) { ingestChunk(ch, mono); });
+    };
+
+    // GET_METRICS reply; sized to the largest frame the server will queue.
+    char metrics[WS_MAX_TX_PAYLOAD];
+    auto buildMetrics = [&]() -> int {
+        size_t cap = sizeof(metrics);
+        int len = snprintf(metrics, cap, "{\"metrics\":{\"backend\":\"%s\",\"clients\":%d,\"fps\":%d,\"channels\":[",
+                           ws.backendName(), ws.clientCount(), 1000 / sendIntervalMs.load());
+        bool first = true;
+        char source[256];
+        for (int i = 0; i < MAX_SOURCES && (size_t)len < cap; i++) {
+            if (!channels[i]) continue;
+            jsonEscape(channels[i]->source, source, sizeof(source));
+            len += snprintf(metrics + len, cap - len, "%s{\"channel\":%d,\"source\":\"%s\",\"dropped\":%u}",
+                            first ? "" : ",", i, source, channels[i]->dropped.load());
+            first = false;
+        }
+        if ((size_t)len < cap) len += snprintf(metrics + len, cap - len, "],\"latency\":[");
+        first = true;
+        for (int i = 0; i < WS_MAX_CLIENTS && (size_t)len < cap; i++) {
+            if (latency[i].echoes == 0 && latency[i].unmatched == 0) continue;
+            len += snprintf(metrics + len, cap - len, "%s{\"client\":%d,\"stats\":", first ? "" : ",", i);
+            if ((size_t)len >= cap) break;
+            int n = latency[i].toJson(metrics + len, cap - len);
+            if (n < 0) return -1;
+            len += n;
+            if ((size_t)len < cap) len += snprintf(metrics + len, cap - len, "}");
+            first = false;
+        }
+        if ((size_t)len < cap) len += snprintf(metrics + len, cap - len, "]}}");
+        return (size_t)len < cap ? len : -1;
+    };
+
+    // Re-read the settings file (SIGHUP, or RELOAD_CONFIG from `client`).
+    // The new tuning reaches the workers in a config snapshot, so the
+    // streams and their smoothing / gain state carry on.  The layout and
+    // send rate clients chose are kept while the new lists allow them.
+    auto reloadSettings = [&](int client) {
+        VisSettings next;
+        std::string err;
+        if (!loadSettings(g_settingsPath, next, err)) {
+            fprintf(stderr, "[vis] settings reload failed, keeping current: %s: %s\n",
+                    g_settingsPath.c_str(), err.c_str());
+            for (char& c : err) if (c == '"' || c == '\\') c = '\'';
+            int n = snprintf(reply, sizeof(reply), "{\"configError\":\"%s\"}", err.c_str());
+            if (client >= 0) ws.sendTextTo(client, std::string_view(reply, std::min(n, (int)sizeof(reply) - 1)));
+            return;
+        }
+        if (next.port != port)
+            fprintf(stderr, "[vis] port %d takes effect on restart\n", next.port);
+
+        int count;
+        float freq;
+        currentConfig(&count, &freq);
+        bool countOk = settingsAllow(next.barCounts, count) || count == next.barCount;
+        bool freqOk  = settingsAllow(next.freqMaxes, (int)freq) || freq == next.freqMax;
+        publishConfig(countOk ? count : next.barCount, freqOk ? freq : next.freqMax, next.tune);
+        if (!countOk || !freqOk) configureKernels(false);
+        if (!countOk) {
+            int n = snprintf(reply, sizeof(reply), "{\"barCountChanged\":%d}", next.barCount);
+            ws.sendText(std::string_view(reply, n));
+        }
+        if (!freqOk) {
+            int n = snprintf(reply, sizeof(reply), "{\"freqMaxChanged\":%d}", (int)next.freqMax);
+            ws.sendText(std::string_view(reply, n));
+        }
+        if (!settingsAllow(next.fpsRates, sendFps)) {
+            sendFps = next.fps;
+            sendIntervalMs = 1000 / sendFps;
+            int n = snprintf(reply, sizeof(reply), "{\"fpsChanged\":%d}", sendFps);
+            ws.sendText(std::string_view(reply, n));
+        }
+        settings = next;
+        fprintf(stderr, "[vis] settings reloaded from %s\n", g_settingsPath.c_str());
+        ws.sendText("{\"configReloaded\":true}");
+    };
 
     // Handle text commands from WebSocket client
-    ws.onText = [&](const std::string& msg) {
-        if (msg == "GET_SOURCES") {
+    ws.onText = [&](int client, std::string_view msg) {
+        int fps = 0, freq = 0, count = 0, id = 0, hz = 0, on = 0;
+        if (msg.substr(0, 8) == "LATENCY:") {
+            uint32_t seq;
+            double recvMs, paintMs;
+            int64_t sentNs, originNs;
+            if (!parseLatencyEcho(msg.substr(8), &seq, &recvMs, &paintMs)) return;
+            if (!ws.sentFrame(client, seq, &sentNs, &originNs)) {
+                latency[client].unmatched++;
+                return;
+            }
+            latency[client].add(originNs ? (sentNs - originNs) / 1e6f : 0.0f,
+                                (WsServer::nowNs() - sentNs) / 1e6f, (float)(paintMs - recvMs));
+        } else if (msg == "GET_METRICS") {
+            int n = buildMetrics();
+            if (n > 0) ws.sendTextTo(client, std::string_view(metrics, n));
+        } else if (msg == "RELOAD_CONFIG") {
+            reloadSettings(client);
+        } else if (msg == "GET_SOURCES") {
             auto sources = enumerateSources();
             std::string json = buildSourcesJson(sources);
-            fprintf(stderr, "[vis] Sending %zu sources to client\n", sources.size());
-            ws.sendText(json);
-        } else if (msg.rfind("SET_SOURCE:", 0) == 0) {
-            std::string src = msg.substr(11);
-            fprintf(stderr, "[vis] Source change requested: %s\n", src.c_str());
+            fprintf(stderr, "[vis] Sending %zu sources to client %d\n", sources.size(), client);
+            ws.sendTextTo(client, json);
+        } else if (msg.substr(0, 11) == "SET_SOURCE:") {
+            std::string_view src = msg.substr(11);
+            if (channels[0]->replay) {
+                ws.sendTextTo(client, "{\"sourceError\":\"Replaying, the source is fixed\"}");
+                return;
+            }
+            fprintf(stderr, "[vis] Source change requested: %.*s\n", (int)src.size(), src.data());
             std::lock_guard<std::mutex> lock(sourceMtx);
-            pendingSource = src;
+            pendingSource.assign(src.data(), src.size());
             sourceChangeRequested = true;
-        } else if (msg.rfind("SET_FPS:", 0) == 0) {
-            int fps = std::atoi(msg.substr(8).c_str());
-            if (fps == 24 || fps == 30 || fps == 60) {
+        } else if (msg.substr(0, 11) == "ADD_SOURCE:") {
+            std::string src(msg.substr(11));
+            int slot = 1;
+            while (slot < MAX_SOURCES && channels[slot]) slot++;
+            pa_simple* pa = slot < MAX_SOURCES ? openCapture(src) : nullptr;
+            if (!pa) {
+                int n = snprintf(reply, sizeof(reply), "{\"sourceError\":\"%s\"}",
+                                 slot < MAX_SOURCES ? "Failed to connect to source" : "Too many sources");
+                ws.sendTextTo(client, std::string_view(reply, n));
+                return;
+            }
+            auto ch = std::make_unique<Channel>();
+            ch->id = slot;
+            ch->source = src;
+            ch->pa = pa;
+            ch->clientSet = 1u << client;
+            startChannel(ch.get());
+            channels[slot] = std::move(ch);
+            fprintf(stderr, "[vis] Source %d added: %s\n", slot, src.c_str());
+            char name[256];
+            jsonEscape(src, name, sizeof(name));
+            int n = snprintf(reply, sizeof(reply), "{\"sourceAdded\":{\"channel\":%d,\"name\":\"%s\"}}",
+                             slot, name);
+            ws.sendTextTo(client, std::string_view(reply, std::min(n, (int)sizeof(reply) - 1)));
+        } else if (msg.substr(0, 10) == "PCM_START:") {
+            int i = ingestChannel(client);
+            const bool fresh = i < 0;
+            if (fresh) {
+                i = 1;
+                while (i < MAX_SOURCES && channels[i]) i++;
+            }
+            PcmIngest spec;
+            const char* err = i >= MAX_SOURCES ? "Too many sources"
+                            : !spec.start(msg.substr(10)) ? "Bad PCM format" : nullptr;
+            if (err) {
+                int n = snprintf(reply, sizeof(reply), "{\"pcmError\":\"%s\"}", err);
+                ws.sendTextTo(client, std::string_view(reply, n));
+                return;
+            }
+            if (fresh) {
+                auto ch = std::make_unique<Channel>();
+                ch->id = i;
+                ch->owner = client;
+                ch->clientSet = 1u << client;
+                channels[i] = std::move(ch);
+            }
+            // A restart with a new format keeps the channel, not the state
+            Channel* ch = channels[i].get();
+            ch->ingest.start(msg.substr(10));
+            ch->source.assign("pcm:").append(msg.substr(10));
+            ch->reset = true;
+            fprintf(stderr, "[vis] PCM ingest on channel %d from client %d: %s\n", i, client, ch->source.c_str() + 4);
+            int n = snprintf(reply, sizeof(reply), "{\"pcmStarted\":%d}", i);
+            ws.sendTextTo(client, std::string_view(reply, n));
+        } else if (msg == "PCM_STOP") {
+            int i = ingestChannel(client);
+            if (i >= 0) {
+                stopIngest(i);
+                int n = snprintf(reply, sizeof(reply), "{\"pcmStopped\":%d}", i);
+                ws.sendTextTo(client, std::string_view(reply, n));
+            }
+        } else if (commandInt(msg, "REMOVE_SOURCE:", &id)) {
+            // PCM ingest channels end with their client's PCM_STOP
+            if (id >= 1 && id < MAX_SOURCES && channels[id] && channels[id]->owner < 0) {
+                stopChannel(channels[id].get());
+                channels[id].reset();
+                fprintf(stderr, "[vis] Source %d removed\n", id);
+                int n = snprintf(reply, sizeof(reply), "{\"sourceRemoved\":%d}", id);
+                ws.sendText(std::string_view(reply, n));
+            }
+        } else if (commandInt(msg, "SET_FPS:", &fps)) {
+            if (settingsAllow(settings.fpsRates, fps)) {
+                sendFps = fps;
                 sendIntervalMs = 1000 / fps;
                 fprintf(stderr, "[vis] Send rate changed to %d fps (%d ms)\n", fps, sendIntervalMs.load());
-                ws.sendText("{\"fpsChanged\":" + std::to_string(fps) + "}");
+                int n = snprintf(reply, sizeof(reply), "{\"fpsChanged\":%d}", fps);
+                ws.sendText(std::string_view(reply, n));
+            }
+        } else if (commandInt(msg, "SET_REFRESH:", &hz)) {
+            if (hz == 0 || (hz >= MIN_REFRESH_HZ && hz <= MAX_REFRESH_HZ)) {
+                refresh[client].set(hz, WsServer::nowNs());
+                if (hz) fprintf(stderr, "[vis] Client %d refresh set to %d Hz\n", client, hz);
+                else fprintf(stderr, "[vis] Client %d back to hop-rate frames\n", client);
+                int n = snprintf(reply, sizeof(reply), "{\"refreshChanged\":%d}", hz);
+                ws.sendTextTo(client, std::string_view(reply, n));
+            }
+        } else if (commandInt(msg, "SET_LOUDNESS:", &on)) {
+            if (on == 0 || on == 1) {
+                if (on) loudnessSet |= 1u << client;
+                else loudnessSet &= ~(1u << client);
+                g_loudness = loudnessSet != 0;
+                fprintf(stderr, "[vis] Client %d loudness meter %s\n", client, on ? "on" : "off");
+                int n = snprintf(reply, sizeof(reply), "{\"loudnessChanged\":%d}", on);
+                ws.sendTextTo(client, std::string_view(reply, n));
             }
-        } else if (msg.rfind("SET_FREQ_MAX:", 0) == 0) {
-            int freq = std::atoi(msg.substr(13).c_str());
-            if (freq == 10000 || freq == 12000 || freq == 14000 || freq == 16000 || freq == 18000) {
-                g_freqMax = (float)freq;
-                initProcessor();
+        } else if (commandInt(msg, "SET_LAYERS:", &on)) {
+            if (on == 0 || on == 1) {
+                if (on) layersSet |= 1u << client;
+                else layersSet &= ~(1u << client);
+                g_layers = layersSet != 0;
+                fprintf(stderr, "[vis] Client %d harmonic/percussive layers %s\n", client, on ? "on" : "off");
+                int n = snprintf(reply, sizeof(reply), "{\"layersChanged\":%d}", on);
+                ws.sendTextTo(client, std::string_view(reply, n));
+            }
+        } else if (msg.substr(0, 8) == "HISTORY:") {
+            int64_t fromMs, toMs;
+            int columns;
+            bool mean;
+            const char* err = nullptr;
+            if (!g_history.isOpen()) err = "History is off";
+            else if (!parseHistoryQuery(msg.substr(8), &fromMs, &toMs, &columns, &mean)) err = "Bad query";
+            else {
+                std::lock_guard<std::mutex> hl(g_historyMtx);
+                if (!historyOut[client].start(g_history, fromMs, toMs, columns, mean)) err = "Nothing in range";
+            }
+            if (err) {
+                int n = snprintf(reply, sizeof(reply), "{\"historyError\":\"%s\"}", err);
+                ws.sendTextTo(client, std::string_view(reply, n));
+            }
+        } else if (msg.substr(0, 8) == "TRIGGER:") {
+            TriggerRule rule{};
+            const char* err = nullptr;
+            if (!parseTrigger(msg.substr(8), &rule)) err = "Bad rule";
+            else {
+                rule.client = client;
+                if (!triggerRules.put(rule)) err = "Too many rules";
+            }
+            int n;
+            if (err) {
+                n = snprintf(reply, sizeof(reply), "{\"triggerError\":\"%s\"}", err);
+            } else {
+                publishTriggers();
+                fprintf(stderr, "[vis] Client %d trigger %d on channel %d bars %d-%d\n",
+                        client, rule.id, rule.channel, rule.firstBar, rule.lastBar);
+                n = snprintf(reply, sizeof(reply), "{\"triggerAdded\":%d}", rule.id);
+            }
+            ws.sendTextTo(client, std::string_view(reply, n));
+        } else if (commandInt(msg, "TRIGGER_CLEAR:", &id)) {
+            int n;
+            if (triggerRules.remove(client, id)) {
+                publishTriggers();
+                n = snprintf(reply, sizeof(reply), "{\"triggerRemoved\":%d}", id);
+            } else {
+                n = snprintf(reply, sizeof(reply), "{\"triggerError\":\"No such rule\"}");
+            }
+            ws.sendTextTo(client, std::string_view(reply, n));
+        } else if (commandInt(msg, "SET_FREQ_MAX:", &freq)) {
+            if (settingsAllow(settings.freqMaxes, freq)) {
+                publishFreqMax((float)freq);
+                configureKernels(false);
                 fprintf(stderr, "[vis] Freq max changed to %d Hz\n", freq);
-                ws.sendText("{\"freqMaxChanged\":" + std::to_string(freq) + "}");
+                int n = snprintf(reply, sizeof(reply), "{\"freqMaxChanged\":%d}", freq);
+                ws.sendText(std::string_view(reply, n));
             }
-        } else if (msg.rfind("SET_BAR_COUNT:", 0) == 0) {
-            int count = std::atoi(msg.substr(14).c_str());
-            if (count == 8 || count == 16 || count == 24 || count == 36 || count == 72 || count == 100 || count == 144) {
-                g_barCount = count;
-                initProcessor();
+        } else if (commandInt(msg, "SET_BAR_COUNT:", &count)) {
+            if (settingsAllow(settings.barCounts, count)) {
+                publishBarCount(count);
+                configureKernels(false);
                 fprintf(stderr, "[vis] Bar count changed to %d\n", count);
-                ws.sendText("{\"barCountChanged\":" + std::to_string(count) + "}");
+                int n = snprintf(reply, sizeof(reply), "{\"barCountChanged\":%d}", count);
+                ws.sendText(std::string_view(reply, n));
             }
         }
     };
 
-    // --- PulseAudio capture (reconnectable) ---
-    pa_simple* pa = nullptr;
-    auto connectPA = [&](const std::string& sourceName) -> bool {
-        if (pa) { pa_simple_free(pa); pa = nullptr; }
-
-        pa_sample_spec spec{};
-        spec.format   = PA_SAMPLE_FLOAT32LE;
-        spec.rate     = SAMPLE_RATE;
-        spec.channels = 1;
-
-        pa_buffer_attr battr{};
-        battr.maxlength = (uint32_t)-1;
-        battr.tlength   = (uint32_t)-1;
-        battr.prebuf    = (uint32_t)-1;
-        battr.minreq    = (uint32_t)-1;
-        battr.fragsize  = FRAME_SAMPLES * sizeof(float);
-
-        int paErr;
-        pa = pa_simple_new(
-            nullptr, "ClearVis", PA_STREAM_RECORD,
-            sourceName.c_str(), "Audio Visualizer",
-            &spec, nullptr, &battr, &paErr
-        );
-        if (!pa) {
-            fprintf(stderr, "[vis] pa_simple_new(%s): %s\n", sourceName.c_str(), pa_strerror(paErr));
-            return false;
+    // --- PulseAudio capture for the primary channel ---
+    channels[0] = std::make_unique<Channel>();
+    if (!g_replay.empty()) {
+        std::string err;
+        channels[0]->replay = std::make_unique<ReplaySource>();
+        if (!channels[0]->replay->open(g_replay, err)) {
+            fprintf(stderr, "[vis] FATAL: --replay %s: %s\n", g_replay.c_str(), err.c_str());
+            return 1;
         }
-        fprintf(stderr, "[vis] PulseAudio connected to: %s\n", sourceName.c_str());
-        return true;
-    };
-
-    if (!connectPA(currentSource)) {
+        channels[0]->source = "replay:" + g_replay;
+        fprintf(stderr, "[vis] Replaying %s\n", g_replay.c_str());
+    } else {
+        channels[0]->source = "@DEFAULT_MONITOR@";
+        channels[0]->pa = openCapture(channels[0]->source);
+    }
+    if (!channels[0]->pa && !channels[0]->replay) {
         fprintf(stderr, "[vis] FATAL: could not connect to default monitor\n");
         return 1;
     }
+    startChannel(channels[0].get());
 
-    // --- Main loop ---
-    initProcessor();
-    float chunk[FRAME_SAMPLES];
+    // --- Main loop: network, source management, sending ---
     float bars[MAX_BAR_COUNT];
+    uint8_t tagged[FRAME_TAG_BYTES + MAX_BAR_COUNT * sizeof(float)];
     bool wasIdle = true;
     auto lastSend = std::chrono::steady_clock::now();
 
-    fprintf(stderr, "[vis] Waiting for client on ws://127.0.0.1:%d\n", WS_PORT);
+    // Queue one channel's bars to a set of clients: bare for the primary
+    // channel, tagged for the others.
+    auto sendTagged = [&](uint32_t clientSet, int kind, int channel, const float* v, int n, int64_t originNs) {
+        tagged[0] = (uint8_t)kind;
+        tagged[1] = (uint8_t)channel;
+        tagged[2] = (uint8_t)(n & 0xFF);
+        tagged[3] = (uint8_t)(n >> 8);
+        memcpy(tagged + FRAME_TAG_BYTES, v, n * sizeof(float));
+        ws.sendBinaryTo(clientSet, tagged, FRAME_TAG_BYTES + n * sizeof(float), originNs);
+    };
+    auto sendBars = [&](uint32_t clientSet, int channel, int n, int64_t originNs) {
+        if (channel == 0) ws.sendBinaryTo(clientSet, bars, n * sizeof(float), originNs);
+        else sendTagged(clientSet, FRAME_KIND_BARS, channel, bars, n, originNs);
+    };
+
+    fprintf(stderr, "[vis] Waiting for client on ws://127.0.0.1:%d\n", port);
 
     while (g_running) {
-        ws.poll();
+        if (g_reloadRequested.exchange(false)) reloadSettings(-1);
 
-        // Handle source change request
+        // Handle source change request for the primary channel
         if (sourceChangeRequested) {
             std::string newSrc;
             {
@@ -233,55 +968,212 @@ int main() {
                 newSrc = pendingSource;
                 sourceChangeRequested = false;
             }
-            if (newSrc != currentSource) {
-                if (connectPA(newSrc)) {
-                    currentSource = newSrc;
-                    initProcessor();
-                    ws.sendText("{\"sourceChanged\":\"" + currentSource + "\"}");
+            Channel* ch0 = channels[0].get();
+            if (newSrc != ch0->source) {
+                stopChannel(ch0);
+                ch0->pa = openCapture(newSrc);
+                if (ch0->pa) {
+                    ch0->source = newSrc;
+                    char name[256];
+                    jsonEscape(ch0->source, name, sizeof(name));
+                    int n = snprintf(reply, sizeof(reply), "{\"sourceChanged\":\"%s\"}", name);
+                    ws.sendText(std::string_view(reply, std::min(n, (int)sizeof(reply) - 1)));
                 } else {
-                    fprintf(stderr, "[vis] Failed to switch, reverting to %s\n", currentSource.c_str());
-                    connectPA(currentSource);
+                    fprintf(stderr, "[vis] Failed to switch, reverting to %s\n", ch0->source.c_str());
+                    ch0->pa = openCapture(ch0->source);
                     ws.sendText("{\"sourceError\":\"Failed to connect to source\"}");
                 }
+                if (ch0->pa) startChannel(ch0);
+                else ch0->failed = true;
             }
         }
 
+        // A failed primary capture is fatal (as before); a failed extra
+        // source is dropped and the client told.
+        if (channels[0]->failed) break;
+        for (int i = 1; i < MAX_SOURCES; i++) {
+            // PCM ingest whose client has gone
+            if (channels[i] && channels[i]->owner >= 0 && !(ws.clientSet() >> channels[i]->owner & 1)) {
+                stopIngest(i);
+                continue;
+            }
+            // Added source whose client has gone
+            if (channels[i] && channels[i]->owner < 0 && !(channels[i]->clientSet & ws.clientSet())) {
+                dropSource(i);
+                continue;
+            }
+            if (channels[i] && channels[i]->failed) {
+                stopChannel(channels[i].get());
+                channels[i].reset();
+                int n = snprintf(reply, sizeof(reply), "{\"sourceRemoved\":%d}", i);
+                ws.sendText(std::string_view(reply, n));
+            }
+        }
+
+        g_streaming = ws.hasClient();
         if (!ws.hasClient()) {
             wasIdle = true;
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            ws.poll();
+            ws.wait(WsServer::nowNs() + 50000000);
             continue;
         }
 
-        // Client just connected — flush stale audio, reset processor
+        // First client connected — capture threads flush and reset themselves
         if (wasIdle) {
-            pa_simple_flush(pa, nullptr);
-            initProcessor();
             wasIdle = false;
             lastSend = std::chrono::steady_clock::now();
-            fprintf(stderr, "[vis] Client connected, streaming 1 snapshot/sec\n");
+            fprintf(stderr, "[vis] Client connected, streaming\n");
         }
 
-        // Blocking read of exactly FRAME_SAMPLES (~16.67ms at 44100 Hz).
-        int paErr;
-        int ret = pa_simple_read(pa, chunk, sizeof(chunk), &paErr);
-        if (ret < 0) {
-            fprintf(stderr, "[vis] pa_simple_read: %s\n", pa_strerror(paErr));
-            break;
+        // Clients on a display clock vs. those taking hop frames at SET_FPS
+        int64_t nowNs = WsServer::nowNs();
+        uint32_t connected = ws.clientSet(), refreshSet = 0, dueSet = 0;
+        // (trigger clients get neither)
+        for (int c = 0; c < WS_MAX_CLIENTS; c++) {
+            if (!(connected >> c & 1) || !refresh[c].hz || (triggerClients >> c & 1)) continue;
+            refreshSet |= 1u << c;
+            if (refresh[c].due(nowNs)) dueSet |= 1u << c;
         }
+        const uint32_t legacySet = connected & ~refreshSet & ~triggerClients;
 
-        // Process: sliding-window FFT, binning, AGC, gravity smoothing
-        processFrame(chunk, bars);
-
-        // Send bars at configured frame rate
+        // Send each channel's newest bars at the configured frame rate
         auto now = std::chrono::steady_clock::now();
-        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - lastSend).count() >= sendIntervalMs.load()) {
-            ws.sendBinary(bars, g_barCount * sizeof(float));
+        auto interval = std::chrono::milliseconds(sendIntervalMs.load());
+        if (now - lastSend >= interval) {
+            for (int i = 0; i < MAX_SOURCES; i++) {
+                Channel* ch = channels[i].get();
+                if (!ch) continue;
+                int n;
+                int64_t stamp;
+                {
+                    std::lock_guard<std::mutex> lock(ch->outMtx);
+                    if (ch->outSeq == ch->sentSeq) continue;
+                    ch->sentSeq = ch->outSeq;
+                    n = ch->outCount;
+                    stamp = ch->outStamp;
+                    memcpy(bars, ch->out, n * sizeof(float));
+                }
+                if (legacySet & ch->clientSet) sendBars(legacySet & ch->clientSet, i, n, stamp);
+            }
+            // Layers go at the same rate, to their subscribers only
+            for (int i = 0; i < MAX_SOURCES && layersSet; i++) {
+                Channel* ch = channels[i].get();
+                if (!ch) continue;
+                const uint32_t to = layersSet & connected & ch->clientSet;
+                std::lock_guard<std::mutex> lock(ch->outMtx);
+                if (!to || ch->layerSeq == ch->layerSentSeq) continue;
+                ch->layerSentSeq = ch->layerSeq;
+                sendTagged(to, FRAME_KIND_HARMONIC, i, ch->outLayers[0], ch->layerCount, ch->layerStamp);
+                sendTagged(to, FRAME_KIND_PERCUSSIVE, i, ch->outLayers[1], ch->layerCount, ch->layerStamp);
+            }
             lastSend = now;
         }
+
+        // Loudness readings, 10 per second per source, to subscribers
+        if (loudnessSet) {
+            for (int i = 0; i < MAX_SOURCES; i++) {
+                Channel* ch = channels[i].get();
+                if (!ch) continue;
+                LoudnessReading loud;
+                {
+                    std::lock_guard<std::mutex> lock(ch->outMtx);
+                    if (ch->loudSeq == ch->loudSentSeq) continue;
+                    ch->loudSentSeq = ch->loudSeq;
+                    loud = ch->loud;
+                }
+                int n = loudnessJson(reply, sizeof(reply), i, loud);
+                const uint32_t to = loudnessSet & connected & ch->clientSet;
+                for (int c = 0; c < WS_MAX_CLIENTS && n > 0; c++)
+                    if (to >> c & 1) ws.sendTextTo(c, std::string_view(reply, n));
+            }
+        }
+
+        // Trigger events, as soon as the pass after they fired
+        for (int i = 0; i < MAX_SOURCES && g_triggers; i++) {
+            Channel* ch = channels[i].get();
+            if (!ch) continue;
+            TriggerEvent fired[TRIGGER_EVENT_QUEUE];
+            int nFired;
+            {
+                std::lock_guard<std::mutex> lock(ch->outMtx);
+                nFired = ch->eventCount;
+                memcpy(fired, ch->events, nFired * sizeof(TriggerEvent));
+                ch->eventCount = 0;
+            }
+            for (int k = 0; k < nFired; k++) {
+                const TriggerEvent& e = fired[k];
+                // Skip rules removed (or clients gone) since it fired
+                if (!triggerRules.find(e.uid) || !((connected & ch->clientSet) >> e.client & 1)) continue;
+                int n = triggerJson(reply, sizeof(reply), e);
+                if (n > 0) ws.sendTextTo(e.client, std::string_view(reply, n));
+            }
+        }
+
+        // History answers, a couple of frames per pass so bar frames keep
+        // their place in the client's queue
+        for (int c = 0; c < WS_MAX_CLIENTS; c++) {
+            HistoryReply& h = historyOut[c];
+            for (int k = 0; k < 2 && h.pending(); k++) {
+                int taken;
+                size_t len = h.encode(historyFrame, sizeof(historyFrame), &taken);
+                if (!ws.sendBinaryTo(1u << c, historyFrame, len)) break;
+                h.next += taken;
+            }
+        }
+
+        // Display-rate clients: every new hop output becomes a keyframe,
+        // and each due client gets the bars interpolated at render time
+        for (int i = 0; i < MAX_SOURCES; i++) {
+            Channel* ch = channels[i].get();
+            if (!ch) continue;
+            if (!refreshSet) {
+                ch->interp.clear();             // no stale keys when one appears
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(ch->outMtx);
+            if (ch->outSeq == ch->keySeq) continue;
+            ch->keySeq = ch->outSeq;
+            ch->interp.push(ch->out, ch->outCount, ch->outStamp);
+        }
+        if (dueSet) {
+            const int64_t renderNs = nowNs - INTERP_DELAY_NS;
+            for (int i = 0; i < MAX_SOURCES; i++) {
+                Channel* ch = channels[i].get();
+                if (!ch) continue;
+                int n = ch->interp.sample(renderNs, bars);
+                if (n && (dueSet & ch->clientSet)) sendBars(dueSet & ch->clientSet, i, n, renderNs);
+            }
+        }
+
+        // One network hop: the frames just queued for every client, any
+        // command replies, and reads of incoming commands all go out
+        // together (a single io_uring submission when available).
+        ws.poll();
+
+        // Free config and trigger snapshots the workers have moved past
+        g_config.reclaim();
+        g_triggerSet.reclaim();
+
+        // Sleep until the next send is due.  Connections, commands and
+        // worker output that can't wait (ws.wait() and wakeNetwork())
+        // cut it short; a history answer in progress goes on soon.
+        bool historyPending = false;
+        for (const HistoryReply& h : historyOut) historyPending |= h.pending();
+        int64_t wakeNs = nowNs + (historyPending ? 5000000 : 100000000);
+        if (legacySet)
+            wakeNs = std::min(wakeNs, (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          (lastSend + interval).time_since_epoch()).count());
+        for (int c = 0; c < WS_MAX_CLIENTS; c++)
+            if (refreshSet >> c & 1) wakeNs = std::min(wakeNs, refresh[c].nextNs);
+        ws.wait(wakeNs);
     }
 
     fprintf(stderr, "\n[vis] Shutting down...\n");
-    if (pa) pa_simple_free(pa);
+    for (auto& ch : channels)
+        if (ch) stopChannel(ch.get());
+    g_pool = nullptr;
+    stopKernelTuner();
     ws.stop();
+    close(g_wakeFd);
     return 0;
 }
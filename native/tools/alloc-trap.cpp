@@ -0,0 +1,113 @@
+// alloc-trap.cpp — LD_PRELOAD shim for vis-alloc: counts heap
+// allocations inside a window the driver opens and closes with signals.
+//   SIGUSR1  arm: count from now on
+//   SIGUSR2  disarm
+// malloc and friends are interposed and forwarded to glibc's __libc_*
+// entry points; operator new lands here through malloc.  The first few
+// armed allocations keep a backtrace.  At exit the totals and those
+// backtraces go to the file named by VIS_ALLOC_REPORT; no report means
+// the process did not exit cleanly.
+//
+// Build:  make (alloc-trap.so)
+// glibc only.
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <csignal>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void* __libc_memalign(size_t, size_t);
+void  __libc_free(void*);
+}
+
+constexpr int TRAP_SAMPLES = 8;         // allocations that keep a backtrace
+constexpr int TRAP_DEPTH   = 16;        // frames per backtrace
+
+struct Sample {
+    size_t size;
+    long   tid;
+    int    depth;
+    void*  frames[TRAP_DEPTH];
+};
+
+static std::atomic<bool>     g_armed{false};
+static std::atomic<uint64_t> g_allocs{0}, g_bytes{0};
+static std::atomic<int>      g_sampled{0};
+static Sample                g_samples[TRAP_SAMPLES];
+static int                   g_reportFd = -1;
+static __thread bool         t_inTrap;  // backtrace() itself may allocate
+
+static void note(size_t size) {
+    if (!g_armed.load(std::memory_order_relaxed) || t_inTrap) return;
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_bytes.fetch_add(size, std::memory_order_relaxed);
+    int i = g_sampled.fetch_add(1, std::memory_order_relaxed);
+    if (i >= TRAP_SAMPLES) return;
+    t_inTrap = true;
+    Sample& s = g_samples[i];
+    s.size = size;
+    s.tid = syscall(SYS_gettid);
+    s.depth = backtrace(s.frames, TRAP_DEPTH);
+    t_inTrap = false;
+}
+
+extern "C" {
+
+void* malloc(size_t n)                { note(n); return __libc_malloc(n); }
+void* calloc(size_t c, size_t n)      { note(c * n); return __libc_calloc(c, n); }
+void* realloc(void* p, size_t n)      { note(n); return __libc_realloc(p, n); }
+void* memalign(size_t a, size_t n)    { note(n); return __libc_memalign(a, n); }
+void* aligned_alloc(size_t a, size_t n) { note(n); return __libc_memalign(a, n); }
+void  free(void* p)                   { __libc_free(p); }
+
+int posix_memalign(void** out, size_t a, size_t n) {
+    note(n);
+    void* p = __libc_memalign(a, n);
+    if (!p) return ENOMEM;
+    *out = p;
+    return 0;
+}
+
+} // extern "C"
+
+static void onArm(int)    { g_armed.store(true); }
+static void onDisarm(int) { g_armed.store(false); }
+
+__attribute__((constructor)) static void trapInit() {
+    // Load libgcc's unwinder now rather than on the first armed sample
+    void* warm[2];
+    backtrace(warm, 2);
+    const char* path = getenv("VIS_ALLOC_REPORT");
+    if (path) g_reportFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    signal(SIGUSR1, onArm);
+    signal(SIGUSR2, onDisarm);
+}
+
+__attribute__((destructor)) static void trapReport() {
+    if (g_reportFd < 0) return;
+    g_armed.store(false);
+    const uint64_t n = g_allocs.load();
+    dprintf(g_reportFd, "allocations %llu bytes %llu\n", (unsigned long long)n,
+            (unsigned long long)g_bytes.load());
+    const int sampled = n < TRAP_SAMPLES ? (int)n : TRAP_SAMPLES;
+    for (int i = 0; i < sampled; i++) {
+        const Sample& s = g_samples[i];
+        dprintf(g_reportFd, "-- %zu bytes on thread %ld\n", s.size, s.tid);
+        backtrace_symbols_fd((void* const*)s.frames + 1, s.depth - 1, g_reportFd);
+    }
+    close(g_reportFd);
+    g_reportFd = -1;
+}
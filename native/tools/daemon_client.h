@@ -0,0 +1,144 @@
+// daemon_client.h — Shared by the tools that drive a live vis-capture:
+// start it on a replay source with its own settings file, wait for it to
+// listen, talk to it as a minimal WebSocket client, and stop it.
+// Linux only (/proc, fork/exec).  Header-only.
+#ifndef VIS_TOOLS_DAEMON_CLIENT_H
+#define VIS_TOOLS_DAEMON_CLIENT_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+static double nowSec() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Listening on 127.0.0.1:port yet?  Read from /proc so the probe does
+// not itself show up as a client.
+static bool portListening(int port) {
+    FILE* f = fopen("/proc/net/tcp", "r");
+    if (!f) return false;
+    char line[256], want[16];
+    snprintf(want, sizeof(want), "0100007F:%04X", port);
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f)) {
+        char local[64], remote[64];
+        unsigned state;
+        if (sscanf(line, "%*d: %63s %63s %x", local, remote, &state) == 3)
+            found = state == 0x0A && strcmp(local, want) == 0;
+    }
+    fclose(f);
+    return found;
+}
+
+// Fork and exec the daemon on `source`, output to `log`.  `env` holds
+// NAME=VALUE entries added to its environment.
+static pid_t startDaemon(const std::string& daemon, const std::string& config, const std::string& source,
+                         const std::vector<std::string>& extra, const std::vector<std::string>& env,
+                         const std::string& log) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    for (const std::string& e : env) putenv((char*)e.c_str());
+    int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) { dup2(fd, 2); dup2(fd, 1); close(fd); }
+    std::vector<const char*> argv = { daemon.c_str(), "--config", config.c_str(), "--replay", source.c_str() };
+    for (const std::string& a : extra) argv.push_back(a.c_str());
+    argv.push_back(nullptr);
+    execv(daemon.c_str(), (char* const*)argv.data());
+    fprintf(stderr, "exec %s: %s\n", daemon.c_str(), strerror(errno));
+    _exit(127);
+}
+
+static void stopDaemon(pid_t pid) {
+    kill(pid, SIGTERM);
+    for (int i = 0; i < 50; i++) {
+        if (waitpid(pid, nullptr, WNOHANG) == pid) return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+// ---- WebSocket client ----
+// Just enough to connect, send commands and count the frames that come
+// back (server frames are never masked).
+
+struct WsClient {
+    int fd = -1;
+    std::vector<uint8_t> rx;
+    long binFrames = 0;
+
+    bool connect(int port) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || ::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) return false;
+        const char req[] = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+        if (send(fd, req, sizeof(req) - 1, 0) < 0) return false;
+        // Response headers end with a blank line; frames may follow
+        std::string hdr;
+        char c;
+        while (hdr.size() < 4 || hdr.compare(hdr.size() - 4, 4, "\r\n\r\n") != 0) {
+            if (recv(fd, &c, 1, 0) != 1) return false;
+            hdr += c;
+        }
+        return hdr.compare(0, 12, "HTTP/1.1 101") == 0;
+    }
+
+    bool sendText(const std::string& msg) {
+        std::vector<uint8_t> f = { 0x81, (uint8_t)(0x80 | msg.size()), 0x12, 0x34, 0x56, 0x78 };
+        for (size_t i = 0; i < msg.size(); i++) f.push_back((uint8_t)msg[i] ^ f[2 + i % 4]);
+        return msg.size() < 126 && send(fd, f.data(), f.size(), 0) == (ssize_t)f.size();
+    }
+
+    // Read whatever arrived within timeoutMs and count complete frames.
+    void pump(int timeoutMs) {
+        pollfd p{ fd, POLLIN, 0 };
+        if (poll(&p, 1, timeoutMs) <= 0) return;
+        uint8_t buf[65536];
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return;
+        rx.insert(rx.end(), buf, buf + n);
+        size_t pos = 0;
+        for (;;) {
+            if (rx.size() - pos < 2) break;
+            uint64_t len = rx[pos + 1] & 0x7F;
+            size_t hdr = 2;
+            if (len == 126) {
+                if (rx.size() - pos < 4) break;
+                len = (rx[pos + 2] << 8) | rx[pos + 3];
+                hdr = 4;
+            } else if (len == 127) {
+                if (rx.size() - pos < 10) break;
+                len = 0;
+                for (int i = 0; i < 8; i++) len = (len << 8) | rx[pos + 2 + i];
+                hdr = 10;
+            }
+            if (rx.size() - pos < hdr + len) break;
+            if ((rx[pos] & 0x0F) == 0x02) binFrames++;
+            pos += hdr + len;
+        }
+        rx.erase(rx.begin(), rx.begin() + pos);
+    }
+
+    ~WsClient() { if (fd >= 0) close(fd); }
+};
+
+#endif // VIS_TOOLS_DAEMON_CLIENT_H
@@ -0,0 +1,156 @@
+// vis-alloc.cpp — Fails if the capture daemon allocates while streaming.
+// Starts vis-capture on a replay source (replay.h) with alloc-trap.so
+// preloaded, connects the clients the steady state serves, a hop-rate
+// client echoing LATENCY and polling GET_METRICS, a SET_REFRESH client
+// and a TRIGGER client, and lets everything settle.  Then it arms the
+// trap for a fixed window of replayed streaming and disarms it before
+// shutting the daemon down.  The exit status is non-zero if anything
+// allocated inside the window (the report lists the first backtraces),
+// if the daemon did not start or exit cleanly, or if no frames arrived.
+//
+// Build:  make
+// Run:    ./vis-alloc [--daemon PATH] [--trap FILE.so] [--seconds S] [--warmup S]
+//                     [--replay FILE.f32] [--port N] [-- DAEMON ARGS...]
+//
+// Linux / glibc only.  Backtraces name daemon functions only if it was
+// linked with -rdynamic; otherwise feed the offsets to addr2line.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "daemon_client.h"
+#include "protocol.h"
+
+static std::string readAll(const std::string& path) {
+    std::string s;
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) return s;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) s.append(buf, n);
+    fclose(f);
+    return s;
+}
+
+int main(int argc, char** argv) {
+    std::string daemon = "../linux/vis-capture", trap = "./alloc-trap.so", replay = "synthetic:music";
+    double seconds = 10.0, warmup = 3.0;
+    int port = 7791;
+    std::vector<std::string> extra;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) daemon = argv[++i];
+        else if (strcmp(argv[i], "--trap") == 0 && i + 1 < argc) trap = argv[++i];
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) warmup = atof(argv[++i]);
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replay = argv[++i];
+        else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--") == 0) { extra.assign(argv + i + 1, argv + argc); break; }
+        else {
+            fprintf(stderr, "usage: vis-alloc [--daemon PATH] [--trap FILE.so] [--seconds S] [--warmup S]\n"
+                            "                 [--replay FILE.f32] [--port N] [-- DAEMON ARGS...]\n");
+            return 2;
+        }
+    }
+    if (access(daemon.c_str(), X_OK) != 0) {
+        fprintf(stderr, "[alloc] no daemon at %s (build native/linux or pass --daemon)\n", daemon.c_str());
+        return 2;
+    }
+    char trapPath[4096];
+    if (!realpath(trap.c_str(), trapPath)) {
+        fprintf(stderr, "[alloc] no trap library at %s (make alloc-trap.so or pass --trap)\n", trap.c_str());
+        return 2;
+    }
+    if (seconds <= 0.0 || port <= 0 || port > 65535) {
+        fprintf(stderr, "[alloc] seconds must be > 0 and port 1..65535\n");
+        return 2;
+    }
+
+    char config[] = "/tmp/vis-alloc-XXXXXX";
+    int cfd = mkstemp(config);
+    if (cfd < 0) { perror("[alloc] mkstemp"); return 2; }
+    dprintf(cfd, "port = %d\n", port);
+    close(cfd);
+    const std::string report = std::string(config) + ".report", log = "/tmp/vis-alloc.log";
+    unlink(report.c_str());
+
+    pid_t pid = startDaemon(daemon, config, replay, extra,
+                            { std::string("LD_PRELOAD=") + trapPath, "VIS_ALLOC_REPORT=" + report }, log);
+    double t0 = nowSec();
+    while (!portListening(port) && nowSec() - t0 < 30.0 && waitpid(pid, nullptr, WNOHANG) == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    if (!portListening(port)) {
+        fprintf(stderr, "[alloc] daemon did not start, see %s\n", log.c_str());
+        stopDaemon(pid);
+        unlink(config);
+        return 1;
+    }
+
+    WsClient hop, refresh, trigger;
+    bool ok = hop.connect(port) && hop.sendText("SET_FPS:60") &&
+              refresh.connect(port) && refresh.sendText("SET_REFRESH:144") &&
+              trigger.connect(port) && trigger.sendText("TRIGGER:1,0,0,3,rise,0.05,0.0,100") &&
+              trigger.sendText("TRIGGER:2,0,0,63,level,0.6,0.4,0");
+    if (!ok) {
+        fprintf(stderr, "[alloc] could not connect the clients\n");
+        stopDaemon(pid);
+        unlink(config);
+        return 1;
+    }
+
+    // Steady-state traffic: frames read as they come, a latency echo
+    // every LATENCY_ECHO_EVERY frames, metrics once a second.
+    long echoed = 0;
+    double nextMetrics = 0.0;
+    auto run = [&](double s) {
+        double end = nowSec() + s;
+        while (nowSec() < end) {
+            hop.pump(5);
+            refresh.pump(5);
+            trigger.pump(5);
+            if (hop.binFrames - echoed >= LATENCY_ECHO_EVERY) {
+                echoed = hop.binFrames;
+                double ms = nowSec() * 1000.0;
+                char msg[96];
+                snprintf(msg, sizeof(msg), "LATENCY:%ld,%.3f,%.3f", echoed, ms, ms + 1.0);
+                hop.sendText(msg);
+            }
+            if (nowSec() >= nextMetrics) {
+                nextMetrics = nowSec() + 1.0;
+                hop.sendText("GET_METRICS");
+            }
+        }
+    };
+    run(warmup);
+    long frames0 = hop.binFrames + refresh.binFrames;
+    kill(pid, SIGUSR1);
+    run(seconds);
+    kill(pid, SIGUSR2);
+    long frames = hop.binFrames + refresh.binFrames - frames0;
+    stopDaemon(pid);
+    unlink(config);
+
+    const std::string text = readAll(report);
+    unlink(report.c_str());
+    unsigned long long allocs = 0, bytes = 0;
+    if (sscanf(text.c_str(), "allocations %llu bytes %llu", &allocs, &bytes) != 2) {
+        fprintf(stderr, "[alloc] no report from the daemon (crashed or killed?), see %s\n", log.c_str());
+        return 1;
+    }
+    printf("daemon %s, %.0f s of %s after %.0f s warmup: %ld frames, %llu allocations (%llu bytes)\n",
+           daemon.c_str(), seconds, replay.c_str(), warmup, frames, allocs, bytes);
+    if (frames == 0) {
+        printf("FAIL: no frames arrived, see %s\n", log.c_str());
+        return 1;
+    }
+    if (allocs > 0) {
+        printf("\n%s\nFAIL: the streaming path allocated\n", text.c_str() + text.find('\n') + 1);
+        return 1;
+    }
+    return 0;
+}
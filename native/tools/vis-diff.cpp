@@ -0,0 +1,437 @@
+// vis-diff.cpp — Reference-versus-optimized harness for the DSP kernels.
+// Drives the frozen reference (fft_ref.h) and every pipeline variant in
+// fft.h with the same corpus of synthetic and recorded signals, then
+// reports per-bar max / RMS error, frame-by-frame divergence and
+// throughput, and checks the batched kernels (fft_batch.h) against
+// the same kernel one hop at a time.  Exits non-zero if any variant
+// that claims to match the reference (refMaxErr > 0) drifts past its
+// max or RMS tolerance, or a batched kernel departs from its kernel.
+//
+// Build:  make
+// Run:    ./vis-diff [--bars N] [--freq-max HZ] [--seconds S]
+//                    [--per-bar] [--frames] [FILE.wav | FILE.f32 ...]
+//
+// Recorded inputs are 16-bit PCM or float32 WAV (any channel count,
+// downmixed to mono), or raw mono float32 at SAMPLE_RATE (.f32).
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../common/protocol.h"
+#include "../common/fft.h"
+#include "../common/pipelines.h"
+#include "../common/fft_ref.h"
+
+struct Signal {
+    std::string name;
+    std::vector<float> pcm;   // mono, SAMPLE_RATE
+};
+
+// ---- Synthetic corpus ----
+// Deterministic (fixed LCG seed) so runs are comparable across builds.
+
+static uint32_t g_rng = 12345;
+static float noise() {
+    g_rng = g_rng * 1664525u + 1013904223u;
+    return (float)(g_rng >> 8) / 8388608.0f - 1.0f;
+}
+
+static std::vector<Signal> syntheticCorpus(int seconds) {
+    const int n = seconds * SAMPLE_RATE;
+    const float sr = (float)SAMPLE_RATE;
+    std::vector<Signal> out;
+
+    out.push_back({"silence", std::vector<float>(n, 0.0f)});
+
+    // PA warmup noise: below SILENCE_THRESHOLD, must not move the AGC.
+    Signal warm{"warmup-noise", std::vector<float>(n)};
+    for (int i = 0; i < n; i++) warm.pcm[i] = 5e-5f * noise();
+    out.push_back(warm);
+
+    // Log sine sweep 20 Hz → 20 kHz.
+    Signal sweep{"sine-sweep", std::vector<float>(n)};
+    {
+        double phase = 0.0, k = log(20000.0 / 20.0) / n;
+        for (int i = 0; i < n; i++) {
+            phase += 2.0 * M_PI * 20.0 * exp(k * i) / sr;
+            sweep.pcm[i] = 0.5f * (float)sin(phase);
+        }
+    }
+    out.push_back(sweep);
+
+    Signal white{"white-noise", std::vector<float>(n)};
+    for (int i = 0; i < n; i++) white.pcm[i] = 0.3f * noise();
+    out.push_back(white);
+
+    // Pink noise (Paul Kellet's economy filter).
+    Signal pink{"pink-noise", std::vector<float>(n)};
+    {
+        float b0 = 0, b1 = 0, b2 = 0;
+        for (int i = 0; i < n; i++) {
+            float w = noise();
+            b0 = 0.99765f * b0 + w * 0.0990460f;
+            b1 = 0.96300f * b1 + w * 0.2965164f;
+            b2 = 0.57000f * b2 + w * 1.0526913f;
+            pink.pcm[i] = 0.1f * (b0 + b1 + b2 + w * 0.1848f);
+        }
+    }
+    out.push_back(pink);
+
+    // Kick + hi-hat pattern at 120 BPM: transients for attack/gravity.
+    Signal beat{"kick-hat", std::vector<float>(n)};
+    for (int i = 0; i < n; i++) {
+        float t = (float)(i % (SAMPLE_RATE / 2)) / sr;
+        float th = (float)((i + SAMPLE_RATE / 4) % (SAMPLE_RATE / 2)) / sr;
+        float kick = 0.8f * expf(-t * 12.0f) * sinf(2.0f * (float)M_PI * (50.0f + 80.0f * expf(-t * 30.0f)) * t);
+        float hat = 0.2f * expf(-th * 60.0f) * noise();
+        beat.pcm[i] = kick + hat;
+    }
+    out.push_back(beat);
+
+    // Sustained chord with amplitude steps every second.
+    Signal chord{"chord-steps", std::vector<float>(n)};
+    for (int i = 0; i < n; i++) {
+        float t = (float)i / sr;
+        float amp = ((i / SAMPLE_RATE) % 3 == 0) ? 0.05f : ((i / SAMPLE_RATE) % 3 == 1 ? 0.4f : 0.9f);
+        chord.pcm[i] = amp * (0.33f * sinf(2.0f * (float)M_PI * 220.0f * t) +
+                              0.33f * sinf(2.0f * (float)M_PI * 277.2f * t) +
+                              0.33f * sinf(2.0f * (float)M_PI * 329.6f * t));
+    }
+    out.push_back(chord);
+
+    // Silence → full-scale noise → silence: sensInit ramp, overshoot, release.
+    Signal step{"silence-step", std::vector<float>(n, 0.0f)};
+    for (int i = n / 4; i < n / 2; i++) step.pcm[i] = 0.95f * noise();
+    out.push_back(step);
+
+    return out;
+}
+
+// ---- Recorded corpus ----
+
+static bool loadF32(const char* path, Signal& sig) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    float buf[4096];
+    size_t n;
+    while ((n = fread(buf, sizeof(float), 4096, f)) > 0)
+        sig.pcm.insert(sig.pcm.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+static uint32_t le32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static uint16_t le16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+static bool loadWav(const char* path, Signal& sig) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    std::vector<uint8_t> data;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+    fclose(f);
+    if (data.size() < 12 || memcmp(&data[0], "RIFF", 4) != 0 || memcmp(&data[8], "WAVE", 4) != 0)
+        return false;
+
+    int fmtTag = 0, channels = 0, bits = 0;
+    uint32_t rate = 0;
+    size_t off = 12;
+    while (off + 8 <= data.size()) {
+        uint32_t len = le32(&data[off + 4]);
+        const uint8_t* body = &data[off + 8];
+        if (off + 8 + len > data.size()) len = (uint32_t)(data.size() - off - 8);
+        if (memcmp(&data[off], "fmt ", 4) == 0 && len >= 16) {
+            fmtTag   = le16(body);
+            channels = le16(body + 2);
+            rate     = le32(body + 4);
+            bits     = le16(body + 14);
+            if (fmtTag == 0xFFFE && len >= 26) fmtTag = le16(body + 24);  // WAVE_FORMAT_EXTENSIBLE
+        } else if (memcmp(&data[off], "data", 4) == 0 && channels > 0) {
+            bool pcm16 = (fmtTag == 1 && bits == 16);
+            bool f32   = (fmtTag == 3 && bits == 32);
+            if (!pcm16 && !f32) {
+                fprintf(stderr, "[diff] %s: unsupported WAV format %d/%d-bit\n", path, fmtTag, bits);
+                return false;
+            }
+            if (rate != (uint32_t)SAMPLE_RATE)
+                fprintf(stderr, "[diff] %s: %u Hz (analysed as %d Hz)\n", path, rate, SAMPLE_RATE);
+            size_t frameBytes = (size_t)channels * bits / 8;
+            size_t frames = len / frameBytes;
+            sig.pcm.resize(frames);
+            for (size_t i = 0; i < frames; i++) {
+                float sum = 0.0f;
+                for (int c = 0; c < channels; c++) {
+                    const uint8_t* p = body + i * frameBytes + c * (bits / 8);
+                    if (pcm16) sum += (int16_t)le16(p) / 32768.0f;
+                    else { uint32_t u = le32(p); float v; memcpy(&v, &u, 4); sum += v; }
+                }
+                sig.pcm[i] = sum / channels;
+            }
+            return true;
+        }
+        off += 8 + len + (len & 1);
+    }
+    return false;
+}
+
+// ---- Runners ----
+
+// Run one signal through the reference and collect frames x bars.
+static std::vector<float> runReference(const Signal& sig, int barCount, float freqMax) {
+    int frames = (int)(sig.pcm.size() / FRAME_SAMPLES);
+    std::vector<float> out((size_t)frames * barCount);
+    vis_ref::initProcessor(barCount, freqMax);
+    for (int f = 0; f < frames; f++)
+        vis_ref::processFrame(&sig.pcm[(size_t)f * FRAME_SAMPLES], &out[(size_t)f * barCount]);
+    return out;
+}
+
+static VisProcessor g_proc;
+
+constexpr float BATCH_MAX_ERR = 1e-6f;
+
+static std::vector<float> runVariant(const PipelineVariant& v, const Signal& sig, int barCount, float freqMax,
+                                     ProcessFn fn = nullptr) {
+    int frames = (int)(sig.pcm.size() / FRAME_SAMPLES);
+    std::vector<float> out((size_t)frames * barCount);
+    float bars[MAX_BAR_COUNT];
+    int16_t s16[FRAME_SAMPLES];
+    publishConfig(barCount, freqMax, VisTuning{});
+    initProcessor(g_proc);
+    for (int f = 0; f < frames; f++) {
+        // S16 variants get the input quantized the way S16LE capture would.
+        if (v.fnS16) {
+            floatToS16(&sig.pcm[(size_t)f * FRAME_SAMPLES], s16, FRAME_SAMPLES);
+            v.fnS16(g_proc, s16, bars);
+        } else {
+            (fn ? fn : v.fn)(g_proc, &sig.pcm[(size_t)f * FRAME_SAMPLES], bars);
+        }
+        memcpy(&out[(size_t)f * barCount], bars, barCount * sizeof(float));
+    }
+    return out;
+}
+
+// The same through a batched kernel, FFT_BATCH hops per call.
+static FrameBatch g_batch;
+
+static std::vector<float> runBatch(const Signal& sig, int barCount, float freqMax, ProcessBatchFn fn) {
+    int frames = (int)(sig.pcm.size() / FRAME_SAMPLES);
+    std::vector<float> out((size_t)frames * barCount);
+    float bars[FFT_BATCH][MAX_BAR_COUNT];
+    const float* chunks[FFT_BATCH];
+    publishConfig(barCount, freqMax, VisTuning{});
+    initProcessor(g_proc);
+    for (int f = 0; f < frames; f += FFT_BATCH) {
+        int n = std::min(FFT_BATCH, frames - f);
+        for (int i = 0; i < n; i++) chunks[i] = &sig.pcm[(size_t)(f + i) * FRAME_SAMPLES];
+        fn(g_proc, g_batch, chunks, n, bars);
+        for (int i = 0; i < n; i++) memcpy(&out[(size_t)(f + i) * barCount], bars[i], barCount * sizeof(float));
+    }
+    return out;
+}
+
+static double nowSec() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv) {
+    int barCount = BAR_COUNT;
+    float freqMax = FREQ_MAX;
+    int seconds = 10;
+    bool perBar = false, perFrame = false;
+    std::vector<Signal> corpus;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bars") == 0 && i + 1 < argc) barCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--freq-max") == 0 && i + 1 < argc) freqMax = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--per-bar") == 0) perBar = true;
+        else if (strcmp(argv[i], "--frames") == 0) perFrame = true;
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: vis-diff [--bars N] [--freq-max HZ] [--seconds S] [--per-bar] [--frames] [FILE ...]\n");
+            return 2;
+        } else files.push_back(argv[i]);
+    }
+    if (barCount < 1 || barCount > MAX_BAR_COUNT || seconds < 1) {
+        fprintf(stderr, "[diff] bars must be 1..%d and seconds >= 1\n", MAX_BAR_COUNT);
+        return 2;
+    }
+
+    corpus = syntheticCorpus(seconds);
+    for (const char* path : files) {
+        Signal sig{path, {}};
+        size_t len = strlen(path);
+        bool ok = (len > 4 && strcmp(path + len - 4, ".f32") == 0) ? loadF32(path, sig) : loadWav(path, sig);
+        if (!ok || sig.pcm.size() < (size_t)FRAME_SAMPLES) {
+            fprintf(stderr, "[diff] could not load %s\n", path);
+            return 2;
+        }
+        corpus.push_back(std::move(sig));
+    }
+
+    printf("bars %d, freq max %.0f Hz, %zu signals\n\n", barCount, freqMax, corpus.size());
+    printf("%-16s %-12s %7s %11s %11s %9s %7s %5s\n",
+           "signal", "variant", "frames", "max err", "rms err", "diverged", "first", "bar");
+
+    bool failed = false;
+    std::vector<double> varTime(PIPELINE_COUNT, 0.0);
+    double refTime = 0.0;
+    long totalFrames = 0;
+
+    for (const Signal& sig : corpus) {
+        double t0 = nowSec();
+        std::vector<float> ref = runReference(sig, barCount, freqMax);
+        refTime += nowSec() - t0;
+        int frames = (int)(ref.size() / barCount);
+        totalFrames += frames;
+
+        for (int v = 0; v < PIPELINE_COUNT; v++) {
+            const PipelineVariant& pv = g_pipelines[v];
+            t0 = nowSec();
+            std::vector<float> out = runVariant(pv, sig, barCount, freqMax);
+            varTime[v] += nowSec() - t0;
+
+            // Error relative to the reference: per bar, and per frame.
+            float tol = pv.refMaxErr > 0.0f ? pv.refMaxErr : 1e-6f;
+            std::vector<float> barMax(barCount, 0.0f);
+            std::vector<double> barSq(barCount, 0.0);
+            int diverged = 0, first = -1;
+            for (int f = 0; f < frames; f++) {
+                float frameMax = 0.0f;
+                for (int b = 0; b < barCount; b++) {
+                    float e = fabsf(out[(size_t)f * barCount + b] - ref[(size_t)f * barCount + b]);
+                    barMax[b] = std::max(barMax[b], e);
+                    barSq[b] += (double)e * e;
+                    frameMax = std::max(frameMax, e);
+                }
+                if (frameMax > tol) {
+                    if (first < 0) first = f;
+                    diverged++;
+                    if (perFrame)
+                        printf("    %s/%s frame %d max err %.6f\n", sig.name.c_str(), pv.name, f, frameMax);
+                }
+            }
+            int worst = 0;
+            double rms = 0.0;
+            for (int b = 0; b < barCount; b++) {
+                if (barMax[b] > barMax[worst]) worst = b;
+                rms += barSq[b];
+            }
+            rms = frames > 0 ? sqrt(rms / ((double)frames * barCount)) : 0.0;
+
+            bool comparable = pv.refMaxErr > 0.0f;
+            bool bad = comparable && (barMax[worst] > pv.refMaxErr || rms > pv.refRmsErr);
+            if (bad) failed = true;
+            char firstStr[16] = "-";
+            if (first >= 0) snprintf(firstStr, sizeof(firstStr), "%d", first);
+            printf("%-16.16s %-12s %7d %11.6f %11.6f %9d %7s %5d%s\n",
+                   sig.name.c_str(), pv.name, frames, barMax[worst], rms, diverged, firstStr, worst,
+                   !comparable ? "  (not comparable)" : (bad ? "  FAIL" : ""));
+
+            if (perBar) {
+                for (int b = 0; b < barCount; b++)
+                    printf("    bar %3d  max %.6f  rms %.6f\n", b, barMax[b],
+                           frames > 0 ? sqrt(barSq[b] / frames) : 0.0);
+            }
+        }
+    }
+
+    printf("\n%-12s %12s %12s %9s\n", "throughput", "frames/s", "us/frame", "vs ref");
+    printf("%-12s %12.0f %12.2f %9s\n", "reference", totalFrames / refTime, refTime * 1e6 / totalFrames, "1.00x");
+    for (int v = 0; v < PIPELINE_COUNT; v++)
+        printf("%-12s %12.0f %12.2f %8.2fx\n", g_pipelines[v].name, totalFrames / varTime[v],
+               varTime[v] * 1e6 / totalFrames, refTime / varTime[v]);
+
+    // Kernel grids: every alternative kernel against its grid's baseline
+    // (kernel 0), with the tolerance the autotuner accepts.
+    printf("\n%-24s %-26s %11s %11s %9s\n", "kernels", "kernel", "max err", "rms err", "us/frame");
+    const ProcessFn* seen[PIPELINE_COUNT] = {};
+    for (int v = 0; v < PIPELINE_COUNT; v++) {
+        const PipelineVariant& pv = g_pipelines[v];
+        bool dup = !pv.tuneKernels;
+        for (int i = 0; i < v && !dup; i++) dup = seen[i] == pv.tuneKernels;
+        seen[v] = pv.tuneKernels;
+        if (dup) continue;
+
+        double kTime[KERNEL_COUNT] = {};
+        float kMax[KERNEL_COUNT] = {};
+        double kSq[KERNEL_COUNT] = {};
+        long samples = 0;
+        for (const Signal& sig : corpus) {
+            std::vector<float> base;
+            for (int k = 0; k < KERNEL_COUNT; k++) {
+                double t0 = nowSec();
+                std::vector<float> out = runVariant(pv, sig, barCount, freqMax, pv.tuneKernels[k]);
+                kTime[k] += nowSec() - t0;
+                if (k == 0) { base = std::move(out); samples += (long)base.size(); continue; }
+                for (size_t i = 0; i < out.size(); i++) {
+                    float e = fabsf(out[i] - base[i]);
+                    kMax[k] = std::max(kMax[k], e);
+                    kSq[k] += (double)e * e;
+                }
+            }
+        }
+        for (int k = 0; k < KERNEL_COUNT; k++) {
+            char name[64];
+            kernelName(k, name, sizeof(name));
+            double rms = samples > 0 ? sqrt(kSq[k] / samples) : 0.0;
+            bool bad = kMax[k] > KERNEL_MAX_ERR || rms > KERNEL_RMS_ERR;
+            if (bad) failed = true;
+            printf("%-24s %-26s %11.6f %11.6f %9.2f%s\n", k == 0 ? pv.name : "", name, kMax[k], rms,
+                   kTime[k] * 1e6 / totalFrames, bad ? "  FAIL" : "");
+        }
+    }
+
+    // Batched kernels (the table-twiddle ones) against the same kernel one
+    // hop at a time: the same arithmetic lane by lane, so they should
+    // agree to rounding at most.
+    printf("\n%-24s %-26s %11s %11s %9s %9s\n", "batched", "kernel", "max err", "rms err", "us/frame", "speedup");
+    const ProcessBatchFn* seenBatch[PIPELINE_COUNT] = {};
+    for (int v = 0; v < PIPELINE_COUNT; v++) {
+        const PipelineVariant& pv = g_pipelines[v];
+        bool dup = !pv.batchKernels;
+        for (int i = 0; i < v && !dup; i++) dup = seenBatch[i] == pv.batchKernels;
+        seenBatch[v] = pv.batchKernels;
+        if (dup) continue;
+
+        bool firstRow = true;
+        for (int k = 0; k < KERNEL_COUNT; k++) {
+            if (!pv.batchKernels[k]) continue;
+            double tSeq = 0.0, tBatch = 0.0, sq = 0.0;
+            float maxErr = 0.0f;
+            long samples = 0;
+            for (const Signal& sig : corpus) {
+                double t0 = nowSec();
+                std::vector<float> seq = runVariant(pv, sig, barCount, freqMax, pv.kernels[k]);
+                tSeq += nowSec() - t0;
+                t0 = nowSec();
+                std::vector<float> out = runBatch(sig, barCount, freqMax, pv.batchKernels[k]);
+                tBatch += nowSec() - t0;
+                for (size_t i = 0; i < out.size(); i++) {
+                    float e = fabsf(out[i] - seq[i]);
+                    maxErr = std::max(maxErr, e);
+                    sq += (double)e * e;
+                }
+                samples += (long)out.size();
+            }
+            char name[64];
+            kernelName(k, name, sizeof(name));
+            double rms = samples > 0 ? sqrt(sq / samples) : 0.0;
+            bool bad = maxErr > BATCH_MAX_ERR;
+            if (bad) failed = true;
+            printf("%-24s %-26s %11.6f %11.6f %9.2f %8.2fx%s\n", firstRow ? pv.name : "", name,
+                   maxErr, rms, tBatch * 1e6 / totalFrames, tSeq / tBatch, bad ? "  FAIL" : "");
+            firstRow = false;
+        }
+    }
+
+    if (failed) printf("\nFAIL: a variant or kernel exceeded its tolerance\n");
+    return failed ? 1 : 0;
+}
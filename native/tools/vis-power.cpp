@@ -0,0 +1,294 @@
+// vis-power.cpp — Idle and steady-state cost of the capture daemon.
+// Starts vis-capture on a replay source (replay.h, no sound server
+// needed) once per scenario, drives it with a WebSocket client, and
+// reads what it cost from /proc over a fixed window: wakeups, CPU time,
+// voluntary / involuntary context switches (summed over its threads)
+// and resident memory.  Each figure is checked against a stored
+// baseline; the exit status is non-zero if any scenario got worse by
+// more than the tolerance.
+//
+// Build:  make
+// Run:    ./vis-power [--daemon PATH] [--seconds S] [--warmup S] [--only NAME]
+//                     [--replay FILE.f32] [--baseline FILE] [--save-baseline]
+//                     [--tolerance PCT] [--port N] [-- DAEMON ARGS...]
+//
+// Linux only (/proc).  Wakeups are scheduler run-queue arrivals from
+// /proc/<pid>/task/*/schedstat; kernels without schedstat fall back to
+// voluntary context switches, which count the same sleeps.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "daemon_client.h"
+
+struct Scenario {
+    const char* name;
+    const char* source;     // --replay spec; nullptr = the music source
+    bool        client;
+    int         fps;        // SET_FPS once connected
+    const char* desc;
+};
+
+static const Scenario g_scenarios[] = {
+    { "idle",      nullptr,             false, 0,  "no client connected" },
+    { "silence",   "synthetic:silence", true,  30, "client, digital silence" },
+    { "paused",    "synthetic:stall",   true,  30, "client, source delivers nothing" },
+    { "stream-24", nullptr,             true,  24, "client, music at 24 fps" },
+    { "stream-30", nullptr,             true,  30, "client, music at 30 fps" },
+    { "stream-60", nullptr,             true,  60, "client, music at 60 fps" },
+};
+
+// ---- /proc sampling ----
+
+struct Usage {
+    double   t = 0.0;           // steady-clock seconds
+    double   cpu = 0.0;         // user + system seconds
+    uint64_t runs = 0;          // schedstat run-queue arrivals
+    uint64_t vcs = 0, ics = 0;  // context switches
+    long     rssKb = 0;
+    bool     schedstat = false;
+};
+
+struct Result {
+    double wakeups = 0, cpuPct = 0, vcs = 0, ics = 0, rssKb = 0, fps = 0;
+};
+
+static bool readFile(const std::string& path, char* buf, size_t cap) {
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) return false;
+    size_t n = fread(buf, 1, cap - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+    return true;
+}
+
+static uint64_t statusField(const char* status, const char* key) {
+    const char* p = strstr(status, key);
+    return p ? strtoull(p + strlen(key), nullptr, 10) : 0;
+}
+
+static bool sampleUsage(pid_t pid, Usage& u) {
+    char buf[4096];
+    const std::string dir = "/proc/" + std::to_string(pid);
+    u = Usage{};
+    u.t = nowSec();
+
+    // utime / stime are fields 14 and 15, counted after the "(comm)"
+    if (!readFile(dir + "/stat", buf, sizeof(buf))) return false;
+    const char* p = strrchr(buf, ')');
+    if (!p) return false;
+    unsigned long long utime = 0, stime = 0;
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2) return false;
+    u.cpu = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+
+    if (readFile(dir + "/status", buf, sizeof(buf))) u.rssKb = (long)statusField(buf, "VmRSS:");
+
+    DIR* d = opendir((dir + "/task").c_str());
+    if (!d) return false;
+    u.schedstat = true;
+    while (dirent* e = readdir(d)) {
+        if (e->d_name[0] == '.') continue;
+        const std::string task = dir + "/task/" + e->d_name;
+        if (readFile(task + "/status", buf, sizeof(buf))) {
+            u.vcs += statusField(buf, "voluntary_ctxt_switches:");
+            u.ics += statusField(buf, "nonvoluntary_ctxt_switches:");
+        }
+        unsigned long long runNs, waitNs, runs;
+        if (readFile(task + "/schedstat", buf, sizeof(buf)) &&
+            sscanf(buf, "%llu %llu %llu", &runNs, &waitNs, &runs) == 3 && runs > 0)
+            u.runs += runs;
+        else
+            u.schedstat = false;
+    }
+    closedir(d);
+    return true;
+}
+
+static Result usageDelta(const Usage& a, const Usage& b) {
+    Result r;
+    double dt = b.t - a.t;
+    r.wakeups = (a.schedstat && b.schedstat ? (double)(b.runs - a.runs) : (double)(b.vcs - a.vcs)) / dt;
+    r.cpuPct  = 100.0 * (b.cpu - a.cpu) / dt;
+    r.vcs     = (double)(b.vcs - a.vcs) / dt;
+    r.ics     = (double)(b.ics - a.ics) / dt;
+    r.rssKb   = (double)b.rssKb;
+    return r;
+}
+
+// ---- Baseline ----
+// One line per scenario: name wakeups/s cpu% vcs/s ics/s rss_kb
+
+struct BaselineRow { std::string name; Result r; };
+
+static std::vector<BaselineRow> loadBaseline(const std::string& path) {
+    std::vector<BaselineRow> rows;
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) return rows;
+    char line[256], name[64];
+    while (fgets(line, sizeof(line), f)) {
+        BaselineRow row;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%63s %lf %lf %lf %lf %lf", name, &row.r.wakeups, &row.r.cpuPct,
+                   &row.r.vcs, &row.r.ics, &row.r.rssKb) == 6) {
+            row.name = name;
+            rows.push_back(row);
+        }
+    }
+    fclose(f);
+    return rows;
+}
+
+static bool saveBaseline(const std::string& path, const std::vector<BaselineRow>& rows) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "# vis-power baseline: scenario wakeups/s cpu%% vcs/s ics/s rss_kb\n");
+    for (const BaselineRow& row : rows)
+        fprintf(f, "%-10s %8.1f %7.2f %8.1f %7.1f %8.0f\n", row.name.c_str(), row.r.wakeups, row.r.cpuPct,
+                row.r.vcs, row.r.ics, row.r.rssKb);
+    fclose(f);
+    return true;
+}
+
+// Worse than base by more than tol (fraction) plus an absolute slack
+// for figures that are near zero on an idle daemon.
+static bool regressed(double v, double base, double tol, double slack) {
+    return v > base * (1.0 + tol) + slack;
+}
+
+int main(int argc, char** argv) {
+    std::string daemon = "../linux/vis-capture", replay, baselinePath = "power-baseline.txt", only;
+    double seconds = 10.0, warmup = 3.0, tol = 0.25;
+    int port = 7790;
+    bool save = false;
+    std::vector<std::string> extra;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) daemon = argv[++i];
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) warmup = atof(argv[++i]);
+        else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) only = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replay = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) baselinePath = argv[++i];
+        else if (strcmp(argv[i], "--save-baseline") == 0) save = true;
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) tol = atof(argv[++i]) / 100.0;
+        else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--") == 0) { extra.assign(argv + i + 1, argv + argc); break; }
+        else {
+            fprintf(stderr, "usage: vis-power [--daemon PATH] [--seconds S] [--warmup S] [--only NAME]\n"
+                            "                 [--replay FILE.f32] [--baseline FILE] [--save-baseline]\n"
+                            "                 [--tolerance PCT] [--port N] [-- DAEMON ARGS...]\n");
+            return 2;
+        }
+    }
+    if (access(daemon.c_str(), X_OK) != 0) {
+        fprintf(stderr, "[power] no daemon at %s (build native/linux or pass --daemon)\n", daemon.c_str());
+        return 2;
+    }
+    if (seconds <= 0.0 || port <= 0 || port > 65535) {
+        fprintf(stderr, "[power] seconds must be > 0 and port 1..65535\n");
+        return 2;
+    }
+
+    // Settings file just for the port, so a running daemon is left alone
+    char config[] = "/tmp/vis-power-XXXXXX";
+    int cfd = mkstemp(config);
+    if (cfd < 0) { perror("[power] mkstemp"); return 2; }
+    dprintf(cfd, "port = %d\n", port);
+    close(cfd);
+
+    std::vector<BaselineRow> baseline = save ? std::vector<BaselineRow>{} : loadBaseline(baselinePath);
+    std::vector<BaselineRow> results;
+    bool failed = false;
+
+    printf("daemon %s, %.0f s per scenario after %.0f s warmup, baseline %s%s\n\n", daemon.c_str(), seconds,
+           warmup, baselinePath.c_str(), save ? " (saving)" : baseline.empty() ? " (none)" : "");
+    printf("%-10s %-32s %9s %7s %8s %7s %8s %6s\n",
+           "scenario", "", "wakeup/s", "cpu %", "vcs/s", "ics/s", "rss MB", "fps");
+
+    for (const Scenario& sc : g_scenarios) {
+        if (!only.empty() && only != sc.name) continue;
+        const std::string source = sc.source ? sc.source : replay.empty() ? "synthetic:music" : replay;
+        const std::string log = std::string("/tmp/vis-power-") + sc.name + ".log";
+
+        pid_t pid = startDaemon(daemon, config, source, extra, {}, log);
+        double t0 = nowSec();
+        while (!portListening(port) && nowSec() - t0 < 30.0 && waitpid(pid, nullptr, WNOHANG) == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if (!portListening(port)) {
+            fprintf(stderr, "[power] %s: daemon did not start, see %s\n", sc.name, log.c_str());
+            stopDaemon(pid);
+            failed = true;
+            continue;
+        }
+
+        WsClient client;
+        if (sc.client && (!client.connect(port) || !client.sendText("SET_FPS:" + std::to_string(sc.fps)))) {
+            fprintf(stderr, "[power] %s: could not connect a client\n", sc.name);
+            stopDaemon(pid);
+            failed = true;
+            continue;
+        }
+
+        // Keep the client reading so the daemon never sees back-pressure
+        auto wait = [&](double s) {
+            double end = nowSec() + s;
+            while (nowSec() < end) {
+                if (sc.client) client.pump(20);
+                else std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        };
+        wait(warmup);
+        Usage a, b;
+        long frames0 = client.binFrames;
+        bool ok = sampleUsage(pid, a);
+        wait(seconds);
+        ok = ok && sampleUsage(pid, b);
+        long frames = client.binFrames - frames0;
+        stopDaemon(pid);
+        if (!ok) {
+            fprintf(stderr, "[power] %s: could not read /proc/%d\n", sc.name, (int)pid);
+            failed = true;
+            continue;
+        }
+
+        Result r = usageDelta(a, b);
+        r.fps = frames / (b.t - a.t);
+        results.push_back({sc.name, r});
+        printf("%-10s %-32s %9.1f %7.2f %8.1f %7.1f %8.1f %6.1f\n", sc.name, sc.desc, r.wakeups, r.cpuPct,
+               r.vcs, r.ics, r.rssKb / 1024.0, r.fps);
+
+        for (const BaselineRow& base : baseline) {
+            if (base.name != sc.name) continue;
+            const Result& q = base.r;
+            bool bad[5] = {
+                regressed(r.wakeups, q.wakeups, tol, 5.0),
+                regressed(r.cpuPct,  q.cpuPct,  tol, 0.5),
+                regressed(r.vcs,     q.vcs,     tol, 5.0),
+                regressed(r.ics,     q.ics,     tol, 5.0),
+                regressed(r.rssKb,   q.rssKb,   tol, 2048.0),
+            };
+            auto pct = [](double v, double ref) { return ref > 0.0 ? 100.0 * (v - ref) / ref : 0.0; };
+            printf("%-10s %-32s %+8.0f%% %+6.0f%% %+7.0f%% %+6.0f%% %+7.0f%%%s\n", "", "vs baseline",
+                   pct(r.wakeups, q.wakeups), pct(r.cpuPct, q.cpuPct), pct(r.vcs, q.vcs), pct(r.ics, q.ics),
+                   pct(r.rssKb, q.rssKb), bad[0] || bad[1] || bad[2] || bad[3] || bad[4] ? "  FAIL" : "");
+            for (bool x : bad) failed |= x;
+        }
+    }
+    unlink(config);
+
+    if (save) {
+        if (!saveBaseline(baselinePath, results)) {
+            fprintf(stderr, "[power] could not write %s\n", baselinePath.c_str());
+            return 2;
+        }
+        printf("\nbaseline saved to %s\n", baselinePath.c_str());
+    }
+    if (failed) printf("\nFAIL: a scenario did not run or regressed past %.0f%%\n", tol * 100.0);
+    return failed ? 1 : 0;
+}
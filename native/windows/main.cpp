@@ -21,16 +21,31 @@
 #include <chrono>
 #include <thread>
 #include <string>
+#include <string_view>
+#include <charconv>
 
 #pragma comment(lib, "ole32.lib")
 #pragma comment(lib, "ws2_32.lib")
 
 #include "../common/protocol.h"
 #include "../common/fft.h"
+#include "../common/pipelines.h"
+#include "../common/autotune.h"
 #include "../common/ws_server.h"
+#include "../common/latency.h"
+#include "../common/settings.h"
+#include "../common/interp.h"
+#include "../common/pcm_ingest.h"
+#include "../common/loudness.h"
+#include "../common/history.h"
+#include "../common/hpss.h"
+#include "../common/triggers.h"
 
 static std::atomic<bool> g_running{true};
 
+// Longest a capture-loop Sleep(1) takes at the default timer resolution.
+constexpr int64_t COARSE_TICK_NS = 16000000;
+
 static BOOL WINAPI consoleHandler(DWORD sig) {
     if (sig == CTRL_C_EVENT || sig == CTRL_CLOSE_EVENT) {
         g_running = false;
@@ -60,54 +75,404 @@ static void toMono(const BYTE* src, float* dst, UINT32 frames,
     }
 }
 
-int main() {
+// Integer argument of a "PREFIX:value" command, parsed in place so the
+// command path doesn't allocate.
+static bool commandInt(std::string_view msg, std::string_view prefix, int* out) {
+    if (msg.substr(0, prefix.size()) != prefix) return false;
+    std::string_view arg = msg.substr(prefix.size());
+    auto r = std::from_chars(arg.data(), arg.data() + arg.size(), *out);
+    return r.ec == std::errc();
+}
+
+static std::string g_settingsPath = defaultSettingsPath();
+static bool g_settingsRequired = false;     // --config given: the file must load
+static std::string g_historyPath;           // --history PATH|off; empty = defaultHistoryPath()
+
+// Command line: --pipeline NAME selects a processing variant,
+// --list-pipelines prints the available ones, --kernels NAME|auto
+// overrides the autotuner (--retune re-measures, --list-kernels lists),
+// --config PATH reads settings from PATH instead of the default location,
+// --history PATH|off moves or turns off the bar history file (history.h).
+// Returns false to exit.
+static bool parseArgs(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (!selectPipeline(name)) {
+                fprintf(stderr, "[vis] unknown pipeline '%s', available:\n", name);
+                listPipelines();
+                return false;
+            }
+        } else if (strcmp(argv[i], "--list-pipelines") == 0) {
+            listPipelines();
+            return false;
+        } else if (strcmp(argv[i], "--kernels") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            g_kernelOverride = strcmp(name, "auto") == 0 ? -1 : parseKernelName(name);
+            if (g_kernelOverride < 0 && strcmp(name, "auto") != 0) {
+                fprintf(stderr, "[vis] unknown kernels '%s', available:\n", name);
+                listKernels();
+                return false;
+            }
+        } else if (strcmp(argv[i], "--retune") == 0) {
+            g_retune = true;
+        } else if (strcmp(argv[i], "--list-kernels") == 0) {
+            listKernels();
+            return false;
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            g_settingsPath = argv[++i];
+            g_settingsRequired = true;
+        } else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+            g_historyPath = argv[++i];
+        } else {
+            fprintf(stderr, "usage: vis-capture [--pipeline NAME] [--list-pipelines]\n"
+                            "                   [--kernels NAME|auto] [--retune] [--list-kernels] [--config PATH]\n"
+                            "                   [--history PATH|off]\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (!parseArgs(argc, argv)) return 1;
     SetConsoleCtrlHandler(consoleHandler, TRUE);
     fprintf(stderr, "[vis] Spotify visualizer audio bridge (Windows)\n");
+
+    // --- Settings: the file if there is one, else the built-in defaults ---
+    VisSettings settings;
+    std::string settingsErr;
+    if (g_settingsRequired || settingsFileExists(g_settingsPath)) {
+        if (!loadSettings(g_settingsPath, settings, settingsErr)) {
+            fprintf(stderr, "[vis] FATAL: %s: %s\n", g_settingsPath.c_str(), settingsErr.c_str());
+            return 1;
+        }
+        fprintf(stderr, "[vis] settings: %s\n", g_settingsPath.c_str());
+    }
+    publishConfig(settings.barCount, settings.freqMax, settings.tune);
+    const int port = settings.port;
+
     fprintf(stderr, "[vis] FFT %d, bars %d, %d fps (%d samples/frame)\n",
-            FFT_SIZE, BAR_COUNT, SEND_FPS, FRAME_SAMPLES);
+            FFT_SIZE, settings.barCount, SEND_FPS, FRAME_SAMPLES);
+    fprintf(stderr, "[vis] pipeline: %s (%s)\n", g_pipeline->name, g_pipeline->desc);
+    configureKernels(true);
+
+    // Primary source's bars for HISTORY: queries
+    static HistoryStore history;
+    if (g_historyPath != "off") history.open(g_historyPath.empty() ? defaultHistoryPath() : g_historyPath);
 
     // --- Start WebSocket server ---
     WsServer ws;
-    if (!ws.start(WS_PORT)) {
+    if (!ws.start(port)) {
         fprintf(stderr, "[vis] FATAL: could not start WebSocket server\n");
         return 1;
     }
 
     // Dynamic send rate (default 30fps = 33ms)
-    std::atomic<int> sendIntervalMs{33};
+    int sendFps = settings.fps;
+    std::atomic<int> sendIntervalMs{1000 / sendFps};
+
+    // Single capture, single processor; commands and capture share this
+    // thread, and the processor picks up layout changes on its next frame.
+    static VisProcessor proc;
+
+    // PCM ingest (PCM_START): one client at a time, analysed on this
+    // thread as channel 1 and sent back to that client only.
+    static VisProcessor ingestProc;
+    static PcmIngest ingest;
+    int ingestClient = -1;
+    auto lastIngestSend = std::chrono::steady_clock::now();
+
+    // Render-latency echoes, per client slot.
+    ClientLatency latency[WS_MAX_CLIENTS];
+    // Display-rate clients (SET_REFRESH); hz == 0 gets hop frames at SET_FPS.
+    RefreshClock refresh[WS_MAX_CLIENTS];
+    // SET_LOUDNESS subscribers, and a meter per processor fed while any.
+    uint32_t loudnessSet = 0;
+    // SET_LAYERS subscribers; the captured source's layers while any.
+    uint32_t layersSet = 0;
+    static HpssLayers layers;
+    static uint8_t layerFrame[FRAME_TAG_BYTES + MAX_BAR_COUNT * sizeof(float)];
+    auto sendLayer = [&](uint32_t to, int kind, const float* v, int n, int64_t originNs) {
+        layerFrame[0] = (uint8_t)kind;
+        layerFrame[1] = 0;
+        layerFrame[2] = (uint8_t)(n & 0xFF);
+        layerFrame[3] = (uint8_t)(n >> 8);
+        memcpy(layerFrame + FRAME_TAG_BYTES, v, n * sizeof(float));
+        ws.sendBinaryTo(to, layerFrame, FRAME_TAG_BYTES + n * sizeof(float), originNs);
+    };
+    static LoudnessMeter meter, ingestMeter;
+    static char loudJson[256];
+    // HISTORY: answers still being sent, per client slot.
+    static HistoryReply historyOut[WS_MAX_CLIENTS];
+    static uint8_t historyFrame[WS_MAX_TX_PAYLOAD];
+    auto sendLoudness = [&](uint32_t to, int channel, const LoudnessReading& loud) {
+        int n = loudnessJson(loudJson, sizeof(loudJson), channel, loud);
+        for (int c = 0; c < WS_MAX_CLIENTS && n > 0; c++)
+            if (to >> c & 1) ws.sendTextTo(c, std::string_view(loudJson, n));
+    };
+    // TRIGGER rules, evaluated on this thread right after each frame (no
+    // snapshot needed), and the clients that get events instead of frames.
+    static TriggerSet triggerRules;
+    static TriggerEvaluator triggerEval, ingestTriggerEval;
+    static char triggerText[128];
+    uint32_t triggerClients = 0;
+    auto runTriggers = [&](TriggerEvaluator& eval, int channel, const float* bars, int n, int64_t captured, uint32_t to) {
+        if (!triggerRules.count) return;
+        TriggerEvent fired[TRIGGER_EVENT_QUEUE];
+        int nFired = eval.run(triggerRules, channel, bars, n, captured, fired, TRIGGER_EVENT_QUEUE);
+        for (int k = 0; k < nFired; k++) {
+            int len = triggerJson(triggerText, sizeof(triggerText), fired[k]);
+            if (len > 0 && (to >> fired[k].client & 1)) ws.sendTextTo(fired[k].client, std::string_view(triggerText, len));
+        }
+    };
+    ws.onConnect = [&](int client) {
+        latency[client].clear();
+        refresh[client].set(0, 0);
+        loudnessSet &= ~(1u << client);
+        layersSet &= ~(1u << client);
+        if (!layersSet) attachHpss(proc, nullptr);
+        historyOut[client].cancel();
+        triggerRules.remove(client, -1);
+        triggerClients = triggerRules.clients();
+        if (ingestClient == client) ingestClient = -1;   // left without PCM_STOP
+    };
+    ws.onBinary = [&](int client, const uint8_t* data, size_t len) {
+        if (client != ingestClient) return;
+        ingest.push(data, len, [&](const float* mono) {
+            int64_t captured = WsServer::nowNs();
+            float out[MAX_BAR_COUNT];
+            uint8_t tagged[FRAME_TAG_BYTES + MAX_BAR_COUNT * sizeof(float)];
+            processFrame(ingestProc, mono, out);
+            runTriggers(ingestTriggerEval, 1, out, ingestProc.barCount, captured, 1u << client);
+            LoudnessReading loud;
+            if ((loudnessSet >> client & 1) && ingestMeter.push(mono, FRAME_SAMPLES, loud))
+                sendLoudness(1u << client, 1, loud);
+            auto now = std::chrono::steady_clock::now();
+            if ((triggerClients >> client & 1) ||
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - lastIngestSend).count() < sendIntervalMs.load())
+                return;
+            const int n = ingestProc.barCount;
+            tagged[0] = FRAME_KIND_BARS;
+            tagged[1] = 1;
+            tagged[2] = (uint8_t)(n & 0xFF);
+            tagged[3] = (uint8_t)(n >> 8);
+            memcpy(tagged + FRAME_TAG_BYTES, out, n * sizeof(float));
+            ws.sendBinaryTo(1u << client, tagged, FRAME_TAG_BYTES + n * sizeof(float), captured);
+            lastIngestSend = now;
+        });
+    };
+
+    // GET_METRICS reply; sized to the largest frame the server will queue.
+    static char metrics[WS_MAX_TX_PAYLOAD];
+    auto buildMetrics = [&]() -> int {
+        size_t cap = sizeof(metrics);
+        int len = snprintf(metrics, cap, "{\"metrics\":{\"backend\":\"%s\",\"clients\":%d,\"fps\":%d,\"latency\":[",
+                           ws.backendName(), ws.clientCount(), 1000 / sendIntervalMs.load());
+        bool first = true;
+        for (int i = 0; i < WS_MAX_CLIENTS && (size_t)len < cap; i++) {
+            if (latency[i].echoes == 0 && latency[i].unmatched == 0) continue;
+            len += snprintf(metrics + len, cap - len, "%s{\"client\":%d,\"stats\":", first ? "" : ",", i);
+            if ((size_t)len >= cap) break;
+            int n = latency[i].toJson(metrics + len, cap - len);
+            if (n < 0) return -1;
+            len += n;
+            if ((size_t)len < cap) len += snprintf(metrics + len, cap - len, "}");
+            first = false;
+        }
+        if ((size_t)len < cap) len += snprintf(metrics + len, cap - len, "]}}");
+        return (size_t)len < cap ? len : -1;
+    };
+
+    // Reply storage for command responses, reused so that replying to a
+    // command never allocates.
+    char reply[512];
+
+    // Re-read the settings file (RELOAD_CONFIG from `client`; there is no
+    // SIGHUP here).  The new tuning is published as a config snapshot, so
+    // the processor keeps its smoothing / gain state.  The layout and
+    // send rate clients chose are kept while the new lists allow them.
+    auto reloadSettings = [&](int client) {
+        VisSettings next;
+        std::string err;
+        if (!loadSettings(g_settingsPath, next, err)) {
+            fprintf(stderr, "[vis] settings reload failed, keeping current: %s: %s\n",
+                    g_settingsPath.c_str(), err.c_str());
+            for (char& c : err) if (c == '"' || c == '\\') c = '\'';
+            int n = snprintf(reply, sizeof(reply), "{\"configError\":\"%s\"}", err.c_str());
+            ws.sendTextTo(client, std::string_view(reply, std::min(n, (int)sizeof(reply) - 1)));
+            return;
+        }
+        if (next.port != port)
+            fprintf(stderr, "[vis] port %d takes effect on restart\n", next.port);
+
+        int count;
+        float freq;
+        currentConfig(&count, &freq);
+        bool countOk = settingsAllow(next.barCounts, count) || count == next.barCount;
+        bool freqOk  = settingsAllow(next.freqMaxes, (int)freq) || freq == next.freqMax;
+        publishConfig(countOk ? count : next.barCount, freqOk ? freq : next.freqMax, next.tune);
+        if (!countOk || !freqOk) configureKernels(false);
+        if (!countOk) {
+            int n = snprintf(reply, sizeof(reply), "{\"barCountChanged\":%d}", next.barCount);
+            ws.sendText(std::string_view(reply, n));
+        }
+        if (!freqOk) {
+            int n = snprintf(reply, sizeof(reply), "{\"freqMaxChanged\":%d}", (int)next.freqMax);
+            ws.sendText(std::string_view(reply, n));
+        }
+        if (!settingsAllow(next.fpsRates, sendFps)) {
+            sendFps = next.fps;
+            sendIntervalMs = 1000 / sendFps;
+            int n = snprintf(reply, sizeof(reply), "{\"fpsChanged\":%d}", sendFps);
+            ws.sendText(std::string_view(reply, n));
+        }
+        settings = next;
+        fprintf(stderr, "[vis] settings reloaded from %s\n", g_settingsPath.c_str());
+        ws.sendText("{\"configReloaded\":true}");
+    };
 
     // Handle text commands from WebSocket client.
     // Windows WASAPI loopback always captures the default render device,
     // so there are no selectable sources.  We respond to GET_SOURCES
     // with a single "default" entry so the UI knows it's Windows.
-    ws.onText = [&](const std::string& msg) {
-        if (msg == "GET_SOURCES") {
-            ws.sendText("{\"sources\":[{\"name\":\"default\",\"desc\":\"Default Audio Output (WASAPI Loopback)\"}]}");
-        } else if (msg.rfind("SET_SOURCE:", 0) == 0) {
+    ws.onText = [&](int client, std::string_view msg) {
+        int fps = 0, freq = 0, count = 0, hz = 0, on = 0, id = 0;
+        if (msg.substr(0, 8) == "LATENCY:") {
+            uint32_t seq;
+            double recvMs, paintMs;
+            int64_t sentNs, originNs;
+            if (!parseLatencyEcho(msg.substr(8), &seq, &recvMs, &paintMs)) return;
+            if (!ws.sentFrame(client, seq, &sentNs, &originNs)) {
+                latency[client].unmatched++;
+                return;
+            }
+            latency[client].add(originNs ? (sentNs - originNs) / 1e6f : 0.0f,
+                                (WsServer::nowNs() - sentNs) / 1e6f, (float)(paintMs - recvMs));
+        } else if (msg == "GET_METRICS") {
+            int n = buildMetrics();
+            if (n > 0) ws.sendTextTo(client, std::string_view(metrics, n));
+        } else if (msg == "RELOAD_CONFIG") {
+            reloadSettings(client);
+        } else if (msg == "GET_SOURCES") {
+            ws.sendTextTo(client, "{\"sources\":[{\"name\":\"default\",\"desc\":\"Default Audio Output (WASAPI Loopback)\"}]}");
+        } else if (msg.substr(0, 11) == "SET_SOURCE:") {
             // No-op on Windows — always uses default loopback
             ws.sendText("{\"sourceChanged\":\"default\"}");
-        } else if (msg.rfind("SET_FPS:", 0) == 0) {
-            int fps = std::atoi(msg.substr(8).c_str());
-            if (fps == 24 || fps == 30 || fps == 60) {
+        } else if (msg.substr(0, 11) == "ADD_SOURCE:") {
+            // Only the default loopback can be captured here
+            ws.sendTextTo(client, "{\"sourceError\":\"Multiple sources are not supported on Windows\"}");
+        } else if (msg.substr(0, 10) == "PCM_START:") {
+            const char* err = ingestClient >= 0 && ingestClient != client ? "Too many sources"
+                            : !ingest.start(msg.substr(10)) ? "Bad PCM format" : nullptr;
+            if (err) {
+                int n = snprintf(reply, sizeof(reply), "{\"pcmError\":\"%s\"}", err);
+                ws.sendTextTo(client, std::string_view(reply, n));
+                return;
+            }
+            ingestClient = client;
+            initProcessor(ingestProc);
+            ingestMeter.reset();
+            fprintf(stderr, "[vis] PCM ingest from client %d: %.*s\n", client, (int)msg.size() - 10, msg.data() + 10);
+            ws.sendTextTo(client, "{\"pcmStarted\":1}");
+        } else if (msg == "PCM_STOP") {
+            if (client == ingestClient) {
+                ingestClient = -1;
+                fprintf(stderr, "[vis] PCM ingest from client %d stopped\n", client);
+                ws.sendTextTo(client, "{\"pcmStopped\":1}");
+            }
+        } else if (commandInt(msg, "SET_FPS:", &fps)) {
+            if (settingsAllow(settings.fpsRates, fps)) {
+                sendFps = fps;
                 sendIntervalMs = 1000 / fps;
                 fprintf(stderr, "[vis] Send rate changed to %d fps (%d ms)\n", fps, sendIntervalMs.load());
-                ws.sendText("{\"fpsChanged\":" + std::to_string(fps) + "}");
+                int n = snprintf(reply, sizeof(reply), "{\"fpsChanged\":%d}", fps);
+                ws.sendText(std::string_view(reply, n));
+            }
+        } else if (commandInt(msg, "SET_REFRESH:", &hz)) {
+            if (hz == 0 || (hz >= MIN_REFRESH_HZ && hz <= MAX_REFRESH_HZ)) {
+                refresh[client].set(hz, WsServer::nowNs());
+                if (hz) fprintf(stderr, "[vis] Client %d refresh set to %d Hz\n", client, hz);
+                else fprintf(stderr, "[vis] Client %d back to hop-rate frames\n", client);
+                int n = snprintf(reply, sizeof(reply), "{\"refreshChanged\":%d}", hz);
+                ws.sendTextTo(client, std::string_view(reply, n));
             }
-        } else if (msg.rfind("SET_FREQ_MAX:", 0) == 0) {
-            int freq = std::atoi(msg.substr(13).c_str());
-            if (freq == 10000 || freq == 12000 || freq == 14000 || freq == 16000 || freq == 18000) {
-                g_freqMax = (float)freq;
-                initProcessor();
+        } else if (commandInt(msg, "SET_LOUDNESS:", &on)) {
+            if (on == 0 || on == 1) {
+                // First subscriber: start from a clean meter
+                if (on && !loudnessSet) {
+                    meter.reset();
+                    ingestMeter.reset();
+                }
+                if (on) loudnessSet |= 1u << client;
+                else loudnessSet &= ~(1u << client);
+                fprintf(stderr, "[vis] Client %d loudness meter %s\n", client, on ? "on" : "off");
+                int n = snprintf(reply, sizeof(reply), "{\"loudnessChanged\":%d}", on);
+                ws.sendTextTo(client, std::string_view(reply, n));
+            }
+        } else if (commandInt(msg, "SET_LAYERS:", &on)) {
+            if (on == 0 || on == 1) {
+                if (on && !layersSet) attachHpss(proc, &layers);
+                if (on) layersSet |= 1u << client;
+                else layersSet &= ~(1u << client);
+                if (!layersSet) attachHpss(proc, nullptr);
+                fprintf(stderr, "[vis] Client %d harmonic/percussive layers %s\n", client, on ? "on" : "off");
+                int n = snprintf(reply, sizeof(reply), "{\"layersChanged\":%d}", on);
+                ws.sendTextTo(client, std::string_view(reply, n));
+            }
+        } else if (msg.substr(0, 8) == "HISTORY:") {
+            int64_t fromMs, toMs;
+            int columns;
+            bool mean;
+            const char* err = !history.isOpen() ? "History is off"
+                            : !parseHistoryQuery(msg.substr(8), &fromMs, &toMs, &columns, &mean) ? "Bad query"
+                            : !historyOut[client].start(history, fromMs, toMs, columns, mean) ? "Nothing in range" : nullptr;
+            if (err) {
+                int n = snprintf(reply, sizeof(reply), "{\"historyError\":\"%s\"}", err);
+                ws.sendTextTo(client, std::string_view(reply, n));
+            }
+        } else if (msg.substr(0, 8) == "TRIGGER:") {
+            TriggerRule rule{};
+            const char* err = nullptr;
+            if (!parseTrigger(msg.substr(8), &rule)) err = "Bad rule";
+            else {
+                rule.client = client;
+                if (!triggerRules.put(rule)) err = "Too many rules";
+            }
+            int n;
+            if (err) {
+                n = snprintf(reply, sizeof(reply), "{\"triggerError\":\"%s\"}", err);
+            } else {
+                triggerClients = triggerRules.clients();
+                fprintf(stderr, "[vis] Client %d trigger %d on channel %d bars %d-%d\n",
+                        client, rule.id, rule.channel, rule.firstBar, rule.lastBar);
+                n = snprintf(reply, sizeof(reply), "{\"triggerAdded\":%d}", rule.id);
+            }
+            ws.sendTextTo(client, std::string_view(reply, n));
+        } else if (commandInt(msg, "TRIGGER_CLEAR:", &id)) {
+            int n;
+            if (triggerRules.remove(client, id)) {
+                triggerClients = triggerRules.clients();
+                n = snprintf(reply, sizeof(reply), "{\"triggerRemoved\":%d}", id);
+            } else {
+                n = snprintf(reply, sizeof(reply), "{\"triggerError\":\"No such rule\"}");
+            }
+            ws.sendTextTo(client, std::string_view(reply, n));
+        } else if (commandInt(msg, "SET_FREQ_MAX:", &freq)) {
+            if (settingsAllow(settings.freqMaxes, freq)) {
+                publishFreqMax((float)freq);
+                configureKernels(false);
                 fprintf(stderr, "[vis] Freq max changed to %d Hz\n", freq);
-                ws.sendText("{\"freqMaxChanged\":" + std::to_string(freq) + "}");
+                int n = snprintf(reply, sizeof(reply), "{\"freqMaxChanged\":%d}", freq);
+                ws.sendText(std::string_view(reply, n));
             }
-        } else if (msg.rfind("SET_BAR_COUNT:", 0) == 0) {
-            int count = std::atoi(msg.substr(14).c_str());
-            if (count == 8 || count == 16 || count == 24 || count == 36 || count == 72 || count == 100 || count == 144) {
-                g_barCount = count;
-                initProcessor();
+        } else if (commandInt(msg, "SET_BAR_COUNT:", &count)) {
+            if (settingsAllow(settings.barCounts, count)) {
+                publishBarCount(count);
+                configureKernels(false);
                 fprintf(stderr, "[vis] Bar count changed to %d\n", count);
-                ws.sendText("{\"barCountChanged\":" + std::to_string(count) + "}");
+                int n = snprintf(reply, sizeof(reply), "{\"barCountChanged\":%d}", count);
+                ws.sendText(std::string_view(reply, n));
             }
         }
     };
@@ -158,10 +523,17 @@ int main() {
     fprintf(stderr, "[vis] WASAPI loopback started\n");
 
     // --- Main loop ---
-    initProcessor();
-    float chunk[FRAME_SAMPLES];
-    int chunkPos = 0;
+    initProcessor(proc);
+    // Completed hops wait here until the packets queued so far are
+    // drained, then go through the batched transform together: after a
+    // stall WASAPI hands over several at once.
+    static float pending[FFT_BATCH][FRAME_SAMPLES];
+    static FrameBatch batch;
+    int64_t pendingAt[FFT_BATCH];
+    int pendingCount = 0, chunkPos = 0;
+    float batchBars[FFT_BATCH][MAX_BAR_COUNT];
     float bars[MAX_BAR_COUNT];
+    static BarInterpolator interp;          // hop outputs for display-rate clients
     bool wasIdle = true;
 
     bool isFloat = (mixFormat->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
@@ -172,11 +544,19 @@ int main() {
 
     auto lastSend = std::chrono::steady_clock::now();
 
-    fprintf(stderr, "[vis] Waiting for client on ws://127.0.0.1:%d\n", WS_PORT);
+    fprintf(stderr, "[vis] Waiting for client on ws://127.0.0.1:%d\n", port);
 
     while (g_running) {
         ws.poll();
 
+        // Clients on a display clock vs. those taking hop frames at SET_FPS
+        // (trigger clients get neither)
+        uint32_t connected = ws.clientSet(), refreshSet = 0;
+        for (int c = 0; c < WS_MAX_CLIENTS; c++)
+            if ((connected >> c & 1) && refresh[c].hz && !(triggerClients >> c & 1)) refreshSet |= 1u << c;
+        const uint32_t legacySet = connected & ~refreshSet & ~triggerClients;
+        if (ingestClient >= 0 && !(connected >> ingestClient & 1)) ingestClient = -1;
+
         if (!ws.hasClient()) {
             wasIdle = true;
             Sleep(50);
@@ -184,13 +564,43 @@ int main() {
         }
 
         if (wasIdle) {
-            initProcessor();
-            chunkPos = 0;
+            initProcessor(proc);
+            meter.reset();
+            interp.clear();
+            chunkPos = pendingCount = 0;
             wasIdle = false;
             lastSend = std::chrono::steady_clock::now();
             fprintf(stderr, "[vis] Client connected, streaming\n");
         }
 
+        // Process the pending hops in order; the newest goes out at SET_FPS
+        auto flushPending = [&]() {
+            const float* chunks[FFT_BATCH];
+            for (int k = 0; k < pendingCount; k++) chunks[k] = pending[k];
+            processFrames(proc, &batch, chunks, pendingCount, batchBars);
+            for (int k = 0; k < pendingCount; k++) {
+                if (refreshSet) interp.push(batchBars[k], proc.barCount, pendingAt[k]);
+                runTriggers(triggerEval, 0, batchBars[k], proc.barCount, pendingAt[k], connected);
+                history.append(batchBars[k], proc.barCount, std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::system_clock::now().time_since_epoch()).count());
+                LoudnessReading loud;
+                if (loudnessSet && meter.push(pending[k], FRAME_SAMPLES, loud))
+                    sendLoudness(loudnessSet & connected, 0, loud);
+            }
+            const float* last = batchBars[pendingCount - 1];
+            const int64_t captured = pendingAt[pendingCount - 1];
+            pendingCount = 0;
+            auto now = std::chrono::steady_clock::now();
+            if ((legacySet || layersSet) && std::chrono::duration_cast<std::chrono::milliseconds>(now - lastSend).count() >= sendIntervalMs.load()) {
+                if (legacySet) ws.sendBinaryTo(legacySet, last, proc.barCount * sizeof(float), captured);
+                if (layersSet && layers.count) {
+                    sendLayer(layersSet & connected, FRAME_KIND_HARMONIC, layers.harmonic, layers.count, captured);
+                    sendLayer(layersSet & connected, FRAME_KIND_PERCUSSIVE, layers.percussive, layers.count, captured);
+                }
+                lastSend = now;
+            }
+        };
+
         UINT32 packetLength = 0;
         hr = captureClient->GetNextPacketSize(&packetLength);
         if (FAILED(hr)) break;
@@ -212,14 +622,10 @@ int main() {
             }
 
             for (UINT32 i = 0; i < toConvert; i++) {
-                chunk[chunkPos++] = mono[i];
+                pending[pendingCount][chunkPos++] = mono[i];
                 if (chunkPos >= FRAME_SAMPLES) {
-                    processFrame(chunk, bars);
-                    auto now = std::chrono::steady_clock::now();
-                    if (ws.hasClient() && std::chrono::duration_cast<std::chrono::milliseconds>(now - lastSend).count() >= sendIntervalMs.load()) {
-                        ws.sendBinary(bars, g_barCount * sizeof(float));
-                        lastSend = now;
-                    }
+                    pendingAt[pendingCount++] = WsServer::nowNs();
+                    if (pendingCount == FFT_BATCH) flushPending();
                     chunkPos = 0;
                 }
             }
@@ -228,8 +634,42 @@ int main() {
             hr = captureClient->GetNextPacketSize(&packetLength);
             if (FAILED(hr)) break;
         }
+        if (pendingCount) flushPending();
+
+        // Display-rate clients get the bars interpolated at render time
+        int64_t nowNs = WsServer::nowNs();
+        uint32_t dueSet = 0;
+        for (int c = 0; c < WS_MAX_CLIENTS; c++)
+            if ((refreshSet >> c & 1) && refresh[c].due(nowNs)) dueSet |= 1u << c;
+        if (!refreshSet) interp.clear();
+        if (dueSet) {
+            int n = interp.sample(nowNs - INTERP_DELAY_NS, bars);
+            if (n) ws.sendBinaryTo(dueSet, bars, n * sizeof(float), nowNs - INTERP_DELAY_NS);
+        }
+
+        // History answers, a couple of frames per pass
+        for (int c = 0; c < WS_MAX_CLIENTS; c++) {
+            HistoryReply& h = historyOut[c];
+            for (int k = 0; k < 2 && h.pending(); k++) {
+                int taken;
+                size_t len = h.encode(historyFrame, sizeof(historyFrame), &taken);
+                if (!ws.sendBinaryTo(1u << c, historyFrame, len)) break;
+                h.next += taken;
+            }
+        }
 
-        Sleep(1);
+        ws.flush();
+
+        // Poll capture on the coarse Sleep(1) (a scheduler tick, ~15.6 ms
+        // unless something raised the timer resolution).  Only a
+        // display-rate frame due sooner than that is waited for on the
+        // high-resolution timer, up to exactly its deadline.
+        int64_t wakeNs = INT64_MAX;
+        for (int c = 0; c < WS_MAX_CLIENTS; c++)
+            if (refreshSet >> c & 1) wakeNs = std::min(wakeNs, refresh[c].nextNs);
+        nowNs = WsServer::nowNs();
+        if (wakeNs - nowNs <= COARSE_TICK_NS) sleepUntilNs(wakeNs, nowNs);
+        else Sleep(1);
     }
 
     fprintf(stderr, "\n[vis] Shutting down...\n");
@@ -240,6 +680,7 @@ int main() {
     enumerator->Release();
     CoTaskMemFree(mixFormat);
     CoUninitialize();
+    stopKernelTuner();
     ws.stop();
     return 0;
 }
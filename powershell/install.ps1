@@ -490,7 +490,20 @@ New-Item -ItemType Directory -Force -Path $buildWin | Out-Null
 $nativeFiles = @(
     "native/common/protocol.h",
     "native/common/fft.h",
+    "native/common/snapshot.h",
+    "native/common/fft_fixed.h",
+    "native/common/fft_batch.h",
+    "native/common/pipelines.h",
+    "native/common/autotune.h",
     "native/common/ws_server.h",
+    "native/common/latency.h",
+    "native/common/settings.h",
+    "native/common/interp.h",
+    "native/common/pcm_ingest.h",
+    "native/common/loudness.h",
+    "native/common/history.h",
+    "native/common/hpss.h",
+    "native/common/triggers.h",
     "native/windows/main.cpp",
     "native/windows/build.bat"
 )
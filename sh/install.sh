@@ -19,7 +19,7 @@ REPO="wktkow/clear-spotify-client"
 BRANCH="main"
 BASE_URL="https://raw.githubusercontent.com/$REPO/$BRANCH"
 THEME_FILES=("user.css" "color.ini" "theme.js")
-NATIVE_FILES=("native/common/protocol.h" "native/common/fft.h" "native/common/ws_server.h" "native/linux/main.cpp" "native/linux/Makefile" "native/linux/clear-vis.service")
+NATIVE_FILES=("native/common/protocol.h" "native/common/fft.h" "native/common/snapshot.h" "native/common/fft_fixed.h" "native/common/fft_batch.h" "native/common/pipelines.h" "native/common/autotune.h" "native/common/ws_server.h" "native/common/uring.h" "native/common/worker_pool.h" "native/common/latency.h" "native/common/settings.h" "native/common/interp.h" "native/common/pcm_ingest.h" "native/common/replay.h" "native/common/loudness.h" "native/common/history.h" "native/common/hpss.h" "native/common/triggers.h" "native/linux/main.cpp" "native/linux/Makefile" "native/linux/clear-vis.service")
 THEME_NAME="Clear"
 
 cyan()   { printf '\033[1;36m>> %s\033[0m\n' "$*"; }
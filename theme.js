@@ -1098,6 +1098,7 @@
     const MAX_BAR_COUNT = 144;
     const WS_PORT = 7700;
     const WS_RECONNECT_MS = 2000;
+    const LATENCY_ECHO_EVERY = 15; // echo every Nth frame back (see protocol.h)
 
     let barCount = loadSettings().visBarCount || 72;
 
@@ -1113,6 +1114,7 @@
     const wsData = new Float32Array(MAX_BAR_COUNT);
     let reconnectTimer = null;
     let lastMsgTime = 0;
+    let binSeq = 0; // binary frames received on this connection
 
     // Audio source management
     let audioSources = []; // [{name, desc},...] from daemon
@@ -1145,6 +1147,7 @@
 
       ws.onopen = () => {
         wsConnected = true;
+        binSeq = 0;
         hideMessage();
         console.log("[VIS] WebSocket connected to audio bridge");
         // Request available audio sources
@@ -1201,8 +1204,10 @@
           const len = Math.min(barCount, data.length);
           for (let i = 0; i < len; i++) wsData[i] = data[i];
           lastMsgTime = performance.now();
+          const seq = ++binSeq;
           // Draw bars immediately on each snapshot from daemon
           drawBars();
+          if (seq % LATENCY_ECHO_EVERY === 0) echoLatency(seq, lastMsgTime);
           frameCount++;
           if (frameCount <= 3) {
             const sample = [data[0], data[5], data[11], data[17], data[23]];
@@ -1239,6 +1244,20 @@
       };
     }
 
+    // Tell the daemon when frame `seq` reached the screen.  The next
+    // animation frame is the one that paints the new bar heights, so its
+    // callback time stands in for the paint time.
+    function echoLatency(seq, recvTime) {
+      const sock = ws;
+      requestAnimationFrame(() => {
+        const paintTime = performance.now();
+        if (sock !== ws || !sock || sock.readyState !== WebSocket.OPEN) return;
+        sock.send(
+          `LATENCY:${seq},${recvTime.toFixed(2)},${paintTime.toFixed(2)}`,
+        );
+      });
+    }
+
     function disconnectWs() {
       if (reconnectTimer) {
         clearTimeout(reconnectTimer);